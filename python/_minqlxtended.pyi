@@ -251,8 +251,54 @@ class ReliableStatus(tuple[Any, ...]):
     def worst_backlog(self) -> Any: ...
     @property
     def worst_slot(self) -> Any: ...
+    @property
+    def coalesced(self) -> Any: ...
+    @property
+    def shed(self) -> Any: ...
+    @property
+    def cs_waiting(self) -> Any: ...
+    @property
+    def cs_collapsed(self) -> Any: ...
     def _replace(self, **fields: Any) -> "ReliableStatus": ...
 
+class ProfileProbe(tuple[Any, ...]):
+    _fields: Final[tuple[str, ...]]
+    n_fields: Final[int]
+    n_sequence_fields: Final[int]
+    n_unnamed_fields: Final[int]
+    def __init__(self, sequence: Any, /) -> None: ...
+    @property
+    def name(self) -> Any: ...
+    @property
+    def count(self) -> Any: ...
+    @property
+    def total_ns(self) -> Any: ...
+    @property
+    def max_ns(self) -> Any: ...
+    @property
+    def p50_ns(self) -> Any: ...
+    @property
+    def p90_ns(self) -> Any: ...
+    @property
+    def p99_ns(self) -> Any: ...
+    @property
+    def p999_ns(self) -> Any: ...
+    def _replace(self, **fields: Any) -> "ProfileProbe": ...
+
+class ProfileStatus(tuple[Any, ...]):
+    _fields: Final[tuple[str, ...]]
+    n_fields: Final[int]
+    n_sequence_fields: Final[int]
+    n_unnamed_fields: Final[int]
+    def __init__(self, sequence: Any, /) -> None: ...
+    @property
+    def enabled(self) -> Any: ...
+    @property
+    def elapsed_ns(self) -> Any: ...
+    @property
+    def probes(self) -> Any: ...
+    def _replace(self, **fields: Any) -> "ProfileStatus": ...
+
 class StatPowerups(tuple[Any, ...]):
     _fields: Final[tuple[str, ...]]
     n_fields: Final[int]
@@ -1188,6 +1234,7 @@ class EngineStateError(RuntimeError):
 
 def add_console_command(name: str, /) -> None: ...
 def add_event(entity_id: int, event: int, event_parm: int = ..., /) -> None: ...
+def begin_mergeable_prints() -> None: ...
 def callvote(vote: str, display: str, time: int = ..., caller_id: int = ..., /) -> None: ...
 def client_command(client_id: int, cmd: str, /) -> bool: ...
 def console_command(cmd: str, /) -> None: ...
@@ -1199,6 +1246,7 @@ def destroy_kamikaze_timers() -> bool: ...
 def dev_print_items() -> None: ...
 def drop_holdable(client_id: int, /) -> bool: ...
 def drop_item(client_id: int, item_id: int, angle: float = ..., /) -> int | None: ...
+def end_mergeable_prints() -> None: ...
 def entities(inuse: bool = ..., etype: int | None = ..., start: int = ...,
              stop: int = ..., classname: str | None = ...) -> Iterator[Entity]: ...
 def force_vote(pass_it: bool, /) -> bool: ...
@@ -1209,21 +1257,27 @@ def get_userinfo(client_id: int, /) -> str | None: ...
 def items() -> Iterator[Item]: ...
 def kick(client_id: int, reason: str | None, /) -> None: ...
 def link_entity(entity_id: int, /) -> bool: ...
+def metric_add(name: str, delta: int = 1, /) -> None: ...
 def player_expanded_stats(client_id: int, /) -> PlayerExpandedStats | None: ...
 def player_info(client_id: int, /) -> PlayerInfo | None: ...
 def player_spawn(client_id: int, /) -> bool: ...
 def player_state(client_id: int, /) -> PlayerState | None: ...
 def player_stats(client_id: int, /) -> PlayerStats | None: ...
 def players_info() -> list[PlayerInfo | None]: ...
+def profile_status() -> ProfileStatus: ...
 def register_handler(event: str, handler: Callable[..., Any] | None, /) -> None: ...
+def reliable_history(client_id: int, frames: int = ..., /) -> bytes: ...
 def reliable_status() -> ReliableStatus: ...
 def remove_dropped_items() -> bool: ...
 def remove_entity(entity_id: int, /) -> bool: ...
 def replace_items(entity: int | str, item: int | str, /) -> bool: ...
+def save_demo_window(client_id: int, seconds: int, /) -> str | None: ...
 def send_server_command(client_id: int | None, cmd: str, /) -> bool: ...
+def send_server_command_many(client_ids: Sequence[int], cmd: str, /) -> int: ...
 def set_configstring(index: int, value: str, /) -> None: ...
 def set_cvar(name: str, value: str, flags: int = ..., force: bool = ...) -> Cvar: ...
 def set_cvar_limit(name: str, value: str, minimum: str, maximum: str, flags: int = ..., /) -> None: ...
+def set_server_command_filter(words: Sequence[str] | None, /) -> bool: ...
 def slay_with_mod(client_id: int, mod: int, /) -> bool: ...
 def spawn_entity(classname: str, keys: dict[str, str | int | float | Sequence[float]] | None = ..., /) -> Entity | None: ...
 def spawn_item(item_id: int, x: int, y: int, z: int, /) -> bool: ...
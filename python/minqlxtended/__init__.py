@@ -55,14 +55,16 @@ from _minqlxtended import (  # noqa: F401
     add_console_command, add_event, callvote, client_command, console_command, console_print,
     cvar, cvars, demo_status, destroy_kamikaze_timers, dev_print_items, drop_holdable,
     drop_item, entities, force_vote, force_weapon_respawn_time, get_cvar, get_userinfo,
-    items, kick, link_entity, player_expanded_stats, player_info, player_spawn, player_state,
-    player_stats, players_info, register_handler, reliable_status, remove_dropped_items,
-    remove_entity, replace_items, send_server_command, set_configstring, set_cvar,
-    set_cvar_limit, slay_with_mod, spawn_entity, spawn_item, start_demo, stop_demo,
-    unlink_entity,
+    items, kick, link_entity, metric_add, player_expanded_stats, player_info, player_spawn,
+    player_state, player_stats, players_info, profile_status, register_handler,
+    reliable_history, reliable_status, remove_dropped_items, remove_entity, replace_items,
+    save_demo_window, send_server_command, send_server_command_many, set_configstring,
+    set_cvar, set_cvar_limit, set_server_command_filter, slay_with_mod, spawn_entity,
+    spawn_item, start_demo, stop_demo, unlink_entity,
     # Struct sequences. Snapshots, taken when you ask for them.
     DemoStatus, Flight, Keys, PlayerExpandedStats, PlayerInfo, PlayerState, PlayerStats,
-    Powerups, ReliableStatus, StatHoldables, StatPowerups, Vector3, Weapons,
+    Powerups, ProfileProbe, ProfileStatus, ReliableStatus, StatHoldables, StatPowerups,
+    Vector3, Weapons,
     # Live engine views, and the singletons among them.
     Client, Cvar, Entity, EntityShared, EntityState, ExpandedStats, GameClient, IntArray,
     Item, Level, MatchState, Netchan, Persistant, PlayerStateView, RaceInfo, RoundStateView,
@@ -112,6 +114,7 @@ from ._core import (  # noqa: F401
     reload_plugin, set_map_subtitles, setting,
     set_plugins_version, spawn_points, starting_weapon_bit, stats_listener, thread,
     threading_excepthook, toggle_starting_weapon, unload_plugin, uptime, vote,
+    watchdog_stacks,
 )
 from ._configstring import (  # noqa: F401
     apply_variable_changes, configstring, configstring_variables, player_configstring,
@@ -125,13 +128,15 @@ from ._mapinfo import (  # noqa: F401
 )
 from ._plugin import Identifier, Plugin  # noqa: F401
 from ._game import Game, NonexistentGameError  # noqa: F401
-from ._events import EVENT_DISPATCHERS, EventDispatcher, EventDispatcherManager  # noqa: F401
+from ._events import (  # noqa: F401
+    EVENT_DISPATCHERS, EventDispatcher, EventDispatcherManager, handler_profile,
+)
 from ._commands import (  # noqa: F401
     AbstractChannel, BLUE_TEAM_CHAT_CHANNEL, BlueTeamChatChannel, CHAT_CHANNEL, COMMANDS,
     CONSOLE_CHANNEL, ChatChannel, ClientCommandChannel, Command, CommandInvoker,
     ConsoleChannel, FREE_CHAT_CHANNEL, FreeChatChannel, MAX_MSG_LENGTH,
     RED_TEAM_CHAT_CHANNEL, RedTeamChatChannel, SPECTATOR_CHAT_CHANNEL,
-    SpectatorChatChannel, TellChannel, re_color_tag,
+    SpectatorChatChannel, TellChannel, TellManyChannel, mergeable_prints, re_color_tag,
 )
 from ._votes import CUSTOM_VOTES, CustomVote, CustomVoteManager  # noqa: F401
 from ._handlers import (  # noqa: F401
@@ -20,10 +20,14 @@
 from __future__ import annotations
 
 import minqlxtended
+import contextlib
 import threading
 import re
 from typing import Any
 
+from _minqlxtended import begin_mergeable_prints as _begin_mergeable_prints
+from _minqlxtended import end_mergeable_prints as _end_mergeable_prints
+
 from ._core import _QUOTED_FORBIDDEN, _check_command_value
 from ._enums import Priority, Return, Team
 
@@ -47,6 +51,8 @@ __all__ = (
     "SPECTATOR_CHAT_CHANNEL",
     "SpectatorChatChannel",
     "TellChannel",
+    "TellManyChannel",
+    "mergeable_prints",
     "re_color_tag",
 )
 
@@ -67,6 +73,28 @@ def center_print(client_id, msg):
 
 re_color_tag = re.compile(r"\^[0-7]")
 
+
+@contextlib.contextmanager
+def mergeable_prints():
+    """Let the prints sent to particular players inside arrive a frame late, folded into as
+    few reliable commands as they fit in::
+
+        with minqlxtended.mergeable_prints():
+            for line in summary:
+                minqlxtended.send_server_command(player.id, f'print "{line}\\n"')
+
+    Each client has 64 reliable slots, and eight one-line prints take eight of them. Only
+    newline-terminated prints merge, and only while the reliable command guard is on.
+    Broadcasts go out as usual. Game thread only. :meth:`Plugin.tell` takes ``merge=True``
+    for the same thing.
+
+    """
+    _begin_mergeable_prints()
+    try:
+        yield
+    finally:
+        _end_mergeable_prints()
+
 # COMMANDS
 
 class Command:
@@ -404,10 +432,12 @@ class AbstractChannel:
     def name(self):
         return self._name
 
-    def reply(self, msg: Any, limit: int = 100, delimiter: str = " ") -> None:
+    def reply(self, msg: Any, limit: int = 100, delimiter: str = " ",
+              merge: bool = False) -> None:
         """Send *msg* to whoever this channel reaches.
 
-        Every channel takes the same arguments, whether or not it uses them.
+        Every channel takes the same arguments, whether or not it uses them. *merge* is
+        :func:`mergeable_prints` for the send, where the channel sends prints.
         """
         raise NotImplementedError()
 
@@ -463,7 +493,16 @@ class ChatChannel(AbstractChannel):
         return [p.id for p in minqlxtended.Player.all_players() if p.team == self.team]
 
     @minqlxtended.next_frame
-    def reply(self, msg, limit=100, delimiter=" "):
+    def reply(self, msg, limit=100, delimiter=" ", merge=False):
+        # merge=True is mergeable_prints() around the send. Tells only: a broadcast is one
+        # reliable command per line whatever happens.
+        if merge:
+            with mergeable_prints():
+                self._send(msg, limit, delimiter)
+        else:
+            self._send(msg, limit, delimiter)
+
+    def _send(self, msg, limit, delimiter):
         # TODO: rcon can print quotes to clients using NET_OutOfBandPrint. Maybe we should too?
         msg = str(msg).replace("\"", "'")
         last_color = ""
@@ -484,9 +523,8 @@ class ChatChannel(AbstractChannel):
         for s in joined_msgs:
             if targets is None:
                 minqlxtended.send_server_command(None, self.fmt.format(last_color + s))
-            else:
-                for cid in targets:
-                    minqlxtended.send_server_command(cid, self.fmt.format(last_color + s))
+            elif targets:
+                minqlxtended.send_server_command_many(targets, self.fmt.format(last_color + s))
 
             find = re_color_tag.findall(s)
             if find:
@@ -531,13 +569,28 @@ class TellChannel(ChatChannel):
 
         return [cid]
 
+class TellManyChannel(ChatChannel):
+    """Private messages to several players at once. Each line goes to all of them in one
+    send_server_command_many call. Recipients that no longer resolve are skipped, not
+    raised on."""
+    def __init__(self, players):
+        super().__init__("tell")
+        self.recipients = list(players)
+
+    def __repr__(self):
+        return f"tell {len(self.recipients)} players"
+
+    def _targets(self):
+        ids = (minqlxtended.Plugin.client_id(p) for p in self.recipients)
+        return [cid for cid in ids if cid is not None]
+
 class ConsoleChannel(AbstractChannel):
     """A channel that prints to the console."""
     def __init__(self):
         super().__init__("console")
 
-    def reply(self, msg, limit=100, delimiter=" "):
-        # limit and delimiter are accepted and ignored; the console wraps its own output.
+    def reply(self, msg, limit=100, delimiter=" ", merge=False):
+        # The rest are accepted and ignored; the console wraps its own output.
         minqlxtended.console_print(str(msg))
 
 class ClientCommandChannel(AbstractChannel):
@@ -550,8 +603,8 @@ class ClientCommandChannel(AbstractChannel):
     def __repr__(self):
         return f"client_command {minqlxtended.Plugin.player(self.recipient).id}"
 
-    def reply(self, msg, limit=100, delimiter=" "):
-        self.tell_channel.reply(msg, limit, delimiter)
+    def reply(self, msg, limit=100, delimiter=" ", merge=False):
+        self.tell_channel.reply(msg, limit, delimiter, merge)
 
 
 # MODULE CONSTANTS
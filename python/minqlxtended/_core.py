@@ -55,7 +55,7 @@ __all__ = (
     "toggle_starting_weapon",
     # Logging and diagnostics.
     "get_logger", "handle_exception", "log_exception", "perf_trampoline",
-    "queued_handler", "threading_excepthook", "uptime",
+    "queued_handler", "threading_excepthook", "uptime", "watchdog_stacks",
     # Server identity and state.
     "MapTitles", "map_titles", "owner", "plugins_version", "set_map_subtitles",
     "set_plugins_version",
@@ -416,6 +416,38 @@ def perf_trampoline(action: str = "") -> str:
     return f"Perf trampoline is {'on' if sys.is_stack_trampoline_active() else 'off'}."
 
 
+def watchdog_stacks(game_thread: int) -> str:
+    """Every Python thread's stack, the game thread's first. Backs the frame watchdog, which
+    calls this from its own thread once a frame has run past its budget.
+
+    :param game_thread: The game thread's :func:`threading.get_ident`.
+    :type game_thread: int
+    :returns: str -- the stacks, ready for the watchdog's log.
+
+    """
+    frames = sys._current_frames()
+    # Our own frame, on the watchdog's thread, says nothing about the stall.
+    frames.pop(threading.get_ident(), None)
+    names = {t.ident: t.name for t in threading.enumerate()}
+    out = []
+    if game_thread not in frames:
+        out.append("game thread: no Python frame, so the time went in the engine, in C, or "
+                   "waiting for the GIL one of the threads below held.\n")
+
+    for ident in sorted(frames, key=lambda i: i != game_thread):
+        frame = frames[ident]
+        label = "game thread" if ident == game_thread else f"thread {names.get(ident, ident)!r}"
+        # The events being dispatched, outermost first, read off EventDispatcher.dispatch frames.
+        events = [f.f_locals["self"].name for f, _ in traceback.walk_stack(frame)
+                  if f.f_code.co_name == "dispatch"
+                  and isinstance(f.f_locals.get("self"), minqlxtended.EventDispatcher)]
+        suffix = f", dispatching {' > '.join(reversed(events))}" if events else ""
+        out.append(f"{label}{suffix}:\n")
+        out.extend(traceback.format_stack(frame))
+
+    return "".join(out)
+
+
 def owner() -> int | None:
     """Returns the SteamID64 of the owner. This is set in the config."""
     try:
@@ -754,7 +786,7 @@ def _mark(func, attr, entry):
     return func
 
 
-def hook(event, priority=Priority.NORMAL):
+def hook(event, priority=Priority.NORMAL, *, commands=None):
     """Hook an event from the handler itself, instead of calling
     :meth:`minqlxtended.Plugin.add_hook` in the plugin's ``__init__``.
 
@@ -773,11 +805,14 @@ def hook(event, priority=Priority.NORMAL):
     :type event: str
     :param priority: The priority of the hook, which decides the order handlers run in.
     :type priority: minqlxtended.Priority
+    :param commands: ``server_command`` only: the first words of the commands the handler
+        wants. See :meth:`minqlxtended.Plugin.add_hook`.
+    :type commands: str or Iterable[str] or None
 
     """
 
     def wrap(func):
-        return _mark(func, _HOOK_ATTR, (event, priority))
+        return _mark(func, _HOOK_ATTR, (event, priority, commands))
 
     return wrap
 
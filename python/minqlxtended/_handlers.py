@@ -38,7 +38,7 @@ from ._commands import (BLUE_TEAM_CHAT_CHANNEL, FREE_CHAT_CHANNEL, RED_TEAM_CHAT
                         SPECTATOR_CHAT_CHANNEL)
 
 # The handle_* functions below are the C ABI, so they are not exported.
-# register_handlers() reaches them as module globals, and the two gated ones are resolved
+# register_handlers() reaches them as module globals, and the gated ones are resolved
 # off this module by name.
 __all__ = (
     "NEXT_FRAME_TASKS_MAX",
@@ -120,10 +120,12 @@ def handle_client_command(client_id, cmd):
 
 def handle_server_command(client_id, cmd):
     try:
-        # Runs for every server command sent, so the Player construction (a C player_info
-        # call) is skipped entirely while nothing hooks the event.
+        # Gated, so C only calls this while something hooks the event. A dispatch already
+        # in flight when the last hook goes away must not pay for a Player.
         dispatcher = minqlxtended.EVENT_DISPATCHERS["server_command"]
         if dispatcher._handler_chain:
+            if isinstance(client_id, tuple):
+                return _dispatch_server_command_many(dispatcher, client_id, cmd)
             try:
                 player = minqlxtended.Player(client_id) if client_id >= 0 else None
             except minqlxtended.NonexistentPlayerError:
@@ -140,6 +142,27 @@ def handle_server_command(client_id, cmd):
         minqlxtended.log_exception()
         return True
 
+def _dispatch_server_command_many(dispatcher, client_ids, cmd):
+    """send_server_command_many's dispatch: one call from C for the whole recipient set,
+    and the handlers still see one player at a time. The same command for everyone comes
+    back as a single str, so C can feed the reliable guard in one pass.
+
+    """
+    results = []
+    uniform = True
+    for client_id in client_ids:
+        result = cmd
+        try:
+            retval = dispatcher.dispatch(minqlxtended.Player(client_id), cmd)
+            if retval is False or isinstance(retval, str):
+                result = retval
+        except minqlxtended.NonexistentPlayerError:
+            pass
+        uniform = uniform and result == cmd
+        results.append(result)
+
+    return cmd if uniform else results
+
 # Work to run on the main thread just before a frame, queued by @minqlxtended.next_frame.
 frame_tasks = sched.scheduler()
 
@@ -189,6 +212,7 @@ def handle_frame():
     global _next_frame_dropped
     if _next_frame_dropped:
         dropped, _next_frame_dropped = _next_frame_dropped, 0
+        minqlxtended.metric_add("next_frame_dropped", dropped)
         minqlxtended.get_logger().warning(
             "Dropped %d next_frame task(s): the queue hit its %d-task limit, which "
             "usually means frames stopped dispatching while a thread kept queueing.",
@@ -1014,7 +1038,6 @@ def register_handlers():
     minqlxtended.register_handler("rcon", handle_rcon)
     minqlxtended.register_handler("custom_command", handle_console_command)
     minqlxtended.register_handler("client_command", handle_client_command)
-    minqlxtended.register_handler("server_command", handle_server_command)
     minqlxtended.register_handler("frame", handle_frame)
     minqlxtended.register_handler("new_game", handle_new_game)
     minqlxtended.register_handler("spawn_server", handle_spawn_server)
@@ -1047,6 +1070,6 @@ def register_handlers():
     minqlxtended.register_handler("team_switch_attempt", handle_team_switch_attempt)
     minqlxtended.register_handler("userinfo", handle_userinfo)
 
-    # `damage` and `weapon_fired` are missing from this list because they're gated; their
-    # dispatchers arm the slot only while the event has hooks. See
-    # EventDispatcher.gated_handler.
+    # `damage`, `weapon_fired`, `cvar_changed` and `server_command` are missing from this
+    # list because they're gated; their dispatchers arm the slot only while the event has
+    # hooks. See EventDispatcher.gated_handler.
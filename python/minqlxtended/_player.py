@@ -817,6 +817,18 @@ class Player:
         """
         return minqlxtended.stop_demo(self.id)
 
+    def save_demo_window(self, seconds: int) -> str | None:
+        """Saves the last ``seconds`` of this player's view as a demo of its own, out of the
+        replay buffer ``sv_demoReplay`` keeps. Works whether or not they are being recorded.
+        Playback has to start at a full snapshot, and those come every ten seconds, so the
+        demo may begin up to that much earlier. Game thread only, so marshal with
+        :func:`minqlxtended.next_frame`.
+
+        :returns: str | None -- where the demo will be once ``demo_finished`` fires for it,
+                  or None if nothing is buffered for this player.
+        """
+        return minqlxtended.save_demo_window(self.id, seconds)
+
     @property
     def is_alive(self) -> bool:
         return self._live_state.is_alive
@@ -150,8 +150,8 @@ class Plugin:
 
         for attribute, entries in cls._declared_hooks:
             handler = getattr(self, attribute)
-            for event, priority in entries:
-                self.add_hook(event, handler, priority)
+            for event, priority, commands in entries:
+                self.add_hook(event, handler, priority, commands=commands)
 
         for attribute, entries in cls._declared_commands:
             handler = getattr(self, attribute)
@@ -231,7 +231,8 @@ class Plugin:
         return minqlxtended.get_logger(self)
 
     def add_hook(self, event: str, handler: Callable[..., Any],
-                 priority: int = Priority.NORMAL) -> None:
+                 priority: int = Priority.NORMAL, *,
+                 commands: str | Iterable[str] | None = None) -> None:
         """Hook an event, so *handler* is called every time it is raised.
 
         Everything registered here comes off again when the plugin is unloaded.
@@ -242,9 +243,14 @@ class Plugin:
             against the event's at registration.
         :param priority: Where in the handler chain this sits.
         :type priority: minqlxtended.Priority
+        :param commands: ``server_command`` only: the first words of the commands to call
+            *handler* for, such as ``"cs"`` or ``("print", "chat")``. Hooking only what you
+            need keeps the engine from calling into Python for everything else.
+        :type commands: str or Iterable[str] or None
         :raises KeyError: if *event* is not a known event name.
         :raises ValueError: if *priority* is not a valid level, or this handler is already
             hooked to the event at this priority.
+        :raises TypeError: if *commands* is given for any other event.
         :raises AssertionError: if the event needs ZeroMQ stats and ``zmq_stats_enable``
             is zero.
 
@@ -252,7 +258,13 @@ class Plugin:
         # Register first, record second. A bad event name, a duplicate handler or a
         # zmq-gated event all raise out of add_hook, and a hook recorded but never
         # registered makes unload_plugin's replay raise for good.
-        minqlxtended.EVENT_DISPATCHERS[event].add_hook(self.name, handler, priority)
+        if commands is None:
+            minqlxtended.EVENT_DISPATCHERS[event].add_hook(self.name, handler, priority)
+        elif event != "server_command":
+            raise TypeError(f"commands= only applies to server_command, not '{event}'.")
+        else:
+            minqlxtended.EVENT_DISPATCHERS[event].add_hook(self.name, handler, priority,
+                                                           commands=commands)
         self._hooks.append((event, handler, priority))
 
     def remove_hook(self, event: str, handler: Callable[..., Any],
@@ -988,6 +1000,7 @@ class Plugin:
     # Every message is a reliable command, and each client has a 64-slot ring before the
     # engine drops it with "a reliable command was cycled out". reliable.c merges
     # consecutive *broadcast* prints, so a loop that tells N players costs N commands.
+    # tell_many still costs one per player, but only one call into C and one dispatch.
 
     @classmethod
     def reply_lines(cls, recipient: Any, lines: Sequence[str]) -> None:
@@ -1009,16 +1022,20 @@ class Plugin:
         cls._reply(recipient, "\n".join(lines))
 
     @classmethod
-    def tell_many(cls, players: Iterable["Player"], message: str, limit: int = 100) -> None:
+    def tell_many(cls, players: Iterable["Player"], message: str, limit: int = 100,
+                  merge: bool = False) -> None:
         """Send the same message to several players.
 
         Broadcasts instead when *players* covers everyone currently connected, which turns
-        N reliable commands into one.
+        N reliable commands into one. Otherwise each line goes to all of them through a
+        single ``send_server_command_many``, rather than one send per player.
 
         :param players: The players to send to.
         :type players: list
         :param message: The message.
         :type message: str
+        :param merge: As for :meth:`tell`. Ignored when this broadcasts.
+        :type merge: bool
         """
         players = list(players)
         if not players:
@@ -1029,8 +1046,7 @@ class Plugin:
             cls.msg(message, limit=limit)
             return
 
-        for player in players:
-            player.tell(message, limit=limit)
+        minqlxtended.TellManyChannel(players).reply(message, limit=limit, merge=merge)
 
     @classmethod
     def tell(cls, msg: Any, recipient: Any, **kwargs: Any) -> None:
@@ -1040,6 +1056,11 @@ class Plugin:
         :type msg: str
         :param recipient: The player that should receive the message.
         :type recipient: str/int/minqlxtended.Player
+        :param merge: Let this arrive a frame later, sharing reliable commands with the
+            other tells sent that frame. For a block of lines, such as an end-of-match
+            summary, that would otherwise take a reliable slot each. See
+            :func:`minqlxtended.mergeable_prints`.
+        :type merge: bool
 
         .. note::
             Returns None. The send is queued for the next frame, so success isn't knowable
@@ -319,7 +319,9 @@ class Redis(AbstractDatabase):
         if ttl > 0:
             cached = Redis._permissions.get(steam_id)
             if cached is not None and cached[1] > now:
+                minqlxtended.metric_add("permission_cache_hits")
                 return cached[0]
+            minqlxtended.metric_add("permission_cache_misses")
 
         key = f"minqlx:players:{steam_id}:permission"
         try:
@@ -0,0 +1,248 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * `make bench`: drives the dispatchers through a scripted sequence of frames against the fake
+ * engine in fake_engine.c, and reports what each kind of event costs from the C side. Every
+ * measured event has one no-op Python hook, so the figures are the dispatch path itself: the GIL,
+ * argument marshalling, the Python handler in _handlers.py, the Player it builds, and the event
+ * chain. They are not a plugin's cost. Single-threaded, so GIL waits are only ever uncontended.
+ *
+ *   bin/minqlxtended_bench [-f frames] [-c clients] [-p]
+ *   bin/minqlxtended_bench -r capture.qlxcap [-P plugin,plugin] [-d pluginsdir] [-t]
+ *
+ * -p also turns the profiler on for the timed frames and prints its report, for the percentiles.
+ * -r replays a file written by "qlx_capture" instead (see replay.c), with the -P plugins loaded
+ * from -d, so the figures include what those plugins do with a real server's traffic. -t keeps
+ * the captured frame timing rather than running flat out.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "python/pyminqlxtended.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "fake_engine.h"
+#include "replay.h"
+#include "features/game_events.h"
+#include "features/profile.h"
+#include "features/reliable.h"
+#include "engine/quake_common.h"
+
+#define BENCH_WARMUP_FRAMES 200
+
+typedef enum {
+    BENCH_FRAME = 0,
+    BENCH_GAME_EVENTS,
+    BENCH_WEAPON_FIRED,
+    BENCH_DAMAGE,
+    BENCH_CHAT,
+    BENCH_CLIENT_COMMAND,
+    BENCH_SERVER_COMMAND,
+    BENCH_CONFIGSTRING,
+    BENCH_COUNT
+} bench_event_t;
+
+static const char* const bench_names[BENCH_COUNT] = {
+    "frame",
+    "game event poll",
+    "weapon_fired",
+    "damage",
+    "chat",
+    "client_command",
+    "server_command",
+    "set_configstring",
+};
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+} bench_stat_t;
+
+static bench_stat_t bench_stats[BENCH_COUNT];
+static int bench_recording;
+
+// One no-op hook per measured event. The gated ones arm their C slot when hooked.
+static const char bench_hooks[] = "import minqlxtended\n"
+                                  "def _bench_noop(*args):\n"
+                                  "    return None\n"
+                                  "for _event in ('frame', 'weapon_fired', 'damage', 'chat', 'client_command',\n"
+                                  "               'server_command', 'set_configstring'):\n"
+                                  "    minqlxtended.EVENT_DISPATCHERS[_event].add_hook('bench', _bench_noop)\n";
+
+static uint64_t bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#define BENCH(kind, call)                                   \
+    do {                                                    \
+        uint64_t t0_ = bench_now();                         \
+        call;                                               \
+        if (bench_recording) {                              \
+            bench_stats[kind].count++;                      \
+            bench_stats[kind].total_ns += bench_now() - t0_; \
+        }                                                   \
+    } while (0)
+
+/*
+ * One frame of a busy duel-to-CA sized game, per client: a shot every frame, a hit every other,
+ * a chat line every two seconds and a command every second at sv_fps 40, plus the engine's own
+ * score configstrings each frame and a player configstring now and then. Staggered by client so
+ * no frame carries everyone's chat at once.
+ */
+static void bench_frame(int frame, int clients) {
+    static char cmd[64], text[128], cs[256];
+
+    level->time += 25;
+    BENCH(BENCH_FRAME, FrameDispatcher());
+    BENCH(BENCH_GAME_EVENTS, GameEvents_Frame());
+
+    for (int i = 0; i < clients; i++) {
+        BENCH(BENCH_WEAPON_FIRED, WeaponFiredDispatcher(i, WP_MACHINEGUN));
+        if ((frame + i) % 2 == 0) {
+            BENCH(BENCH_DAMAGE, DamageDispatcher((i + 1) % clients, i, 7, 0, MOD_MACHINEGUN));
+        }
+        if ((frame + i) % 80 == 0) {
+            snprintf(text, sizeof(text), "\"gg from %d at frame %d\"", i, frame);
+            BENCH(BENCH_CHAT, ChatDispatcher(i, -1, SAY_ALL, text));
+        }
+        if ((frame + i) % 40 == 0) {
+            snprintf(cmd, sizeof(cmd), "score");
+            BENCH(BENCH_CLIENT_COMMAND, My_SV_ExecuteClientCommand(&svs->clients[i], cmd, qtrue));
+            BENCH(BENCH_SERVER_COMMAND, My_SV_SendServerCommand(&svs->clients[i], "print \"frame %d\n\"", frame));
+        }
+        if ((frame + i) % 160 == 0) {
+            snprintf(cs, sizeof(cs), "n\\Player%d\\t\\%d\\model\\sarge\\c1\\%d", i, i % 2 ? TEAM_BLUE : TEAM_RED, frame);
+            BENCH(BENCH_CONFIGSTRING, My_SV_SetConfigstring(CS_PLAYERS + i, cs));
+        }
+    }
+
+    snprintf(cs, sizeof(cs), "%d", frame / 40);
+    BENCH(BENCH_CONFIGSTRING, My_SV_SetConfigstring(CS_SCORES1, cs));
+    BENCH(BENCH_CONFIGSTRING, My_SV_SetConfigstring(CS_SCORES1 + 1, cs));
+    Reliable_Flush();
+}
+
+static void bench_report(int frames, uint64_t wall_ns) {
+    printf("%d frames, %llu.%03llu ms of wall time, %llu.%03llu us per frame\n", frames,
+           (unsigned long long)(wall_ns / 1000000ull), (unsigned long long)(wall_ns % 1000000ull / 1000ull),
+           (unsigned long long)(wall_ns / (uint64_t)frames / 1000ull),
+           (unsigned long long)(wall_ns / (uint64_t)frames % 1000ull));
+    printf("%-18s %10s %12s %10s\n", "event", "count", "total ms", "ns/event");
+    for (int i = 0; i < BENCH_COUNT; i++) {
+        const bench_stat_t* s = &bench_stats[i];
+        if (!s->count) {
+            continue;
+        }
+        printf("%-18s %10llu %8llu.%03llu %10llu\n", bench_names[i], (unsigned long long)s->count,
+               (unsigned long long)(s->total_ns / 1000000ull), (unsigned long long)(s->total_ns % 1000000ull / 1000ull),
+               (unsigned long long)(s->total_ns / s->count));
+    }
+    printf("%u configstring writes and %u server commands reached the fake engine.\n",
+           FakeEngine_ConfigstringWrites(), FakeEngine_ServerCommands());
+}
+
+int main(int argc, char** argv) {
+    int frames = 4000, clients = 16, profile = 0;
+    const char *replay = NULL, *plugins = NULL, *plugins_path = NULL;
+    int realtime = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:c:pr:P:d:t")) != -1) {
+        switch (opt) {
+        case 'f':
+            frames = atoi(optarg);
+            break;
+        case 'c':
+            clients = atoi(optarg);
+            break;
+        case 'p':
+            profile = 1;
+            break;
+        case 'r':
+            replay = optarg;
+            break;
+        case 'P':
+            plugins = optarg;
+            break;
+        case 'd':
+            plugins_path = optarg;
+            break;
+        case 't':
+            realtime = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f frames] [-c clients] [-p]\n       %s -r capture [-P plugins] [-d pluginsdir] [-t]\n",
+                    argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (frames < 1 || clients < 2 || clients > MAX_CLIENTS) {
+        fprintf(stderr, "bench: need at least one frame and 2 to %d clients\n", MAX_CLIENTS);
+        return 2;
+    }
+
+    NoteGameThread();
+    if (replay) {
+        return Replay_Run(replay, plugins, plugins_path, realtime);
+    }
+    FakeEngine_Init(clients, clients);
+    Reliable_Init();
+
+    if (PyMinqlxtended_Initialize() != PYM_SUCCESS) {
+        fprintf(stderr, "bench: Python did not initialise; is python/ on PYTHONPATH?\n");
+        return 1;
+    }
+
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    int failed              = PyRun_SimpleString(bench_hooks);
+    PyGILState_Release(gstate);
+    if (failed) {
+        fprintf(stderr, "bench: could not hook the benchmarked events\n");
+        return 1;
+    }
+
+    for (int f = 0; f < BENCH_WARMUP_FRAMES; f++) {
+        bench_frame(f, clients);
+    }
+
+    if (profile) {
+        Profile_SetEnabled(1);
+    }
+    bench_recording = 1;
+    uint64_t start  = bench_now();
+    for (int f = 0; f < frames; f++) {
+        bench_frame(BENCH_WARMUP_FRAMES + f, clients);
+    }
+    uint64_t wall = bench_now() - start;
+    bench_recording = 0;
+
+    bench_report(frames, wall);
+    if (profile) {
+        Profile_Report();
+    }
+    return 0;
+}
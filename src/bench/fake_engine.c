@@ -0,0 +1,368 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "python/pyminqlxtended.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "fake_engine.h"
+#include "features/reliable.h"
+#include "features/scoreboard.h"
+#include "engine/quake_common.h"
+
+// What dllmain.c resolves at load, and the module globals InitializeVm fills in per map.
+serverStatic_t* svs;
+server_t* sv;
+gentity_t* g_entities;
+level_locals_t* level;
+gitem_t* bg_itemlist;
+int bg_numItems;
+cvar_t* sv_maxclients;
+cvar_t** cvar_vars;
+atomic_int vm_rehooking = 0;
+
+qboolean* mp_pausedByServer;
+int* mp_unpauseTime;
+int* mp_pauseCaller;
+int* mp_teamLocked;
+int* mp_timeoutsUsed;
+int* mp_autoActionState;
+
+// Unresolved, as on a build whose pattern missed. Nothing the bench drives calls them.
+MSG_WriteBits_ptr MSG_WriteBits;
+SV_LinkEntity_ptr SV_LinkEntity;
+SV_UnlinkEntity_ptr SV_UnlinkEntity;
+G_AddEvent_ptr G_AddEvent;
+G_Damage_ptr G_Damage;
+G_FreeEntity_ptr G_FreeEntity;
+G_SpawnGEntityFromSpawnVars_ptr G_SpawnGEntityFromSpawnVars;
+LaunchItem_ptr LaunchItem;
+Drop_Item_ptr Drop_Item;
+MP_LockOrUnlockTeam_ptr MP_LockOrUnlockTeam;
+
+#define FAKE_CVARS 256
+
+static cvar_t fake_cvars[FAKE_CVARS];
+static int fake_cvar_count;
+static cvar_t* fake_cvar_head;
+static char* fake_configstrings[MAX_CONFIGSTRINGS];
+static unsigned fake_configstring_writes;
+static unsigned fake_server_commands;
+
+static void fake_cvar_assign(cvar_t* var, const char* value) {
+    free(var->string);
+    var->string  = strdup(value);
+    var->value   = (float)atof(value);
+    var->integer = atoi(value);
+    var->modificationCount++;
+    var->modified = qtrue;
+}
+
+static cvar_t* __cdecl fake_Cvar_FindVar(const char* var_name) {
+    for (int i = 0; i < fake_cvar_count; i++) {
+        if (!strcasecmp(fake_cvars[i].name, var_name)) {
+            return &fake_cvars[i];
+        }
+    }
+    return NULL;
+}
+
+static cvar_t* __cdecl fake_Cvar_Get(const char* var_name, const char* var_value, int flags) {
+    cvar_t* var = fake_Cvar_FindVar(var_name);
+    if (var) {
+        var->flags |= flags;
+        return var;
+    }
+    if (fake_cvar_count == FAKE_CVARS) {
+        fprintf(stderr, "bench: out of cvars at %s\n", var_name);
+        exit(1);
+    }
+
+    var                = &fake_cvars[fake_cvar_count++];
+    var->name          = strdup(var_name);
+    var->resetString   = strdup(var_value);
+    var->defaultString = strdup(var_value);
+    var->flags         = flags;
+    var->next          = fake_cvar_head;
+    fake_cvar_head     = var;
+    fake_cvar_assign(var, var_value);
+    return var;
+}
+
+static cvar_t* __cdecl fake_Cvar_GetLimit(const char* var_name, const char* var_value, const char* min, const char* max,
+                                          int flag) {
+    cvar_t* var = fake_Cvar_Get(var_name, var_value, flag);
+    if (!var->minimumString) {
+        var->minimumString = strdup(min);
+        var->maximumString = strdup(max);
+    }
+    return var;
+}
+
+static cvar_t* __cdecl fake_Cvar_Set2(const char* var_name, const char* value, qboolean force) {
+    cvar_t* var = fake_Cvar_FindVar(var_name);
+    if (!var) {
+        return fake_Cvar_Get(var_name, value, 0);
+    }
+    fake_cvar_assign(var, value);
+    return var;
+}
+
+static void __cdecl fake_Com_Printf(char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+static void __cdecl fake_Cmd_AddCommand(char* cmd, void* func) {}
+static void __cdecl fake_Cmd_TokenizeString(const char* text_in) {}
+static void __cdecl fake_Cbuf_ExecuteText(int exec_when, const char* text) {}
+static void __cdecl fake_Cmd_ExecuteString(const char* text) {}
+
+static void __cdecl fake_SV_SendServerCommand(client_t* cl, const char* fmt, ...) {
+    fake_server_commands++;
+}
+
+static void __cdecl fake_SV_ExecuteClientCommand(client_t* cl, const char* s, qboolean clientOK) {}
+
+static void __cdecl fake_SV_SetConfigstring(int index, const char* value) {
+    if (index < 0 || index >= MAX_CONFIGSTRINGS) {
+        return;
+    }
+    free(fake_configstrings[index]);
+    fake_configstrings[index] = strdup(value ? value : "");
+    fake_configstring_writes++;
+}
+
+static void __cdecl fake_SV_GetConfigstring(int index, char* buffer, int bufferSize) {
+    if (bufferSize < 1) {
+        return;
+    }
+    const char* cs = index >= 0 && index < MAX_CONFIGSTRINGS && fake_configstrings[index] ? fake_configstrings[index] : "";
+    snprintf(buffer, (size_t)bufferSize, "%s", cs);
+}
+
+static void __cdecl fake_SV_DropClient(client_t* drop, const char* reason) {
+    drop->state = CS_ZOMBIE;
+}
+
+Com_Printf_ptr Com_Printf                             = fake_Com_Printf;
+Cmd_AddCommand_ptr Cmd_AddCommand                     = fake_Cmd_AddCommand;
+Cmd_TokenizeString_ptr Cmd_TokenizeString             = fake_Cmd_TokenizeString;
+Cbuf_ExecuteText_ptr Cbuf_ExecuteText                 = fake_Cbuf_ExecuteText;
+Cmd_ExecuteString_ptr Cmd_ExecuteString               = fake_Cmd_ExecuteString;
+Cvar_FindVar_ptr Cvar_FindVar                         = fake_Cvar_FindVar;
+Cvar_Get_ptr Cvar_Get                                 = fake_Cvar_Get;
+Cvar_GetLimit_ptr Cvar_GetLimit                       = fake_Cvar_GetLimit;
+Cvar_Set2_ptr Cvar_Set2                               = fake_Cvar_Set2;
+SV_SendServerCommand_ptr SV_SendServerCommand         = fake_SV_SendServerCommand;
+SV_ExecuteClientCommand_ptr SV_ExecuteClientCommand   = fake_SV_ExecuteClientCommand;
+SV_SetConfigstring_ptr SV_SetConfigstring             = fake_SV_SetConfigstring;
+SV_GetConfigstring_ptr SV_GetConfigstring             = fake_SV_GetConfigstring;
+SV_DropClient_ptr SV_DropClient                       = fake_SV_DropClient;
+
+void DebugPrint(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    printf(DEBUG_PRINT_PREFIX);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+void DebugError(const char* fmt, const char* file, int line, const char* func, ...) {
+    va_list args;
+    va_start(args, func);
+    fprintf(stderr, DEBUG_ERROR_FORMAT, file, line, func);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+// The hooks the natives call back into, reduced to what hooks.c wraps around the engine call, so
+// a plugin's tell or set_configstring costs what it does on a server. The checks are hooks.c's
+// own, line for line; keep the two in step.
+void __cdecl My_SV_ExecuteClientCommand(client_t* cl, char* s, qboolean clientOK) {
+    char* res = s;
+    if (clientOK && cl->gentity) {
+        res = ClientCommandDispatcher(cl - svs->clients, s);
+        if (!res) {
+            return;
+        }
+    }
+    SV_ExecuteClientCommand(cl, res, clientOK);
+}
+
+void __cdecl My_SV_SendServerCommand(client_t* cl, char* fmt, ...) {
+    va_list argptr;
+    char buffer[MAX_MSGLEN];
+    va_start(argptr, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, argptr);
+    va_end(argptr);
+
+    Scoreboard_NoteCommand(buffer);
+
+    char* res = buffer;
+    if (cl && cl->gentity) {
+        res = ServerCommandDispatcher(cl - svs->clients, buffer);
+    } else if (cl == NULL) {
+        res = ServerCommandDispatcher(-1, buffer);
+    }
+    if (res && !Reliable_Intercept(cl, res)) {
+        SV_SendServerCommand(cl, "%s", res);
+    }
+}
+
+void __cdecl My_SV_SetConfigstring(int index, char* value) {
+    if (index == 16 || (index >= 662 && index < 670)) {
+        SV_SetConfigstring(index, value);
+        return;
+    }
+
+    char* res = SetConfigstringDispatcher(index, value ? value : "");
+    if (res && !Reliable_DeferConfigstring(index, res)) {
+        SV_SetConfigstring(index, res);
+    }
+}
+
+void __cdecl My_SV_DropClient(client_t* drop, const char* reason) {
+    ClientDisconnectDispatcher((int)(drop - svs->clients), reason);
+    SV_DropClient(drop, reason);
+}
+
+void __cdecl My_Com_Printf(char* fmt, ...) {
+    char buf[4096];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    char* res = ConsolePrintDispatcher(buf);
+    if (res) {
+        Com_Printf("%s", res);
+    }
+}
+
+cvar_t* __cdecl My_Cvar_Set2(const char* var_name, const char* value, qboolean force) {
+    return Cvar_Set2(var_name, value, force);
+}
+
+void __cdecl My_ClientSpawn(gentity_t* ent) {
+    ClientSpawnDispatcher((int)(ent - g_entities));
+}
+
+void __cdecl My_Touch_Item(gentity_t* ent, gentity_t* other, trace_t* trace) {}
+
+void __cdecl PyCommand(void) {}
+
+static void* fake_alloc(size_t count, size_t size) {
+    void* p = calloc(count, size);
+    if (!p) {
+        fprintf(stderr, "bench: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+void FakeEngine_Init(int clients, int players) {
+    char value[16];
+    snprintf(value, sizeof(value), "%d", clients);
+    sv_maxclients = Cvar_Get("sv_maxclients", value, 0);
+    Cvar_Get("sv_fps", "40", 0);
+    Cvar_Get("net_port", "27960", 0);
+    Cvar_Get("fs_homepath", "", 0);
+    cvar_vars = &fake_cvar_head;
+
+    svs          = fake_alloc(1, sizeof(*svs));
+    svs->clients = fake_alloc((size_t)clients, sizeof(client_t));
+    sv           = fake_alloc(1, sizeof(*sv));
+    g_entities   = fake_alloc(MAX_GENTITIES, sizeof(gentity_t));
+    level        = fake_alloc(1, sizeof(*level));
+    bg_itemlist  = fake_alloc(1, sizeof(gitem_t));
+    bg_numItems  = 0;
+
+    gclient_t* gclients = fake_alloc((size_t)clients, sizeof(gclient_t));
+    level->clients      = gclients;
+    level->gentities    = g_entities;
+    level->gentitySize  = sizeof(gentity_t);
+    level->num_entities = clients;
+    level->maxclients   = clients;
+    level->time         = 1000;
+    sv->gentities       = (sharedEntity_t*)g_entities;
+    sv->gentitySize     = sizeof(gentity_t);
+    sv->num_entities    = clients;
+
+    for (int i = 0; i < players; i++) {
+        client_t* cl   = &svs->clients[i];
+        gentity_t* ent = &g_entities[i];
+        gclient_t* gc  = &gclients[i];
+
+        cl->state    = CS_ACTIVE;
+        cl->gentity  = (sharedEntity_t*)ent;
+        cl->steam_id = 76561198000000000ull + (uint64_t)i;
+        snprintf(cl->name, sizeof(cl->name), "Player%d", i);
+        snprintf(cl->userinfo, sizeof(cl->userinfo), "\\name\\Player%d\\model\\sarge\\rate\\25000", i);
+
+        ent->s.number = i;
+        ent->inuse    = qtrue;
+        ent->client   = gc;
+
+        gc->pers.connected = CON_CONNECTED;
+        snprintf(gc->pers.netname, sizeof(gc->pers.netname), "Player%d", i);
+        gc->sess.sessionTeam = i % 2 ? TEAM_BLUE : TEAM_RED;
+
+        char cs[MAX_INFO_STRING];
+        snprintf(cs, sizeof(cs), "n\\Player%d\\t\\%d\\model\\sarge", i, gc->sess.sessionTeam);
+        SV_SetConfigstring(CS_PLAYERS + i, cs);
+    }
+}
+
+void FakeEngine_SetPlayer(int slot, int state, int connected, int team, int privileges, uint64_t steam_id,
+                          const char* name, const char* userinfo) {
+    if (slot < 0 || slot >= sv_maxclients->integer) {
+        return;
+    }
+    client_t* cl   = &svs->clients[slot];
+    gentity_t* ent = &g_entities[slot];
+    gclient_t* gc  = &level->clients[slot];
+
+    cl->state    = (clientState_t)state;
+    cl->steam_id = steam_id;
+    snprintf(cl->name, sizeof(cl->name), "%s", name);
+    snprintf(cl->userinfo, sizeof(cl->userinfo), "%s", userinfo);
+
+    ent->inuse         = state != CS_FREE;
+    gc->pers.connected = (clientConnected_t)connected;
+    snprintf(gc->pers.netname, sizeof(gc->pers.netname), "%s", name);
+    gc->sess.sessionTeam = (team_t)team;
+    gc->sess.privileges  = (privileges_t)privileges;
+}
+
+unsigned FakeEngine_ConfigstringWrites(void) {
+    return fake_configstring_writes;
+}
+
+unsigned FakeEngine_ServerCommands(void) {
+    return fake_server_commands;
+}
@@ -0,0 +1,43 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FAKE_ENGINE_H
+#define FAKE_ENGINE_H
+
+#include <stdint.h>
+
+/*
+ * Just enough of qzeroded and qagame for the dispatchers to run outside a server, for
+ * `make bench`. The engine's globals are zeroed heap copies of the real structs, laid out by
+ * quake_common.h, with the handful of fields the dispatchers and the Python getters read filled
+ * in. The engine functions keep what they are given in memory and send nothing anywhere. The
+ * functions the engine resolves by pattern and the bench has no use for stay NULL, as they would
+ * on a server where the pattern had not matched.
+ */
+
+// sv_maxclients of `clients`, with the first `players` slots taken by active players.
+void FakeEngine_Init(int clients, int players);
+
+// A slot as a capture recorded it. CS_FREE empties it.
+void FakeEngine_SetPlayer(int slot, int state, int connected, int team, int privileges, uint64_t steam_id,
+                          const char* name, const char* userinfo);
+
+// Configstring writes and server commands that got past the dispatchers, for a sanity check.
+unsigned FakeEngine_ConfigstringWrites(void);
+unsigned FakeEngine_ServerCommands(void);
+
+#endif /* FAKE_ENGINE_H */
@@ -0,0 +1,372 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "python/pyminqlxtended.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "fake_engine.h"
+#include "replay.h"
+#include "features/capture.h"
+#include "features/reliable.h"
+#include "engine/quake_common.h"
+
+#define REPLAY_MAX_ARGS      8
+#define REPLAY_MAX_EVENT_IDS 256 // Ids are a byte.
+
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+    int bad; // Ran off the end or hit something malformed.
+} reader_t;
+
+typedef struct {
+    char name[64];
+    PyObject** slot; // NULL if this build has no such event.
+    uint64_t count;
+    uint64_t skipped; // Nothing was armed in the slot.
+    uint64_t failed;  // The handler raised.
+    uint64_t total_ns;
+} replay_event_t;
+
+static replay_event_t replay_events[REPLAY_MAX_EVENT_IDS];
+
+static uint64_t replay_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int rd_fixed(reader_t* r, void* out, size_t n) {
+    if (r->bad || (size_t)(r->end - r->p) < n) {
+        r->bad = 1;
+        return 0;
+    }
+    memcpy(out, r->p, n);
+    r->p += n;
+    return 1;
+}
+
+static uint8_t rd_u8(reader_t* r) {
+    uint8_t v = 0;
+    rd_fixed(r, &v, 1);
+    return v;
+}
+
+static uint64_t rd_varint(reader_t* r) {
+    uint64_t v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        uint8_t b = rd_u8(r);
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80) || r->bad) {
+            return v;
+        }
+    }
+    r->bad = 1;
+    return 0;
+}
+
+static int64_t rd_zigzag(reader_t* r) {
+    uint64_t v = rd_varint(r);
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// A string field, pointing into the file. Not terminated.
+static const char* rd_bytes(reader_t* r, size_t* len) {
+    uint64_t n = rd_varint(r);
+    if (r->bad || (uint64_t)(r->end - r->p) < n) {
+        r->bad = 1;
+        *len   = 0;
+        return "";
+    }
+    const char* s = (const char*)r->p;
+    r->p += n;
+    *len = (size_t)n;
+    return s;
+}
+
+// A string field copied into a terminated buffer, truncated to fit.
+static void rd_str(reader_t* r, char* out, size_t size) {
+    size_t len;
+    const char* s = rd_bytes(r, &len);
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(out, s, len);
+    out[len] = '\0';
+}
+
+// A tuple of ints. Each takes a byte at least, which bounds the count before anything is built.
+static PyObject* rd_ints(reader_t* r) {
+    uint64_t n = rd_varint(r);
+    if (r->bad || n > (uint64_t)(r->end - r->p)) {
+        r->bad = 1;
+        return NULL;
+    }
+    PyObject* t = PyTuple_New((Py_ssize_t)n);
+    for (Py_ssize_t i = 0; t && i < (Py_ssize_t)n; i++) {
+        PyObject* v = PyLong_FromLongLong(rd_zigzag(r));
+        if (!v) {
+            Py_CLEAR(t);
+            break;
+        }
+        PyTuple_SET_ITEM(t, i, v);
+    }
+    return t;
+}
+
+static PyObject* rd_arg(reader_t* r) {
+    size_t len;
+    const char* s;
+    double d;
+    switch (rd_u8(r)) {
+    case CAPTURE_ARG_NONE:
+    case CAPTURE_ARG_OTHER:
+        return Py_NewRef(Py_None);
+    case CAPTURE_ARG_TRUE:
+        return Py_NewRef(Py_True);
+    case CAPTURE_ARG_FALSE:
+        return Py_NewRef(Py_False);
+    case CAPTURE_ARG_INT:
+        return PyLong_FromLongLong(rd_zigzag(r));
+    case CAPTURE_ARG_DOUBLE:
+        rd_fixed(r, &d, sizeof(d));
+        return PyFloat_FromDouble(d);
+    case CAPTURE_ARG_STR:
+        s = rd_bytes(r, &len);
+        return PyUnicode_DecodeUTF8(s, (Py_ssize_t)len, "replace");
+    case CAPTURE_ARG_BYTES:
+        s = rd_bytes(r, &len);
+        return PyBytes_FromStringAndSize(s, (Py_ssize_t)len);
+    case CAPTURE_ARG_INTS:
+        return rd_ints(r);
+    default:
+        r->bad = 1;
+        return NULL;
+    }
+}
+
+static void replay_player(reader_t* r) {
+    static char name[MAX_NAME_LENGTH], userinfo[MAX_INFO_STRING];
+    int slot       = rd_u8(r);
+    int state      = rd_u8(r);
+    int connected  = rd_u8(r);
+    int team       = (int)rd_zigzag(r);
+    int privileges = (int)rd_zigzag(r);
+    uint64_t steam_id = 0;
+    rd_fixed(r, &steam_id, sizeof(steam_id));
+    rd_str(r, name, sizeof(name));
+    rd_str(r, userinfo, sizeof(userinfo));
+    if (!r->bad) {
+        FakeEngine_SetPlayer(slot, state, connected, team, privileges, steam_id, name, userinfo);
+    }
+}
+
+static void replay_event(reader_t* r) {
+    replay_event_t* ev = &replay_events[rd_u8(r)];
+    int argc           = rd_u8(r);
+    if (argc > REPLAY_MAX_ARGS) {
+        r->bad = 1;
+        return;
+    }
+
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    PyObject* argv[REPLAY_MAX_ARGS];
+    int have = 0;
+    while (have < argc) {
+        PyObject* arg = rd_arg(r);
+        if (!arg) {
+            break;
+        }
+        argv[have++] = arg;
+    }
+
+    PyObject* handler = ev->slot ? *ev->slot : NULL;
+    if (have < argc) {
+        // The rest of this event's arguments are still unread, so nothing after them can be
+        // found. A Python error from the conversion is reported by DispatcherRelease.
+        r->bad = 1;
+    } else if (!handler) {
+        ev->skipped++;
+    } else {
+        uint64_t t0      = replay_now();
+        PyObject* result = PyObject_Vectorcall(handler, argv, (size_t)argc, NULL);
+        ev->total_ns += replay_now() - t0;
+        ev->count++;
+        if (!result) {
+            ev->failed++;
+        } else if (!strcmp(ev->name, "set_configstring") && argc == 2 && result != Py_False) {
+            // What the engine would have done with the handler's answer.
+            PyObject* value = PyUnicode_Check(result) ? result : argv[1];
+            int index       = (int)PyLong_AsLong(argv[0]);
+            const char* s   = PyUnicode_Check(value) ? PyUnicode_AsUTF8(value) : NULL;
+            if (s && index >= 0) {
+                SV_SetConfigstring(index, s);
+            }
+        }
+        Py_XDECREF(result);
+    }
+
+    for (int i = 0; i < have; i++) {
+        Py_DECREF(argv[i]);
+    }
+    DispatcherRelease(gstate);
+}
+
+static void replay_report(uint64_t wall_ns, unsigned frames, uint64_t captured_ns) {
+    printf("%u frames (%llu.%03llus captured) replayed in %llu.%03llus\n", frames,
+           (unsigned long long)(captured_ns / 1000000000ull), (unsigned long long)(captured_ns % 1000000000ull / 1000000ull),
+           (unsigned long long)(wall_ns / 1000000000ull), (unsigned long long)(wall_ns % 1000000000ull / 1000000ull));
+    printf("%-22s %10s %10s %8s %12s %10s\n", "event", "replayed", "unarmed", "raised", "total ms", "ns/event");
+    for (int i = 0; i < REPLAY_MAX_EVENT_IDS; i++) {
+        const replay_event_t* ev = &replay_events[i];
+        if (!ev->count && !ev->skipped) {
+            continue;
+        }
+        printf("%-22s %10llu %10llu %8llu %8llu.%03llu %10llu\n", ev->name, (unsigned long long)ev->count,
+               (unsigned long long)ev->skipped, (unsigned long long)ev->failed,
+               (unsigned long long)(ev->total_ns / 1000000ull), (unsigned long long)(ev->total_ns % 1000000ull / 1000ull),
+               (unsigned long long)(ev->count ? ev->total_ns / ev->count : 0));
+    }
+}
+
+// Loads the named plugins the way late_init does, minus the database and logger setup.
+static const char replay_loader[] = "import os, sys\n"
+                                    "import minqlxtended\n"
+                                    "_path = os.path.abspath(minqlxtended.get_cvar('qlx_pluginsPath'))\n"
+                                    "sys.path.append(os.path.dirname(_path))\n"
+                                    "for _p in (minqlxtended.get_cvar('qlx_plugins') or '').split(','):\n"
+                                    "    if _p.strip():\n"
+                                    "        minqlxtended.load_plugin(_p.strip())\n";
+
+int Replay_Run(const char* path, const char* plugins, const char* plugins_path, int realtime) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "bench: cannot open %s\n", path);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = size > 0 ? malloc((size_t)size) : NULL;
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "bench: cannot read %s\n", path);
+        fclose(f);
+        free(data);
+        return 1;
+    }
+    fclose(f);
+
+    reader_t r = {data, data + size, 0};
+    char magic[8];
+    uint32_t header[3];
+    uint64_t started;
+    rd_fixed(&r, magic, sizeof(magic));
+    rd_fixed(&r, header, sizeof(header));
+    rd_fixed(&r, &started, sizeof(started));
+    if (r.bad || memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) || header[0] != CAPTURE_VERSION) {
+        fprintf(stderr, "bench: %s is not a version %d capture\n", path, CAPTURE_VERSION);
+        free(data);
+        return 1;
+    }
+    if (header[2] < 1 || header[2] > MAX_CLIENTS) {
+        fprintf(stderr, "bench: %s has an sv_maxclients of %u\n", path, header[2]);
+        free(data);
+        return 1;
+    }
+
+    FakeEngine_Init((int)header[2], 0);
+    char fps[16];
+    snprintf(fps, sizeof(fps), "%u", header[1]);
+    Cvar_Set2("sv_fps", fps, qtrue);
+    Cvar_Set2("qlx_pluginsPath", plugins_path ? plugins_path : ".", qtrue);
+    Cvar_Set2("qlx_plugins", plugins ? plugins : "", qtrue);
+    Reliable_Init();
+
+    if (PyMinqlxtended_Initialize() != PYM_SUCCESS) {
+        fprintf(stderr, "bench: Python did not initialise; is python/ on PYTHONPATH?\n");
+        free(data);
+        return 1;
+    }
+    if (plugins && plugins[0]) {
+        PyGILState_STATE gstate = PyGILState_Ensure();
+        int failed              = PyRun_SimpleString(replay_loader);
+        PyGILState_Release(gstate);
+        if (failed) {
+            fprintf(stderr, "bench: the plugins did not load\n");
+            free(data);
+            return 1;
+        }
+    }
+
+    unsigned frames      = 0;
+    uint64_t captured_ns = 0;
+    uint64_t start       = replay_now();
+    while (r.p < r.end && !r.bad) {
+        switch (rd_u8(&r)) {
+        case CAPTURE_REC_NAME: {
+            replay_event_t* ev = &replay_events[rd_u8(&r)];
+            rd_str(&r, ev->name, sizeof(ev->name));
+            ev->slot = HandlerSlotByName(ev->name);
+            break;
+        }
+        case CAPTURE_REC_EVENT:
+            replay_event(&r);
+            break;
+        case CAPTURE_REC_FRAME:
+            captured_ns += rd_varint(&r);
+            frames++;
+            Reliable_Flush();
+            if (realtime) {
+                uint64_t due = start + captured_ns, now = replay_now();
+                if (due > now) {
+                    struct timespec ts = {(time_t)((due - now) / 1000000000ull), (long)((due - now) % 1000000000ull)};
+                    nanosleep(&ts, NULL);
+                }
+            }
+            break;
+        case CAPTURE_REC_PLAYER:
+            replay_player(&r);
+            break;
+        case CAPTURE_REC_CONFIGSTRING: {
+            static char cs[MAX_INFO_STRING * 8];
+            int index = (int)rd_varint(&r);
+            rd_str(&r, cs, sizeof(cs));
+            SV_SetConfigstring(index, cs);
+            break;
+        }
+        default:
+            r.bad = 1;
+        }
+    }
+    uint64_t wall = replay_now() - start;
+
+    if (r.bad) {
+        fprintf(stderr, "bench: %s is damaged at byte %td; stopping there\n", path, (const uint8_t*)r.p - data);
+    }
+    replay_report(wall, frames, captured_ns);
+    free(data);
+    return r.bad ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*
+ * Plays a "qlx_capture" file back through the Python handlers against the fake engine, with
+ * whichever plugins are named loaded, and reports the time spent per event. The player slots and
+ * configstrings follow the capture, so handlers and plugins see the players they saw live; cvars
+ * and anything else the engine would answer are the fake engine's defaults. Events the loaded
+ * plugins leave gated (damage, weapon_fired, cvar_changed) are skipped, as a server would skip
+ * them. realtime paces the frames as they were captured; otherwise it runs flat out.
+ *
+ * plugins is comma-separated, as qlx_plugins, and may be NULL. Returns the process exit status.
+ */
+int Replay_Run(const char* path, const char* plugins, const char* plugins_path, int realtime);
+
+#endif /* REPLAY_H */
@@ -2145,6 +2145,7 @@ void __cdecl ProfileCommand(void);       // "qlx_prof"
 void __cdecl ReliableCommand(void);   // "qlx_reliable"
 void __cdecl ScoreboardCommand(void); // "qlx_scoreboard"
 void __cdecl PyPerfCommand(void);     // "qlx_pyperf"
+void __cdecl CaptureCommand(void);    // "qlx_capture"
 // PyRcon gives the owner the ability to execute pyminqlxtended commands as if the
 // owner executed them.
 void __cdecl PyRcon(void);
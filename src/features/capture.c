@@ -0,0 +1,453 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "python/pyminqlxtended.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "capture.h"
+#include "workers.h"
+#include "engine/quake_common.h"
+
+#define CAPTURE_MAX_SECONDS   3600
+#define CAPTURE_START_BYTES   (1u << 20)
+#define CAPTURE_MAX_BYTES     (256u << 20) // A busy hour comes to a few tens of MB.
+#define CAPTURE_REFRESH_NS    10000000000ull
+#define CAPTURE_MAX_EVENT_IDS 255 // Ids are a byte.
+
+int capture_active;
+
+static uint8_t* cap_buf;
+static size_t cap_len;
+static size_t cap_size;
+static int cap_full; // A record didn't fit under CAPTURE_MAX_BYTES; ends at the next frame.
+static uint64_t cap_start_ns;
+static uint64_t cap_until_ns;
+static uint64_t cap_frame_ns;   // Time of the last 'F'.
+static uint64_t cap_refresh_ns; // Time of the last full player snapshot.
+static unsigned cap_events;
+static unsigned cap_frames;
+static unsigned cap_skipped; // Dispatches off the game thread, which aren't recorded.
+static const void* cap_ids[CAPTURE_MAX_EVENT_IDS];
+static int cap_id_count;
+static char cap_path[512];
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    char path[sizeof(cap_path)];
+} capture_job_t;
+
+static uint64_t cap_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Room for n more bytes, or 0 once the buffer would pass CAPTURE_MAX_BYTES.
+static int cap_reserve(size_t n) {
+    if (cap_len + n <= cap_size) {
+        return 1;
+    }
+    size_t size = cap_size;
+    while (size < cap_len + n) {
+        size *= 2;
+    }
+    if (size > CAPTURE_MAX_BYTES) {
+        cap_full = 1;
+        return 0;
+    }
+    uint8_t* grown = realloc(cap_buf, size);
+    if (!grown) {
+        cap_full = 1;
+        return 0;
+    }
+    cap_buf  = grown;
+    cap_size = size;
+    return 1;
+}
+
+static int cap_put(const void* data, size_t n) {
+    if (!cap_reserve(n)) {
+        return 0;
+    }
+    memcpy(cap_buf + cap_len, data, n);
+    cap_len += n;
+    return 1;
+}
+
+static int cap_u8(uint8_t v) {
+    return cap_put(&v, 1);
+}
+
+static int cap_varint(uint64_t v) {
+    uint8_t out[10];
+    size_t n = 0;
+    do {
+        out[n] = v & 0x7f;
+        v >>= 7;
+        if (v) {
+            out[n] |= 0x80;
+        }
+        n++;
+    } while (v);
+    return cap_put(out, n);
+}
+
+static int cap_zigzag(int64_t v) {
+    return cap_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static int cap_bytes(const char* s, size_t n) {
+    return cap_varint(n) && cap_put(s, n);
+}
+
+static int cap_str(const char* s) {
+    return cap_bytes(s, strlen(s));
+}
+
+// Whether every write in a record landed. A record that ran out of room is taken back out
+// whole, so the file ends on a record boundary.
+static void cap_commit(size_t start, int ok) {
+    if (!ok) {
+        cap_len = start;
+    }
+}
+
+static void cap_player(int slot) {
+    client_t* cl = &svs->clients[slot];
+    if (cl->state == CS_FREE) {
+        return;
+    }
+
+    gclient_t* gc    = g_entities ? g_entities[slot].client : NULL;
+    const char* name = gc ? gc->pers.netname : cl->name;
+
+    size_t start = cap_len;
+    int ok       = cap_u8(CAPTURE_REC_PLAYER) && cap_u8((uint8_t)slot) && cap_u8((uint8_t)cl->state) &&
+             cap_u8(gc ? (uint8_t)gc->pers.connected : 0) && cap_zigzag(gc ? gc->sess.sessionTeam : TEAM_SPECTATOR) &&
+             cap_zigzag(gc ? gc->sess.privileges : -1) && cap_put(&cl->steam_id, sizeof(cl->steam_id)) &&
+             cap_bytes(name, strnlen(name, sizeof(gc->pers.netname))) &&
+             cap_bytes(cl->userinfo, strnlen(cl->userinfo, sizeof(cl->userinfo)));
+    cap_commit(start, ok);
+}
+
+static void cap_players(void) {
+    if (!svs || !sv_maxclients) {
+        return;
+    }
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        cap_player(i);
+    }
+}
+
+// The id for a handler slot, naming it in the file the first time. -1 once the ids run out.
+static int cap_event_id(const void* slot) {
+    for (int i = 0; i < cap_id_count; i++) {
+        if (cap_ids[i] == slot) {
+            return i;
+        }
+    }
+    if (cap_id_count == CAPTURE_MAX_EVENT_IDS) {
+        return -1;
+    }
+
+    const char* name = HandlerSlotName(slot);
+    size_t start     = cap_len;
+    int ok           = cap_u8(CAPTURE_REC_NAME) && cap_u8((uint8_t)cap_id_count) && cap_str(name ? name : "unknown");
+    cap_commit(start, ok);
+    if (!ok) {
+        return -1;
+    }
+    cap_ids[cap_id_count] = slot;
+    return cap_id_count++;
+}
+
+// Whether every item of a tuple is an int that fits a zigzag varint.
+static int cap_is_int_tuple(PyObject* o) {
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(o); i++) {
+        PyObject* item = PyTuple_GET_ITEM(o, i);
+        int overflow;
+        if (!PyLong_Check(item) || PyBool_Check(item)) {
+            return 0;
+        }
+        long long v = PyLong_AsLongLongAndOverflow(item, &overflow);
+        if (overflow || (v == -1 && PyErr_Occurred())) {
+            PyErr_Clear();
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int cap_arg(PyObject* o) {
+    if (o == Py_None) {
+        return cap_u8(CAPTURE_ARG_NONE);
+    } else if (o == Py_True) {
+        return cap_u8(CAPTURE_ARG_TRUE);
+    } else if (o == Py_False) {
+        return cap_u8(CAPTURE_ARG_FALSE);
+    } else if (PyLong_Check(o)) {
+        int overflow;
+        long long v = PyLong_AsLongLongAndOverflow(o, &overflow);
+        if (!overflow && !(v == -1 && PyErr_Occurred())) {
+            return cap_u8(CAPTURE_ARG_INT) && cap_zigzag(v);
+        }
+        PyErr_Clear();
+    } else if (PyFloat_Check(o)) {
+        double v = PyFloat_AS_DOUBLE(o);
+        return cap_u8(CAPTURE_ARG_DOUBLE) && cap_put(&v, sizeof(v));
+    } else if (PyUnicode_Check(o)) {
+        Py_ssize_t len;
+        const char* s = PyUnicode_AsUTF8AndSize(o, &len);
+        if (s) {
+            return cap_u8(CAPTURE_ARG_STR) && cap_bytes(s, (size_t)len);
+        }
+        // Lone surrogates have no UTF-8.
+        PyErr_Clear();
+    } else if (PyBytes_Check(o)) {
+        return cap_u8(CAPTURE_ARG_BYTES) && cap_bytes(PyBytes_AS_STRING(o), (size_t)PyBytes_GET_SIZE(o));
+    } else if (PyTuple_Check(o) && cap_is_int_tuple(o)) {
+        // The recipients of a server_command sent to several clients at once.
+        Py_ssize_t n = PyTuple_GET_SIZE(o);
+        int ok       = cap_u8(CAPTURE_ARG_INTS) && cap_varint((uint64_t)n);
+        for (Py_ssize_t i = 0; ok && i < n; i++) {
+            ok = cap_zigzag(PyLong_AsLongLong(PyTuple_GET_ITEM(o, i)));
+        }
+        return ok;
+    }
+    return cap_u8(CAPTURE_ARG_OTHER);
+}
+
+// Events whose handler reads the player in the first argument as the engine has them now, which
+// may be newer than the last snapshot.
+static int cap_is_player_event(const char* name) {
+    static const char* const names[] = {
+        "player_connect", "player_loaded", "player_disconnect", "player_spawn",
+        "team_switch",    "team_switch_attempt", "userinfo",
+    };
+    for (size_t i = 0; name && i < sizeof(names) / sizeof(*names); i++) {
+        if (!strcmp(name, names[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void Capture_Event(const void* slot, void* const* argv, int argc) {
+    if (!OnGameThread()) {
+        cap_skipped++;
+        return;
+    }
+    if (cap_full) {
+        return;
+    }
+
+    int id = cap_event_id(slot);
+    if (id < 0) {
+        cap_skipped++;
+        return;
+    }
+
+    if (argc > 0 && PyLong_Check((PyObject*)argv[0]) && cap_is_player_event(HandlerSlotName(slot))) {
+        long client_id = PyLong_AsLong((PyObject*)argv[0]);
+        if (client_id >= 0 && sv_maxclients && client_id < sv_maxclients->integer) {
+            cap_player((int)client_id);
+        }
+        PyErr_Clear();
+    }
+
+    size_t start = cap_len;
+    int ok       = cap_u8(CAPTURE_REC_EVENT) && cap_u8((uint8_t)id) && cap_u8((uint8_t)argc);
+    for (int i = 0; ok && i < argc; i++) {
+        ok = cap_arg((PyObject*)argv[i]);
+    }
+    cap_commit(start, ok);
+    cap_events += ok;
+}
+
+// Runs detached, so tens of megabytes don't go to disk in the middle of a frame.
+static void* capture_writer_main(void* arg) {
+    capture_job_t* job = arg;
+
+    char part[sizeof(job->path) + 8];
+    snprintf(part, sizeof(part), "%s.part", job->path);
+    FILE* f = fopen(part, "wb");
+    if (!f) {
+        DebugPrint("capture: could not open %s\n", part);
+        goto out;
+    }
+    fwrite(job->data, 1, job->len, f);
+    if (ferror(f) | fclose(f)) {
+        DebugPrint("capture: write failed on %s\n", part);
+        remove(part);
+        goto out;
+    }
+    if (rename(part, job->path)) {
+        DebugPrint("capture: could not rename %s into place\n", part);
+        goto out;
+    }
+    DebugPrint("capture: %zu bytes written to %s\n", job->len, job->path);
+out:
+    free(job->data);
+    free(job);
+    return NULL;
+}
+
+static void capture_finish(void) {
+    capture_active = 0;
+
+    capture_job_t* job = malloc(sizeof(*job));
+    if (!job) {
+        free(cap_buf);
+        ENGINE_PRINTF("Capture finished, but there was no memory to write it out.\n");
+    } else {
+        job->data = cap_buf;
+        job->len  = cap_len;
+        memcpy(job->path, cap_path, sizeof(job->path));
+        if (Worker_Start("qlx capture", WORKER_BACKGROUND, capture_writer_main, job)) {
+            free(job->data);
+            free(job);
+            ENGINE_PRINTF("Capture finished, but the writer thread could not be started.\n");
+        } else {
+            ENGINE_PRINTF("Capture finished%s: %u events over %u frames, %zu bytes, writing %s\n",
+                          cap_full ? " early, as it hit the size limit" : "", cap_events, cap_frames, cap_len,
+                          cap_path);
+        }
+    }
+    cap_buf  = NULL;
+    cap_len  = 0;
+    cap_size = 0;
+}
+
+void Capture_Start(int seconds) {
+    if (capture_active) {
+        ENGINE_PRINTF("A capture is already running.\n");
+        return;
+    }
+    if (seconds < 1 || seconds > CAPTURE_MAX_SECONDS) {
+        ENGINE_PRINTF("Capture length must be between 1 and %d seconds.\n", CAPTURE_MAX_SECONDS);
+        return;
+    }
+    if (!svs || !sv_maxclients) {
+        ENGINE_PRINTF("The server is not up yet; there is nothing to capture.\n");
+        return;
+    }
+    cvar_t* homepath = Cvar_FindVar("fs_homepath");
+    if (!homepath || !homepath->string[0]) {
+        ENGINE_PRINTF("fs_homepath is not set, so there is nowhere to write a capture.\n");
+        return;
+    }
+    char stamp[32];
+    time_t t = time(NULL);
+    struct tm tm;
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime_r(&t, &tm));
+    if ((size_t)snprintf(cap_path, sizeof(cap_path), "%s/qlx_capture_%s.qlxcap", homepath->string, stamp) >=
+        sizeof(cap_path)) {
+        ENGINE_PRINTF("fs_homepath is too long to write a capture under.\n");
+        return;
+    }
+
+    cap_buf = malloc(CAPTURE_START_BYTES);
+    if (!cap_buf) {
+        ENGINE_PRINTF("No memory to start a capture.\n");
+        return;
+    }
+    cap_size     = CAPTURE_START_BYTES;
+    cap_len      = 0;
+    cap_full     = 0;
+    cap_events   = 0;
+    cap_frames   = 0;
+    cap_skipped  = 0;
+    cap_id_count = 0;
+
+    cvar_t* sv_fps = Cvar_FindVar("sv_fps");
+    uint32_t header[3] = {CAPTURE_VERSION, sv_fps ? (uint32_t)sv_fps->integer : 0, (uint32_t)sv_maxclients->integer};
+    uint64_t started   = (uint64_t)t;
+    cap_put(CAPTURE_MAGIC, 8);
+    cap_put(header, sizeof(header));
+    cap_put(&started, sizeof(started));
+
+    // Everything a handler might read on the first event. The largest configstring is the
+    // serverinfo, well under this.
+    static char cs[MAX_INFO_STRING * 8];
+    for (int i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        SV_GetConfigstring(i, cs, sizeof(cs));
+        if (cs[0]) {
+            size_t start = cap_len;
+            cap_commit(start, cap_u8(CAPTURE_REC_CONFIGSTRING) && cap_varint((uint64_t)i) && cap_str(cs));
+        }
+    }
+    cap_players();
+
+    cap_start_ns   = cap_now();
+    cap_frame_ns   = cap_start_ns;
+    cap_refresh_ns = cap_start_ns;
+    cap_until_ns   = cap_start_ns + (uint64_t)seconds * 1000000000ull;
+    capture_active = 1;
+    ENGINE_PRINTF("Capturing for %d second(s); the result goes to %s\n", seconds, cap_path);
+}
+
+void Capture_Stop(void) {
+    if (!capture_active) {
+        ENGINE_PRINTF("No capture is running.\n");
+        return;
+    }
+    capture_finish();
+}
+
+void Capture_Frame(void) {
+    if (!capture_active) {
+        return;
+    }
+
+    uint64_t now = cap_now();
+    size_t start = cap_len;
+    cap_commit(start, cap_u8(CAPTURE_REC_FRAME) && cap_varint(now - cap_frame_ns));
+    cap_frame_ns = now;
+    cap_frames++;
+
+    if (now - cap_refresh_ns >= CAPTURE_REFRESH_NS) {
+        cap_refresh_ns = now;
+        cap_players();
+    }
+    if (now >= cap_until_ns || cap_full) {
+        capture_finish();
+    }
+}
+
+void Capture_Report(void) {
+    if (!capture_active) {
+        ENGINE_PRINTF("No capture is running. \"qlx_capture <seconds>\" starts one.\n");
+        return;
+    }
+    uint64_t left_ms = (cap_until_ns - cap_now()) / 1000000ull;
+    ENGINE_PRINTF("Capturing to %s: %u events over %u frames, %zu bytes, %llu.%01llus left.\n", cap_path, cap_events,
+                  cap_frames, cap_len, (unsigned long long)(left_ms / 1000), (unsigned long long)((left_ms % 1000) / 100));
+    if (cap_skipped) {
+        ENGINE_PRINTF("%u dispatch(es) from other threads were left out.\n", cap_skipped);
+    }
+}
@@ -0,0 +1,86 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+/*
+ * "qlx_capture <seconds>" records every call into a Python event handler on the game thread,
+ * with its arguments, so the match can be played back through the same handlers and plugins
+ * offline: `make bench BENCH_ARGS="-r <file> -P <plugins>"`, see src/bench/replay.c. The file
+ * is written to fs_homepath as qlx_capture_<date>-<time>.qlxcap once the capture ends.
+ *
+ * Recording costs an append to a memory buffer per dispatch, serialising the arguments the
+ * handler was about to be called with. Nothing touches the disk until the capture ends, when a
+ * detached thread writes the buffer out, as with "qlx_prof trace".
+ *
+ * The file is a header followed by records, each one tag byte and then its body. Integers are
+ * LEB128 varints, zigzagged where they can be negative. A string is a varint length and then
+ * its bytes. Fixed-width fields are little-endian.
+ *
+ *   header  "QLXCAP\0\0", u32 version, u32 sv_fps, u32 maxclients, u64 unix start time
+ *   'N'     u8 event id, string name. Precedes the first 'E' with that id
+ *   'E'     u8 event id, u8 argc, then argc tagged values:
+ *             'n' None, 't' True, 'f' False, 'i' zigzag varint, 'd' 8-byte double,
+ *             's' UTF-8 string, 'b' bytes, 'I' tuple of ints (varint count, then zigzag
+ *             varints), 'x' anything else (read back as None)
+ *   'F'     varint ns since the previous 'F' (or the start). One per server frame
+ *   'P'     u8 slot, u8 client state, u8 connected, zigzag team, zigzag privileges,
+ *           u64 steam id, string name, string userinfo
+ *   'C'     varint index, string value
+ *
+ * 'C' records cover every configstring at the start, and 'P' records every occupied slot.
+ * After that a slot is written again just before any event about that player arriving, leaving,
+ * spawning or changing team or userinfo, and every slot once every ten seconds. A replay sees
+ * what the handler would have read. Configstrings are kept current by replaying the
+ * set_configstring events themselves.
+ */
+
+#define CAPTURE_MAGIC   "QLXCAP\0\0"
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_REC_NAME         'N'
+#define CAPTURE_REC_EVENT        'E'
+#define CAPTURE_REC_FRAME        'F'
+#define CAPTURE_REC_PLAYER       'P'
+#define CAPTURE_REC_CONFIGSTRING 'C'
+
+#define CAPTURE_ARG_NONE   'n'
+#define CAPTURE_ARG_TRUE   't'
+#define CAPTURE_ARG_FALSE  'f'
+#define CAPTURE_ARG_INT    'i'
+#define CAPTURE_ARG_DOUBLE 'd'
+#define CAPTURE_ARG_STR    's'
+#define CAPTURE_ARG_BYTES  'b'
+#define CAPTURE_ARG_INTS   'I'
+#define CAPTURE_ARG_OTHER  'x'
+
+// Checked in CallHandlerStatus before calling Capture_Event. Game thread only.
+extern int capture_active;
+
+void Capture_Start(int seconds);
+void Capture_Stop(void);
+void Capture_Report(void);
+// Game thread, once per frame. Ends the capture when its time is up.
+void Capture_Frame(void);
+// A handler about to be called. slot is the handler slot, argv the PyObject* arguments; void*
+// so this header needs no Python. Holds the GIL.
+void Capture_Event(const void* slot, void* const* argv, int argc);
+
+#endif /* CAPTURE_H */
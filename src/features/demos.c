@@ -21,20 +21,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
 #include <pthread.h>
-#include <signal.h>
 #include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "common.h"
 #include "demos.h"
 #include "profile.h"
+#include "workers.h"
 #include "engine/quake_common.h"
 
 extern serverStatic_t *svs; // defined in dllmain.c
@@ -44,11 +51,13 @@ extern serverStatic_t *svs; // defined in dllmain.c
 #define DEMO_RING_SIZE (16u * 1024 * 1024) // power of two
 
 typedef enum {
-    DEMO_REC_OPEN = 1,  // payload: null-terminated file path
+    DEMO_REC_OPEN = 1,  // payload: null-terminated file path, gzip level byte (0 for none), index byte
     DEMO_REC_BLOCK,     // payload: message bytes incl. Huffman svc_EOF
     DEMO_REC_CLOSE,     // no payload
     DEMO_REC_CLOSE_ALL, // no payload, slot ignored
     DEMO_REC_SHUTDOWN,  // no payload; writer finalises every open demo and exits
+    DEMO_REC_MARK,      // payload: demo_mark_t; slot -1 for every open segment
+    DEMO_REC_WINDOW,    // payload: a demo_window_t pointer, then as OPEN without the index byte
 } demo_rec_type_t;
 
 typedef struct {
@@ -58,19 +67,98 @@ typedef struct {
     uint32_t len; // payload bytes following this header
 } demo_rec_hdr_t; // 16 bytes
 
+// The replay buffer keeps each client's entries in a list of these. A saved window references
+// the chunks it spans instead of copying them, so even a long one costs the game thread next to
+// nothing. Whoever drops the last reference frees the chunk: the game thread when it evicts it, or
+// the writer once it has written it out.
+#define DEMO_REPLAY_CHUNK       (256u * 1024)
+#define DEMO_REPLAY_MAX_SECONDS 1800 // sv_demoReplay's ceiling, and a window's
+
+typedef struct replay_chunk_s {
+    struct replay_chunk_s *next; // the next newer; set before a window can reference this one
+    _Atomic int refs;
+    int32_t newest;              // svs->time of the last entry
+    uint32_t used;
+    unsigned char data[DEMO_REPLAY_CHUNK];
+} replay_chunk_t;
+
+typedef struct {
+    int32_t seq;
+    int32_t time;     // svs->time at capture
+    uint32_t prelude; // bytes of prelude ahead of the block; keyframes only, and may be 0
+    uint32_t len;     // bytes of block after that
+    int32_t keyframe;
+} replay_entry_t;
+
+// A saved window: the entries from `first` at `first_off` up to `last` at `end`, referenced where
+// they are, and ahead of them the gamestate and the first keyframe's prelude, copied in here.
+// Both of those are small, and the slot replaces them when a new gamestate comes. Nothing in the
+// window is written to again; the game thread only appends past `end`.
+typedef struct {
+    replay_chunk_t *first, *last;
+    uint32_t first_off, end;
+    int32_t gamestate_seq, prelude_seq;
+    uint32_t gamestate_len, prelude_len;
+    unsigned char data[]; // gamestate, then prelude
+} demo_window_t;
+
+static void replay_chunk_unref(replay_chunk_t *c) {
+    if (atomic_fetch_sub_explicit(&c->refs, 1, memory_order_acq_rel) == 1) {
+        free(c);
+    }
+}
+
+static void demo_window_free(demo_window_t *w) {
+    for (replay_chunk_t *c = w->first, *next; c; c = next) {
+        next = c == w->last ? NULL : c->next; // past `last`, next is the game thread's to change
+        replay_chunk_unref(c);
+    }
+    free(w);
+}
+
+typedef struct {
+    int32_t kind;  // demo_mark_kind_t
+    int32_t time;  // svs->time when marked
+    int32_t clock; // as Demo_Mark's
+    int32_t a, b, c;
+} demo_mark_t;
+
 typedef enum {
     DEMO_THREAD_STOPPED = 0,
     DEMO_THREAD_RUNNING,
     DEMO_THREAD_STOPPING, // writer still draining
 } demo_thread_state_t;
 
+// Single producer, single consumer: every record is put by the game thread and taken by the writer,
+// so the ring needs no lock, only the two positions. Each side owns one, advances it with a release
+// store once the bytes behind it are done with, and reads the other's with an acquire load. It is
+// one ring rather than one per slot because CLOSE_ALL and SHUTDOWN have to land after every block
+// queued before them, whichever slot those were for.
 static unsigned char demo_ring[DEMO_RING_SIZE];
-static uint64_t demo_head; // advanced by the game thread.
-static uint64_t demo_tail; // advanced by the writer thread.
+static _Atomic uint64_t demo_head; // advanced by the game thread.
+static _Atomic uint64_t demo_tail; // advanced by the writer thread.
+
+// Covers the completion queue and the thread state. The ring does without it.
 static pthread_mutex_t demo_lock             = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t demo_cond              = PTHREAD_COND_INITIALIZER;
 static demo_thread_state_t demo_thread_state = DEMO_THREAD_STOPPED;
 
+// The writer does not want a wakeup per block. With the ring empty it naps, and blocks queued
+// meanwhile wait for the nap to run out, so a busy server costs one timed wake per nap, not a
+// syscall per message. A nap that finds nothing turns into a sleep only a put can end. Control
+// records, and a ring filling up, cut a nap short. demo_wake is the futex word; a waker bumps it
+// so a put landing between the writer's last look and its wait is not missed.
+typedef enum {
+    DEMO_WRITER_BUSY = 0,
+    DEMO_WRITER_NAPPING, // timed wait; only an urgent put wakes it early
+    DEMO_WRITER_ASLEEP,  // untimed wait; any put wakes it
+} demo_writer_idle_t;
+
+#define DEMO_WRITER_NAP_MS 50
+#define DEMO_RING_URGENT   (DEMO_RING_SIZE / 4) // fill that cuts a nap short
+
+static atomic_int demo_writer_idle;
+static atomic_uint demo_wake;
+
 static demo_thread_state_t demo_state_cached = DEMO_THREAD_STOPPED;
 static uint8_t demo_active[MAX_DEMO_CLIENTS]; // slot has an open segment.
 static unsigned char demo_scratch[MAX_NETCHAN_MSGLEN + 64];
@@ -83,14 +171,30 @@ static int demo_forced_on; // number of slots currently set to 1.
 static char demo_path[MAX_DEMO_CLIENTS][512];
 static uint32_t demo_gen[MAX_DEMO_CLIENTS]; // bumped per OPEN, to match completions up.
 
+// A plain segment collects its blocks in a staging buffer and goes to the file a buffer at a
+// time, in one pwritev with whatever block did not fit, so a finalise costs a single write even
+// with a full buffer and the end marker still to go. The file is preallocated ahead of that in
+// extents, so a server recording every slot does not leave each demo in thousands of fragments.
+#define DEMO_STAGE_SIZE     (64 * 1024)
+#define DEMO_PREALLOC_CHUNK (4L * 1024 * 1024)
+
+// A segment is written through exactly one of fd and gz, the latter under sv_demoCompress.
 typedef struct {
-    FILE *fh;
+    int fd; // -1 when not open; see demo_writer_main.
+    gzFile gz;
+    FILE *idx; // "<path>.idx.part" while open, under sv_demoIndex
     char path[512];
-    long blocks;  // blocks written to this segment (gamestate counts as 1.)
-    long bytes;   // bytes written to the file so far.
-    uint32_t gen; // demo_gen[slot] of the OPEN this segment came from.
+    long blocks;     // blocks written to this segment (gamestate counts as 1.)
+    long bytes;      // bytes written to the file so far, counting what is still staged.
+    long allocated;  // preallocated up to here; -1 once the filesystem has refused.
+    uint32_t staged; // bytes at the front of the slot's writer_stage not yet written.
+    uint32_t gen;    // demo_gen[slot] of the OPEN this segment came from.
 } demo_client_t;
-static demo_client_t demos[MAX_DEMO_CLIENTS];
+// The writer's slots. The second half hold saved replay windows, one per client, so a save
+// never lands in the middle of that client's ordinary recording.
+#define DEMO_WRITER_SLOTS (MAX_DEMO_CLIENTS * 2)
+static demo_client_t demos[DEMO_WRITER_SLOTS];
+static unsigned char writer_stage[DEMO_WRITER_SLOTS][DEMO_STAGE_SIZE];
 // The failure paths publish the ".part" name, so the completion field has to hold it.
 // Truncating there would report a file that is not on disk.
 _Static_assert(sizeof(((demo_finished_t *)0)->path) >= sizeof(demos[0].path) + 8,
@@ -103,6 +207,11 @@ static unsigned char writer_scratch[MAX_NETCHAN_MSGLEN + 64];
 static demo_finished_t demo_done[DEMO_DONE_MAX];
 static unsigned demo_done_head, demo_done_tail;
 static unsigned demo_done_dropped;
+
+// Running totals for Demo_Counters. The segment counts are under demo_lock with the queue;
+// the byte count is bumped by the writer per block, so it's atomic instead.
+static unsigned demo_total_finished, demo_total_discarded, demo_total_failed, demo_total_dropped;
+static _Atomic uint64_t demo_bytes_written;
 // Queued + dropped, so the frame hook can bail without touching demo_lock at all.
 static atomic_uint demo_done_pending;
 
@@ -120,7 +229,11 @@ static atomic_ullong demo_seq_done;
 static cvar_t *sv_demoRecord;       // 0 = off, 1 = record every connected client
 static cvar_t *sv_demoDir;          // output subdirectory, under fs_homepath
 static cvar_t *sv_demoNameFormat;   // filename template: %date %slot %name
-static cvar_t *sv_demoCleanupParts; // remove leftover .part files at startup
+static cvar_t *sv_demoCleanupParts; // at startup: 0 leave .part files, 1 keep them as .salvage, 2 remove
+static cvar_t *sv_demoCompress;     // gzip level for new segments, 1-9; 0 writes plain .dm_91
+static cvar_t *sv_demoIndex;        // write a seek index beside each new segment
+static cvar_t *sv_demoReplay;       // seconds of every client held in memory for Demo_SaveWindow
+static cvar_t *sv_demoReplayMB;     // cap on that memory, per client
 static cvar_t *fs_homepath;
 
 static const int32_t demo_eof[2] = {-1, -1};
@@ -158,7 +271,23 @@ static void demo_mkdir_p(const char *path) {
     mkdir(tmp, 0755);
 }
 
-static void demo_build_name(char *out, size_t n, int slot, client_t *client) {
+// Read on the game thread when a segment opens and carried to the writer in the OPEN record, so
+// a change mid-segment applies from the next one.
+static int demo_compress_level(void) {
+    return cvar_clamped(sv_demoCompress, 0, 0, 9);
+}
+
+// Zero when the replay buffer is off. Always, in a nopy build: only Python can ask for a window,
+// and nothing there runs Demo_ReplayFrame either.
+static int demo_replay_seconds(void) {
+#ifdef NOPY
+    return 0;
+#else
+    return sv_demoReplay ? cvar_clamped(sv_demoReplay, 0, 0, DEMO_REPLAY_MAX_SECONDS) : 0;
+#endif
+}
+
+static void demo_build_name(char *out, size_t n, int slot, client_t *client, const char *tag) {
     const char *subdir = (sv_demoDir && sv_demoDir->string[0]) ? sv_demoDir->string : "demos";
 
     time_t now = time(NULL);
@@ -201,10 +330,11 @@ static void demo_build_name(char *out, size_t n, int slot, client_t *client) {
     }
     body[o] = '\0';
 
-    snprintf(out, n, "%s/%s/%s.dm_91", fs_homepath->string, subdir, body);
+    snprintf(out, n, "%s/%s/%s%s.dm_91%s", fs_homepath->string, subdir, body, tag, demo_compress_level() ? ".gz" : "");
 }
 
-// Both ring copy helpers require demo_lock to be held and handle wraparound with a split copy.
+// Both ring copy helpers handle wraparound with a split copy. Neither touches the positions; the
+// caller publishes those once the copy is complete.
 static void ring_copy_in(uint64_t pos, const void *src, size_t n) {
     size_t off   = (size_t)(pos & (DEMO_RING_SIZE - 1));
     size_t first = DEMO_RING_SIZE - off;
@@ -225,34 +355,48 @@ static void ring_copy_out(uint64_t pos, void *dst, size_t n) {
     memcpy((unsigned char *)dst + first, demo_ring, n - first);
 }
 
-// Caller holds demo_lock. Returns 0 on success, -1 if the record does not fit. The signal
-// cannot wake the writer before the caller unlocks, so state may be published after it in
-// the same critical section.
-static int demo_ring_put_locked(const demo_rec_hdr_t *hdr, const void *payload) {
-    size_t need = sizeof(*hdr) + hdr->len;
+static void demo_futex_wake(void) {
+    atomic_fetch_add_explicit(&demo_wake, 1, memory_order_relaxed);
+    syscall(SYS_futex, &demo_wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Ends the writer's wait if this put is worth one. The exchange means only one put pays for the
+// syscall however many land before the writer runs.
+static void demo_wake_writer(int urgent) {
+    // Pairs with the fence in writer_wait: either the writer sees the new head, or this sees it idle.
+    atomic_thread_fence(memory_order_seq_cst);
+    int idle = atomic_load_explicit(&demo_writer_idle, memory_order_relaxed);
+    if (idle == DEMO_WRITER_BUSY || (idle == DEMO_WRITER_NAPPING && !urgent)) {
+        return;
+    }
+    if (atomic_compare_exchange_strong(&demo_writer_idle, &idle, DEMO_WRITER_BUSY)) {
+        demo_futex_wake();
+    }
+}
 
-    if (DEMO_RING_SIZE - (demo_head - demo_tail) < need) {
+// Game thread only. Returns 0 on success, -1 if the record does not fit.
+static int demo_ring_put(const demo_rec_hdr_t *hdr, const void *payload) {
+    size_t need   = sizeof(*hdr) + hdr->len;
+    uint64_t head = atomic_load_explicit(&demo_head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&demo_tail, memory_order_acquire);
+
+    if (DEMO_RING_SIZE - (head - tail) < need) {
         return -1;
     }
-    ring_copy_in(demo_head, hdr, sizeof(*hdr));
+    ring_copy_in(head, hdr, sizeof(*hdr));
     if (hdr->len) {
-        ring_copy_in(demo_head + sizeof(*hdr), payload, hdr->len);
+        ring_copy_in(head + sizeof(*hdr), payload, hdr->len);
     }
-    demo_head += need;
-    // Under the lock and before the signal, so the writer can never bump demo_seq_done
-    // past a put that has not been counted yet.
+    // Counted before the head moves, so the writer can never bump demo_seq_done past a put that
+    // has not been counted yet.
     atomic_store_explicit(&demo_seq_put, atomic_load_explicit(&demo_seq_put, memory_order_relaxed) + 1,
                           memory_order_relaxed);
-    pthread_cond_signal(&demo_cond);
-    return 0;
-}
+    atomic_store_explicit(&demo_head, head + need, memory_order_release);
 
-// Game thread only. Returns 0 on success, -1 if the record does not fit.
-static int demo_ring_put(const demo_rec_hdr_t *hdr, const void *payload) {
-    pthread_mutex_lock(&demo_lock);
-    int rc = demo_ring_put_locked(hdr, payload);
-    pthread_mutex_unlock(&demo_lock);
-    return rc;
+    // Marks are as patient as the blocks they point at.
+    int control = hdr->type != DEMO_REC_BLOCK && hdr->type != DEMO_REC_MARK;
+    demo_wake_writer(control || head + need - tail >= DEMO_RING_URGENT);
+    return 0;
 }
 
 // d->path holds the final name; the segment is recorded into "<name>.part" until finalised.
@@ -265,11 +409,20 @@ static void demo_part_name(char *out, size_t n, const char *path) {
 static void writer_publish_done(int slot, uint32_t gen, const char *path, long bytes, int discarded,
                                 int failed) {
     pthread_mutex_lock(&demo_lock);
+    if (failed) {
+        demo_total_failed++;
+    } else if (discarded) {
+        demo_total_discarded++;
+    } else {
+        demo_total_finished++;
+    }
     if (demo_done_head - demo_done_tail >= DEMO_DONE_MAX) {
         demo_done_dropped++;
+        demo_total_dropped++;
     } else {
         demo_finished_t *f = &demo_done[demo_done_head % DEMO_DONE_MAX];
-        f->slot            = slot;
+        f->slot            = slot % MAX_DEMO_CLIENTS;
+        f->replay          = slot >= MAX_DEMO_CLIENTS;
         f->gen             = gen;
         f->discarded       = discarded;
         f->failed          = failed;
@@ -282,16 +435,211 @@ static void writer_publish_done(int slot, uint32_t gen, const char *path, long b
     pthread_mutex_unlock(&demo_lock);
 }
 
+static qboolean writer_is_open(const demo_client_t *d) {
+    return (d->fd >= 0 || d->gz) ? qtrue : qfalse;
+}
+
+// Every byte of iov to the file at off, however many calls that takes. Consumes iov.
+static qboolean writer_pwritev(int fd, struct iovec *iov, int count, off_t off) {
+    while (count > 0) {
+        ssize_t n = pwritev(fd, iov, count, off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return qfalse;
+        }
+        off += n;
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (unsigned char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return qtrue;
+}
+
+// Extends the preallocation to cover `end`. Only ever a hint: KEEP_SIZE leaves the file's length
+// alone, so a .part cut short by a crash still ends at its last block rather than in zeroes, and
+// a filesystem without fallocate just gets the writes.
+static void writer_preallocate(demo_client_t *d, long end) {
+    if (d->allocated < 0 || end <= d->allocated) {
+        return;
+    }
+    long want = (end + DEMO_PREALLOC_CHUNK - 1) / DEMO_PREALLOC_CHUNK * DEMO_PREALLOC_CHUNK;
+    if (fallocate(d->fd, FALLOC_FL_KEEP_SIZE, d->allocated, want - d->allocated)) {
+        d->allocated = -1;
+        return;
+    }
+    d->allocated = want;
+}
+
+// The staged bytes and then iov (up to three pieces), in one call.
+static qboolean writer_flush(demo_client_t *d, const struct iovec *iov, int count) {
+    struct iovec all[4];
+    long pending    = d->staged;
+    all[0].iov_base = writer_stage[d - demos];
+    all[0].iov_len  = d->staged;
+    for (int i = 0; i < count; i++) {
+        all[i + 1] = iov[i];
+        pending += (long)iov[i].iov_len;
+    }
+    if (!pending) {
+        return qtrue;
+    }
+    long off = d->bytes - d->staged;
+    writer_preallocate(d, off + pending);
+    d->staged = 0;
+    return writer_pwritev(d->fd, all, count + 1, (off_t)off);
+}
+
+// Plain segments stage and gzip buffers, so a qtrue here only means the bytes were accepted;
+// writer_close has the final say. Takes at most three pieces; d->bytes is the caller's to bump,
+// after the call.
+static qboolean writer_write(demo_client_t *d, const struct iovec *iov, int count) {
+    if (d->gz) {
+        for (int i = 0; i < count; i++) {
+            if (iov[i].iov_len && gzwrite(d->gz, iov[i].iov_base, (unsigned)iov[i].iov_len) != (int)iov[i].iov_len) {
+                return qfalse;
+            }
+        }
+        return qtrue;
+    }
+
+    size_t n = 0;
+    for (int i = 0; i < count; i++) {
+        n += iov[i].iov_len;
+    }
+    if (d->staged + n > DEMO_STAGE_SIZE) {
+        return writer_flush(d, iov, count);
+    }
+    unsigned char *stage = writer_stage[d - demos];
+    for (int i = 0; i < count; i++) {
+        memcpy(stage + d->staged, iov[i].iov_base, iov[i].iov_len);
+        d->staged += (uint32_t)iov[i].iov_len;
+    }
+    return qtrue;
+}
+
+// qfalse if anything failed to reach the file, including what was still buffered.
+static qboolean writer_close(demo_client_t *d) {
+    qboolean ok = qtrue;
+    if (d->gz) {
+        ok    = gzclose(d->gz) == Z_OK;
+        d->gz = NULL;
+    } else if (d->fd >= 0) {
+        ok = writer_flush(d, NULL, 0);
+        // Hands back the part of the last extent we never reached. The length is unchanged, but
+        // truncating to it still drops the blocks held past it.
+        if (d->allocated > d->bytes && ftruncate(d->fd, (off_t)d->bytes)) {
+            ok = qfalse;
+        }
+        if (close(d->fd)) {
+            ok = qfalse;
+        }
+        d->fd = -1;
+    }
+    return ok;
+}
+
+// The index goes the way of its segment: renamed into place beside it, deleted with it, or left
+// as .idx.part next to a .part, for the startup sweep to take with it.
+typedef enum {
+    INDEX_KEEP,
+    INDEX_DROP,
+    INDEX_LEAVE,
+} index_fate_t;
+
+static void writer_end_index(demo_client_t *d, index_fate_t fate) {
+    if (!d->idx) {
+        return;
+    }
+    int bad = fclose(d->idx) != 0;
+    d->idx  = NULL;
+
+    char idx[sizeof(d->path) + 16], part[sizeof(d->path) + 16];
+    snprintf(idx, sizeof(idx), "%s.idx", d->path);
+    snprintf(part, sizeof(part), "%s.idx.part", d->path);
+    if (fate == INDEX_LEAVE) {
+        return;
+    }
+    // An index is only a convenience, so one that failed is dropped rather than failing a demo
+    // that made it to disk whole.
+    if (fate == INDEX_DROP || bad || rename(part, idx)) {
+        if (fate == INDEX_KEEP) {
+            DebugPrint("demo: could not write %s; the demo is fine without it\n", idx);
+        }
+        unlink(part);
+    }
+}
+
+static const char *demo_mark_names[DEMO_MARK_COUNT] = {
+    [DEMO_MARK_GAMESTATE] = "gamestate",     [DEMO_MARK_SNAPSHOT] = "snapshot",
+    [DEMO_MARK_GAME_START] = "game_start",   [DEMO_MARK_GAME_END] = "game_end",
+    [DEMO_MARK_ROUND_START] = "round_start", [DEMO_MARK_ROUND_END] = "round_end",
+    [DEMO_MARK_SCORE] = "score",             [DEMO_MARK_FRAG] = "frag",
+};
+
+// One JSON object per line, at the offset the segment's next block will be written to.
+static void writer_index_mark(demo_client_t *d, const demo_mark_t *m) {
+    if (!d->idx || m->kind < 0 || m->kind >= DEMO_MARK_COUNT) {
+        return;
+    }
+    FILE *f = d->idx;
+    fprintf(f, "{\"offset\":%ld,\"block\":%ld,\"time\":%d,", d->bytes, d->blocks, m->time);
+    if (m->clock >= 0) {
+        fprintf(f, "\"clock\":%d,", m->clock);
+    }
+    fprintf(f, "\"event\":\"%s\"", demo_mark_names[m->kind]);
+    switch (m->kind) {
+    case DEMO_MARK_GAMESTATE:
+    case DEMO_MARK_SNAPSHOT:
+        fprintf(f, ",\"seq\":%d", m->a);
+        break;
+    case DEMO_MARK_GAME_END:
+        fprintf(f, ",\"aborted\":%s", m->a ? "true" : "false");
+        break;
+    case DEMO_MARK_ROUND_START:
+        fprintf(f, ",\"round\":%d", m->a);
+        break;
+    case DEMO_MARK_ROUND_END:
+        fprintf(f, ",\"round\":%d,\"winner\":%d", m->a, m->b);
+        break;
+    case DEMO_MARK_SCORE:
+        fprintf(f, ",\"red\":%d,\"blue\":%d", m->a, m->b);
+        break;
+    case DEMO_MARK_FRAG:
+        fprintf(f, ",\"victim\":%d,\"killer\":%d,\"mod\":%d", m->a, m->b, m->c);
+        break;
+    }
+    fputs("}\n", f);
+}
+
+static void writer_handle_mark(int slot, const demo_mark_t *m) {
+    if (slot >= 0) {
+        writer_index_mark(&demos[slot], m);
+        return;
+    }
+    for (int i = 0; i < MAX_DEMO_CLIENTS; i++) { // replay windows carry no index
+        writer_index_mark(&demos[i], m);
+    }
+}
+
 static void writer_finalise(demo_client_t *d) {
-    if (!d->fh) {
+    if (!writer_is_open(d)) {
         return;
     }
-    // The stream is 64 KB fully buffered, so on a full disk the last blocks are still in
-    // stdio and fclose's return is the only sign.
-    int bad = (fwrite(demo_eof, sizeof(demo_eof), 1, d->fh) != 1) || ferror(d->fh);
+    // Both paths hold up to 64 KB back, so on a full disk the last blocks are still in memory
+    // and the close is the only sign. Compressed, the deflate tail is written there too.
+    qboolean compressed = d->gz ? qtrue : qfalse;
+    struct iovec eof    = {(void *)demo_eof, sizeof(demo_eof)};
+    int bad             = !writer_write(d, &eof, 1);
     d->bytes += (long)sizeof(demo_eof);
-    bad |= (fclose(d->fh) != 0);
-    d->fh = NULL;
+    bad |= !writer_close(d);
 
     int slot = (int)(d - demos);
 
@@ -299,13 +647,15 @@ static void writer_finalise(demo_client_t *d) {
     demo_part_name(part, sizeof(part), d->path);
     if (bad) {
         // Leave it as .part and report the failure, matching writer_handle_block. The byte
-        // count is what we handed to stdio, so it overstates what reached the disk.
+        // count is what the writer was handed, so it overstates what reached the disk.
         DebugPrint("demo: write failed finalising %s\n", part);
+        writer_end_index(d, INDEX_LEAVE);
         writer_publish_done(slot, d->gen, part, d->bytes, 0, 1);
         return;
     }
     if (d->blocks <= 1) { // only the gamestate.
         unlink(part);
+        writer_end_index(d, INDEX_DROP);
         DebugPrint("demo: discarded empty segment %s\n", d->path);
         writer_publish_done(slot, d->gen, d->path, d->bytes, 1, 0);
         return;
@@ -314,13 +664,21 @@ static void writer_finalise(demo_client_t *d) {
     // half-written .part. A failed rename leaves it under the .part name, so report that.
     if (rename(part, d->path)) {
         DebugPrint("demo: could not rename %s into place\n", part);
+        writer_end_index(d, INDEX_LEAVE);
         writer_publish_done(slot, d->gen, part, d->bytes, 0, 1);
         return;
     }
+    // Before the completion goes out, so a demo_finished handler can rely on finding it.
+    writer_end_index(d, INDEX_KEEP);
+    // What the file takes on disk. d->bytes counted the demo as it would be expanded.
+    struct stat st;
+    if (compressed && !stat(d->path, &st)) {
+        d->bytes = (long)st.st_size;
+    }
     writer_publish_done(slot, d->gen, d->path, d->bytes, 0, 0);
 }
 
-static void writer_handle_open(int slot, uint32_t gen, const char *path) {
+static void writer_handle_open(int slot, uint32_t gen, const char *path, int level, int index) {
     demo_client_t *d = &demos[slot];
     writer_finalise(d); // just in case this slot's CLOSE was dropped.
 
@@ -344,28 +702,56 @@ static void writer_handle_open(int slot, uint32_t gen, const char *path) {
 
     char part[sizeof(d->path) + 8];
     demo_part_name(part, sizeof(part), d->path);
-    d->fh = fopen(part, "wb");
-    if (!d->fh) {
+    if (level > 0) {
+        // Streamed: deflate runs here, on the writer, as the blocks arrive. Expand the result with
+        // tools/demo_expand.py, or any gunzip.
+        char mode[16];
+        snprintf(mode, sizeof(mode), "wb%d", level);
+        d->gz = gzopen(part, mode);
+        if (d->gz) {
+            gzbuffer(d->gz, 64 * 1024);
+        }
+    } else {
+        d->fd = open(part, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (!writer_is_open(d)) {
         DebugPrint("demo: could not open %s\n", part);
         writer_publish_done(slot, gen, part, 0, 0, 1);
         return;
     }
-    setvbuf(d->fh, NULL, _IOFBF, 64 * 1024);
-    d->blocks = 0;
-    d->bytes  = 0;
-    DebugPrint("demo: recording slot %d -> %s\n", slot, d->path);
+    d->blocks    = 0;
+    d->bytes     = 0;
+    d->allocated = 0;
+    d->staged    = 0;
+
+    if (index) {
+        char idx[sizeof(d->path) + 16];
+        snprintf(idx, sizeof(idx), "%s.idx.part", d->path);
+        d->idx = fopen(idx, "w");
+        if (d->idx) {
+            fprintf(d->idx, "{\"version\":1,\"compressed\":%s}\n", level > 0 ? "true" : "false");
+        } else {
+            DebugPrint("demo: could not open %s; recording without an index\n", idx);
+        }
+    }
+    if (slot >= MAX_DEMO_CLIENTS) {
+        DebugPrint("demo: saving slot %d's replay -> %s\n", slot - MAX_DEMO_CLIENTS, d->path);
+    } else {
+        DebugPrint("demo: recording slot %d -> %s\n", slot, d->path);
+    }
 }
 
 static void writer_handle_block(int slot, int32_t seq, const unsigned char *data, uint32_t len) {
     demo_client_t *d = &demos[slot];
-    if (!d->fh) {
+    if (!writer_is_open(d)) {
         return; // dropped OPEN or earlier write error.
     }
-    int32_t hdr[2] = {seq, (int32_t)len};
-    if (fwrite(hdr, sizeof(hdr), 1, d->fh) != 1 || fwrite(data, 1, len, d->fh) != len) {
+    int32_t hdr[2]      = {seq, (int32_t)len};
+    struct iovec iov[2] = {{hdr, sizeof(hdr)}, {(void *)data, len}};
+    if (!writer_write(d, iov, 2)) {
         DebugPrint("demo: write error on slot %d, closing\n", slot);
-        fclose(d->fh); // left behind as .part to mark it incomplete.
-        d->fh = NULL;
+        writer_close(d); // left behind as .part to mark it incomplete.
+        writer_end_index(d, INDEX_LEAVE);
         // Report it so the game thread stops capturing this segment; without that it
         // keeps queueing blocks the writer will drop until the next gamestate.
         char part[sizeof(d->path) + 8];
@@ -375,44 +761,84 @@ static void writer_handle_block(int slot, int32_t seq, const unsigned char *data
     }
     d->blocks++;
     d->bytes += (long)sizeof(hdr) + (long)len;
+    atomic_fetch_add_explicit(&demo_bytes_written, sizeof(hdr) + len, memory_order_relaxed);
+}
+
+// Opens, writes and finalises a saved window in one go. A write error closes the segment, and
+// the blocks after it then go nowhere, as for a recording.
+static void writer_handle_window(int slot, demo_window_t *w, const char *path, int level) {
+    writer_handle_open(slot, 0, path, level, 0);
+    writer_handle_block(slot, w->gamestate_seq, w->data, w->gamestate_len);
+    if (w->prelude_len) {
+        writer_handle_block(slot, w->prelude_seq, w->data + w->gamestate_len, w->prelude_len);
+    }
+    for (replay_chunk_t *c = w->first;; c = c->next) {
+        uint32_t pos = c == w->first ? w->first_off : 0;
+        uint32_t end = c == w->last ? w->end : c->used;
+        while (pos < end) {
+            replay_entry_t e;
+            memcpy(&e, c->data + pos, sizeof(e));
+            writer_handle_block(slot, e.seq, c->data + pos + sizeof(e) + e.prelude, e.len);
+            pos += (uint32_t)sizeof(e) + e.prelude + e.len;
+        }
+        if (c == w->last) {
+            break;
+        }
+    }
+    writer_finalise(&demos[slot]);
+    demo_window_free(w);
+}
+
+// The ring is empty as of `tail`. Waits in the given state until a put wakes us or, napping, the
+// nap runs out.
+static void writer_wait(uint64_t tail, demo_writer_idle_t state) {
+    unsigned seen = atomic_load_explicit(&demo_wake, memory_order_relaxed);
+    atomic_store_explicit(&demo_writer_idle, state, memory_order_relaxed);
+    // Pairs with the fence in demo_wake_writer.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&demo_head, memory_order_relaxed) == tail) {
+        struct timespec nap = {0, DEMO_WRITER_NAP_MS * 1000000L};
+        syscall(SYS_futex, &demo_wake, FUTEX_WAIT_PRIVATE, seen, state == DEMO_WRITER_NAPPING ? &nap : NULL,
+                NULL, 0);
+    }
+    atomic_store_explicit(&demo_writer_idle, DEMO_WRITER_BUSY, memory_order_relaxed);
 }
 
 static void *demo_writer_main(void *unused) {
     (void)unused;
 
-    // Keep the engine's asynchronous signal handling on the main thread. SIGSEGV, SIGBUS,
-    // SIGFPE and SIGILL stay unblocked, since blocking a fault the thread raises itself is
-    // undefined, and SIGABRT with them so the engine still prints a backtrace.
-    sigset_t all;
-    sigfillset(&all);
-    sigdelset(&all, SIGSEGV);
-    sigdelset(&all, SIGBUS);
-    sigdelset(&all, SIGFPE);
-    sigdelset(&all, SIGILL);
-    sigdelset(&all, SIGABRT);
-    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    // Nothing can be open here: the last writer finalised every slot on its way out. The zeroed
+    // array has fd 0 everywhere, though, which would pass for an open file.
+    for (int i = 0; i < DEMO_WRITER_SLOTS; i++) {
+        demos[i].fd = -1;
+    }
 
+    int napped_empty = 0;
     for (;;) {
         demo_rec_hdr_t hdr;
         uint32_t len;
 
-        pthread_mutex_lock(&demo_lock);
-        while (demo_head == demo_tail) {
-            pthread_cond_wait(&demo_cond, &demo_lock);
+        uint64_t tail = atomic_load_explicit(&demo_tail, memory_order_relaxed);
+        if (atomic_load_explicit(&demo_head, memory_order_acquire) == tail) {
+            writer_wait(tail, napped_empty ? DEMO_WRITER_ASLEEP : DEMO_WRITER_NAPPING);
+            napped_empty = 1;
+            continue;
         }
-        ring_copy_out(demo_tail, &hdr, sizeof(hdr));
+        napped_empty = 0;
+
+        ring_copy_out(tail, &hdr, sizeof(hdr));
         len = hdr.len;
         if (len > sizeof(writer_scratch)) { // should be impossible.
             len = 0;
         }
         if (len) {
-            ring_copy_out(demo_tail + sizeof(hdr), writer_scratch, len);
+            ring_copy_out(tail + sizeof(hdr), writer_scratch, len);
         }
-        demo_tail += sizeof(hdr) + hdr.len;
-        pthread_mutex_unlock(&demo_lock);
+        // Copied out, so the game thread may reuse the space while we write.
+        atomic_store_explicit(&demo_tail, tail + sizeof(hdr) + hdr.len, memory_order_release);
 
         if (hdr.type == DEMO_REC_SHUTDOWN) {
-            for (int i = 0; i < MAX_DEMO_CLIENTS; i++) {
+            for (int i = 0; i < DEMO_WRITER_SLOTS; i++) {
                 writer_finalise(&demos[i]);
             }
             pthread_mutex_lock(&demo_lock);
@@ -423,12 +849,31 @@ static void *demo_writer_main(void *unused) {
         }
         // A malformed record is still a record that has been consumed, so it has to be
         // counted like any other or Demo_DrainFinalise would wait for it forever.
-        if (len == hdr.len && hdr.slot >= 0 && hdr.slot < MAX_DEMO_CLIENTS) {
+        int min_slot = hdr.type == DEMO_REC_MARK ? -1 : 0;
+        if (len == hdr.len && hdr.slot >= min_slot && hdr.slot < DEMO_WRITER_SLOTS) {
             switch (hdr.type) {
             case DEMO_REC_OPEN:
-                if (len > 0) {
-                    writer_scratch[len - 1] = '\0';
-                    writer_handle_open(hdr.slot, (uint32_t)hdr.seq, (const char *)writer_scratch);
+                if (len > 2) {
+                    int level               = writer_scratch[len - 2];
+                    int index               = writer_scratch[len - 1];
+                    writer_scratch[len - 3] = '\0';
+                    writer_handle_open(hdr.slot, (uint32_t)hdr.seq, (const char *)writer_scratch, level, index);
+                }
+                break;
+            case DEMO_REC_WINDOW:
+                if (len > sizeof(demo_window_t *) + 1) {
+                    demo_window_t *w;
+                    memcpy(&w, writer_scratch, sizeof(w));
+                    int level               = writer_scratch[len - 1];
+                    writer_scratch[len - 2] = '\0';
+                    writer_handle_window(hdr.slot, w, (const char *)writer_scratch + sizeof(w), level);
+                }
+                break;
+            case DEMO_REC_MARK:
+                if (len == sizeof(demo_mark_t)) {
+                    demo_mark_t mark;
+                    memcpy(&mark, writer_scratch, sizeof(mark));
+                    writer_handle_mark(hdr.slot, &mark);
                 }
                 break;
             case DEMO_REC_BLOCK:
@@ -438,7 +883,7 @@ static void *demo_writer_main(void *unused) {
                 writer_finalise(&demos[hdr.slot]);
                 break;
             case DEMO_REC_CLOSE_ALL:
-                for (int i = 0; i < MAX_DEMO_CLIENTS; i++) {
+                for (int i = 0; i < DEMO_WRITER_SLOTS; i++) {
                     writer_finalise(&demos[i]);
                 }
                 break;
@@ -464,8 +909,9 @@ static int demo_slot_wanted(int slot) {
 }
 
 static int demo_reconcile_thread(void) {
-    // Needed if we're recording everyone, or any one slot was explicitly asked for.
-    int enabled = sv_demoRecord->integer != 0 || demo_forced_on > 0;
+    // Needed if we're recording everyone, or any one slot was explicitly asked for, or there is
+    // a replay buffer a window could be saved from.
+    int enabled = sv_demoRecord->integer != 0 || demo_forced_on > 0 || demo_replay_seconds() > 0;
 
     if (enabled && demo_state_cached == DEMO_THREAD_RUNNING) {
         return 1;
@@ -487,12 +933,10 @@ static int demo_reconcile_thread(void) {
     }
 
     if (enabled) { // cached state is STOPPED, so start the writer.
-        pthread_t th;
-        if (pthread_create(&th, NULL, demo_writer_main, NULL)) {
+        if (Worker_Start("qlx demo writer", WORKER_BACKGROUND, demo_writer_main, NULL)) {
             DebugPrint("demo: could not start writer thread; recording disabled\n");
             return 0;
         }
-        pthread_detach(th);
         pthread_mutex_lock(&demo_lock);
         demo_thread_state = DEMO_THREAD_RUNNING;
         pthread_mutex_unlock(&demo_lock);
@@ -502,12 +946,13 @@ static int demo_reconcile_thread(void) {
     }
 
     // Disabled while RUNNING: stop the writer, and SHUTDOWN finalises all open demos.
-    // STOPPING is published in the same critical section as the record. Released first, the
-    // writer can store STOPPED before this lands, leaving STOPPING stuck with no writer
-    // alive: recording dead for the process, and every shutdown waiting out the drain.
+    // The record is put with demo_lock held and STOPPING published before it is released, so the
+    // writer's STOPPED, taken under the same lock, always lands after. The other way round
+    // leaves STOPPING stuck with no writer alive: recording dead for the process, and every
+    // shutdown waiting out the drain.
     demo_rec_hdr_t hdr = {DEMO_REC_SHUTDOWN, 0, 0, 0};
     pthread_mutex_lock(&demo_lock);
-    int queued = demo_ring_put_locked(&hdr, NULL);
+    int queued = demo_ring_put(&hdr, NULL);
     if (queued == 0) {
         demo_thread_state = DEMO_THREAD_STOPPING;
     }
@@ -524,7 +969,64 @@ static int demo_reconcile_thread(void) {
 #define DEMO_SWEEP_DEPTH   8
 #define DEMO_SWEEP_MIN_AGE 60 // seconds; see the note about other servers below.
 
-static void demo_sweep_dir(const char* dir, int depth, time_t cutoff, unsigned* removed, unsigned* kept) {
+// What sv_demoCleanupParts does with what a previous run left behind.
+typedef enum {
+    DEMO_SWEEP_OFF = 0,
+    DEMO_SWEEP_SALVAGE, // rename anything with blocks in it to .salvage, remove the rest
+    DEMO_SWEEP_REMOVE,
+} demo_sweep_mode_t;
+
+typedef struct {
+    demo_sweep_mode_t mode;
+    time_t cutoff;
+    unsigned removed, renamed, kept;
+} demo_sweep_t;
+
+// "<name>.part" to "<name>.salvage", where the startup sweep will not look at it again and
+// tools/demo_expand.py --salvage will.
+static int demo_sweep_rename(const char* part) {
+    char salvage[512 + 8];
+    size_t len = strlen(part) - 5;
+    if ((size_t)snprintf(salvage, sizeof(salvage), "%.*s.salvage", (int)len, part) >= sizeof(salvage)) {
+        return -1;
+    }
+    return rename(part, salvage);
+}
+
+static void demo_sweep_remove(demo_sweep_t* sw, const char* path) {
+    if (unlink(path)) {
+        DebugPrint("demo: could not remove %s\n", path);
+    } else {
+        sw->removed++;
+    }
+}
+
+// One leftover segment, and the index that went with it if there is one.
+static void demo_sweep_segment(demo_sweep_t* sw, const char* path, const struct stat* st) {
+    char idx[512];
+    size_t len = strlen(path) - 5;
+    int has_idx =
+        (size_t)snprintf(idx, sizeof(idx), "%.*s.idx.part", (int)len, path) < sizeof(idx) && !access(idx, F_OK);
+
+    // An empty one never got as far as its gamestate, so there is nothing in it to keep.
+    if (sw->mode == DEMO_SWEEP_SALVAGE && st->st_size > 0) {
+        if (demo_sweep_rename(path)) {
+            DebugPrint("demo: could not rename %s for salvage\n", path);
+            return;
+        }
+        sw->renamed++;
+        if (has_idx && demo_sweep_rename(idx)) {
+            DebugPrint("demo: could not rename %s for salvage\n", idx);
+        }
+        return;
+    }
+    demo_sweep_remove(sw, path);
+    if (has_idx) {
+        demo_sweep_remove(sw, idx);
+    }
+}
+
+static void demo_sweep_dir(demo_sweep_t* sw, const char* dir, int depth) {
     DIR* d = opendir(dir);
     if (!d) {
         return;
@@ -540,13 +1042,15 @@ static void demo_sweep_dir(const char* dir, int depth, time_t cutoff, unsigned*
             continue;
         }
 
+        // Also skips an index already renamed or removed along with its segment, which
+        // readdir may still list.
         struct stat st;
         if (lstat(path, &st)) {
             continue;
         }
         if (S_ISDIR(st.st_mode)) {
             if (depth + 1 < DEMO_SWEEP_DEPTH) {
-                demo_sweep_dir(path, depth + 1, cutoff, removed, kept);
+                demo_sweep_dir(sw, path, depth + 1);
             }
             continue;
         }
@@ -561,15 +1065,21 @@ static void demo_sweep_dir(const char* dir, int depth, time_t cutoff, unsigned*
 
         // Another server sharing this directory could have one of these open right now, and
         // an open segment gets written to constantly, so leave anything recent alone.
-        if (st.st_mtime > cutoff) {
-            (*kept)++;
+        if (st.st_mtime > sw->cutoff) {
+            sw->kept++;
             continue;
         }
-        if (unlink(path)) {
-            DebugPrint("demo: could not remove %s\n", path);
-        } else {
-            (*removed)++;
+
+        if (len > 9 && !strcmp(e->d_name + len - 9, ".idx.part")) {
+            // Goes with its segment, whichever readdir lists first. On its own, it is of no use.
+            char segment[512];
+            snprintf(segment, sizeof(segment), "%.*s.part", (int)(strlen(path) - 9), path);
+            if (access(segment, F_OK)) {
+                demo_sweep_remove(sw, path);
+            }
+            continue;
         }
+        demo_sweep_segment(sw, path, &st);
     }
 
     closedir(d);
@@ -577,9 +1087,13 @@ static void demo_sweep_dir(const char* dir, int depth, time_t cutoff, unsigned*
 
 // The writer renames a segment into place once finalised, and every ordinary way out of the
 // server finalises first, so a surviving .part belongs to a run that was killed outright or
-// crashed with it open, and will never be completed.
+// crashed with it open, and will never be completed. What it holds up to the crash can still be
+// played, once cut back to whole blocks, so by default it is kept under another name.
 static void demo_sweep_parts(void) {
-    if (sv_demoCleanupParts && !sv_demoCleanupParts->integer) {
+    demo_sweep_t sw = {0};
+    sw.mode = sv_demoCleanupParts ? (demo_sweep_mode_t)cvar_clamped(sv_demoCleanupParts, DEMO_SWEEP_SALVAGE, 0, 2)
+                                  : DEMO_SWEEP_SALVAGE;
+    if (sw.mode == DEMO_SWEEP_OFF) {
         return;
     }
     if (!fs_homepath || !fs_homepath->string[0]) {
@@ -592,15 +1106,20 @@ static void demo_sweep_parts(void) {
         return;
     }
 
-    unsigned removed = 0, kept = 0;
-    demo_sweep_dir(dir, 0, time(NULL) - DEMO_SWEEP_MIN_AGE, &removed, &kept);
-    if (removed) {
-        DebugPrint("demo: removed %u incomplete .part file(s) left by a previous run.\n", removed);
+    sw.cutoff = time(NULL) - DEMO_SWEEP_MIN_AGE;
+    demo_sweep_dir(&sw, dir, 0);
+    if (sw.renamed) {
+        DebugPrint("demo: kept %u incomplete demo(s) left by a previous run as .salvage; "
+                   "tools/demo_expand.py --salvage recovers them.\n",
+                   sw.renamed);
     }
-    if (kept) {
+    if (sw.removed) {
+        DebugPrint("demo: removed %u incomplete .part file(s) left by a previous run.\n", sw.removed);
+    }
+    if (sw.kept) {
         DebugPrint("demo: left %u .part file(s) written in the last %d seconds alone; another server may "
                    "still be recording them.\n",
-                   kept, DEMO_SWEEP_MIN_AGE);
+                   sw.kept, DEMO_SWEEP_MIN_AGE);
     }
 }
 
@@ -612,6 +1131,10 @@ void Demo_Init(void) {
     sv_demoDir          = Cvar_Get("sv_demoDir", "demos", CVAR_ARCHIVE);
     sv_demoNameFormat   = Cvar_Get("sv_demoNameFormat", "%date_slot%slot_%name", CVAR_ARCHIVE);
     sv_demoCleanupParts = Cvar_Get("sv_demoCleanupParts", "1", CVAR_ARCHIVE);
+    sv_demoCompress     = Cvar_Get("sv_demoCompress", "0", CVAR_ARCHIVE);
+    sv_demoIndex        = Cvar_Get("sv_demoIndex", "1", CVAR_ARCHIVE);
+    sv_demoReplay       = Cvar_Get("sv_demoReplay", "0", CVAR_ARCHIVE);
+    sv_demoReplayMB     = Cvar_Get("sv_demoReplayMB", "16", CVAR_ARCHIVE);
     fs_homepath         = Cvar_FindVar("fs_homepath");
 
     // Once per process: by the second G_InitGame the .part files on disk are our own. So
@@ -623,12 +1146,439 @@ void Demo_Init(void) {
     }
 }
 
-// Split out of Demo_Capture so the profiler wrapper covers every early return.
-static void Demo_CaptureBody(msg_t *msg, client_t *client) {
-    if (!sv_demoRecord || !MSG_WriteBits || !svs || !svs->clients || !fs_homepath) {
+// Game thread only. A mark lost to a full ring only costs the index an entry.
+static void demo_put_mark(int slot, demo_mark_kind_t kind, int clock, int a, int b, int c) {
+    demo_mark_t mark   = {kind, svs ? svs->time : 0, clock, a, b, c};
+    demo_rec_hdr_t hdr = {DEMO_REC_MARK, slot, 0, sizeof(mark)};
+    demo_ring_put(&hdr, &mark);
+}
+
+// Whether SV_WriteSnapshotToClient will send this client a snapshot built from nothing, which a
+// player can start from without the ones before it. The same test the engine makes.
+static int demo_snapshot_is_full(const client_t *client) {
+    return client->state != CS_ACTIVE || client->deltaMessage <= 0 ||
+           client->netchan.outgoingSequence - client->deltaMessage >= PACKET_BACKUP - 3;
+}
+
+// Instant replay. Under sv_demoReplay, every client's blocks are also kept in memory, the last
+// sv_demoReplay seconds of them, and Demo_SaveWindow hands a stretch of that to the writer as a
+// demo of its own. Nothing reaches the disk unless someone asks.
+//
+// A demo has to open with a gamestate, so each slot keeps its last one aside. Playback can then
+// only pick up at a snapshot sent without a delta, and the engine rarely sends those once a client
+// is in, so Demo_ReplayFrame asks for one every DEMO_REPLAY_KEYFRAME_MS. That costs each buffered
+// client one full snapshot in place of a delta that often. The configstrings have moved on by then
+// too, and the commands that moved them are in the blocks a window leaves out. So each keyframe is
+// stored with a prelude: a block of our own, built when it was captured, of "cs" commands taking
+// the gamestate's configstrings to that moment's.
+#define DEMO_REPLAY_KEYFRAME_MS 10000
+#define DEMO_REPLAY_PRELUDE_MAX (MAX_MSGLEN - 64) // what a client will read as one message
+#define SVC_SERVERCOMMAND       5
+
+// Hashes of the names recently given to saved windows, per slot. See replay_pick_name.
+#define DEMO_REPLAY_NAMES 8
+
+typedef struct {
+    replay_chunk_t *oldest, *newest; // NULL while the slot holds nothing
+    unsigned chunks;
+    int last_keyframe; // svs->time of the newest keyframe
+
+    unsigned char *gamestate; // the block, svc_EOF included; NULL until one is captured
+    uint32_t gamestate_len;
+    int32_t gamestate_seq;
+    int command_seq;          // reliableSequence as the gamestate went out
+
+    // The configstrings the gamestate carried, packed as a 16-bit index and then the string and its
+    // terminator, in index order.
+    unsigned char *cs;
+    size_t cs_len;
+} replay_slot_t;
+
+static replay_slot_t replay[MAX_DEMO_CLIENTS];
+static unsigned char replay_prelude[DEMO_REPLAY_PRELUDE_MAX + 64];
+static replay_chunk_t *replay_spare; // one evicted chunk kept back, so a busy slot seldom mallocs
+static uLong replay_names[MAX_DEMO_CLIENTS][DEMO_REPLAY_NAMES];
+static unsigned replay_names_next[MAX_DEMO_CLIENTS];
+
+// The game thread's side of replay_chunk_unref: a chunk nothing else holds is kept as the spare.
+static void replay_chunk_drop(replay_chunk_t *c) {
+    if (atomic_fetch_sub_explicit(&c->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (replay_spare) {
+        free(c);
+    } else {
+        replay_spare = c;
+    }
+}
+
+static void replay_drop_oldest(replay_slot_t *r) {
+    replay_chunk_t *c = r->oldest;
+    r->oldest         = c->next;
+    if (!r->oldest) {
+        r->newest = NULL;
+    }
+    r->chunks--;
+    replay_chunk_drop(c);
+}
+
+static void replay_release(int slot) {
+    replay_slot_t *r = &replay[slot];
+    while (r->oldest) {
+        replay_drop_oldest(r);
+    }
+    free(r->gamestate);
+    free(r->cs);
+    memset(r, 0, sizeof(*r));
+}
+
+// Packs the live configstrings into the slot, as the gamestate just sent will have carried them.
+static void replay_take_configstrings(replay_slot_t *r) {
+    free(r->cs);
+    r->cs     = NULL;
+    r->cs_len = 0;
+    if (!sv) {
+        return;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        if (sv->configstrings[i] && sv->configstrings[i][0]) {
+            total += 2 + strlen(sv->configstrings[i]) + 1;
+        }
+    }
+    if (!total || !(r->cs = malloc(total))) {
+        return;
+    }
+    for (int i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        const char *v = sv->configstrings[i];
+        if (v && v[0]) {
+            size_t n                = strlen(v) + 1;
+            r->cs[r->cs_len]     = (unsigned char)(i & 0xff);
+            r->cs[r->cs_len + 1] = (unsigned char)(i >> 8);
+            memcpy(r->cs + r->cs_len + 2, v, n);
+            r->cs_len += 2 + n;
+        }
+    }
+}
+
+// A new gamestate starts the slot over: what came before it belongs to another map, or to a
+// connection the client has since replaced.
+static void replay_on_gamestate(int slot, const client_t *client, const unsigned char *data, uint32_t len,
+                                int seq) {
+    replay_slot_t *r  = &replay[slot];
+    unsigned char *gs = realloc(r->gamestate, len);
+    if (!gs) {
+        replay_release(slot); // the old gamestate is still r->gamestate, so this frees it
+        DebugPrint("demo: no memory to hold slot %d's replay\n", slot);
+        return;
+    }
+    while (r->oldest) {
+        replay_drop_oldest(r);
+    }
+    memcpy(gs, data, len);
+    r->gamestate     = gs;
+    r->gamestate_len = len;
+    r->gamestate_seq = seq;
+    r->command_seq   = client->reliableSequence;
+    r->last_keyframe = 0;
+    replay_take_configstrings(r);
+}
+
+static void replay_write_string(msg_t *m, const char *s) {
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        MSG_WriteBits(m, (c > 127 || c == '%') ? '.' : c, 8); // as MSG_WriteString sanitises
+    }
+    MSG_WriteBits(m, 0, 8);
+}
+
+// One configstring the way SV_SendConfigstring sends it: a single "cs", or bcs0/bcs1/bcs2 chunks
+// once it is too long for one command. Returns how many command numbers that took, or -1 if
+// there were not enough of them.
+static int replay_write_configstring(msg_t *m, int index, const char *value, int seq, int last_seq) {
+    char cmd[MAX_STRING_CHARS];
+    const int chunk = MAX_STRING_CHARS - 24;
+    size_t len      = strlen(value);
+
+    if (len < (size_t)chunk) {
+        if (seq > last_seq) {
+            return -1;
+        }
+        snprintf(cmd, sizeof(cmd), "cs %i \"%s\"\n", index, value);
+        MSG_WriteBits(m, SVC_SERVERCOMMAND, 8);
+        MSG_WriteBits(m, seq, 32);
+        replay_write_string(m, cmd);
+        return 1;
+    }
+
+    int pieces = (int)((len + (size_t)(chunk - 1) - 1) / (size_t)(chunk - 1));
+    if (seq + pieces - 1 > last_seq) {
+        return -1;
+    }
+    for (size_t sent = 0; sent < len; sent += (size_t)(chunk - 1), seq++) {
+        const char *kind = sent == 0 ? "bcs0" : (len - sent < (size_t)chunk ? "bcs2" : "bcs1");
+        snprintf(cmd, sizeof(cmd), "%s %i \"%.*s\"\n", kind, index, chunk - 1, value + sent);
+        MSG_WriteBits(m, SVC_SERVERCOMMAND, 8);
+        MSG_WriteBits(m, seq, 32);
+        replay_write_string(m, cmd);
+    }
+    return pieces;
+}
+
+// The prelude for a keyframe going to `client` now, into replay_prelude; 0 when nothing differs.
+// The commands are numbered into the part of the client's command window that the keyframe's own
+// block will not reuse: after the gamestate's number, inside the 64 a player keeps, and no later
+// than the last one the client acknowledged, since every command after that is in the block.
+// Lowest indices first if they do not all fit, which keeps the server and player info.
+static uint32_t replay_build_prelude(const replay_slot_t *r, const client_t *client) {
+    if (!sv) {
+        return 0;
+    }
+    int first = r->command_seq;
+    if (first < client->reliableSequence - MAX_RELIABLE_COMMANDS) {
+        first = client->reliableSequence - MAX_RELIABLE_COMMANDS;
+    }
+    int seq      = first + 1;
+    int last_seq = client->reliableAcknowledge;
+
+    msg_t m   = {0};
+    m.data    = replay_prelude;
+    m.maxsize = (int)sizeof(replay_prelude);
+    MSG_WriteBits(&m, client->lastClientCommand, 32);
+
+    size_t pos = 0;
+    for (int i = 0; i < MAX_CONFIGSTRINGS && seq <= last_seq; i++) {
+        const char *then = "";
+        if (pos < r->cs_len && (r->cs[pos] | (r->cs[pos + 1] << 8)) == i) {
+            then = (const char *)r->cs + pos + 2;
+            pos += 2 + strlen(then) + 1;
+        }
+        const char *now = sv->configstrings[i] ? sv->configstrings[i] : "";
+        if (!strcmp(then, now)) {
+            continue;
+        }
+        // Huffman codes run to about a byte and a half at worst, so keep that much room spare.
+        if (m.cursize + (int)strlen(now) * 2 + 64 > DEMO_REPLAY_PRELUDE_MAX) {
+            break;
+        }
+        int used = replay_write_configstring(&m, i, now, seq, last_seq);
+        if (used < 0) {
+            break;
+        }
+        seq += used;
+    }
+    if (seq == first + 1) {
+        return 0;
+    }
+    MSG_WriteBits(&m, SVC_EOF, 8);
+    return (uint32_t)m.cursize;
+}
+
+static void replay_capture(int slot, const client_t *client, int seconds, int seq, int is_gamestate, int full,
+                           const unsigned char *data, uint32_t len) {
+    replay_slot_t *r = &replay[slot];
+    if (is_gamestate) {
+        replay_on_gamestate(slot, client, data, len, seq);
+        return;
+    }
+    if (!r->gamestate) {
+        return; // no gamestate yet to start from.
+    }
+
+    replay_entry_t e = {seq, svs->time, 0, len, full};
+    if (full) {
+        e.prelude = replay_build_prelude(r, client);
+    }
+    uint32_t need = (uint32_t)sizeof(e) + e.prelude + len;
+    if (need > DEMO_REPLAY_CHUNK) {
+        return;
+    }
+
+    // Whole chunks go once every entry in them is older than a window can reach back to, with a
+    // keyframe's worth of slack so there is one at or before the window's start.
+    int horizon = svs->time - seconds * 1000 - DEMO_REPLAY_KEYFRAME_MS;
+    while (r->oldest && r->oldest != r->newest && r->oldest->newest - horizon < 0) {
+        replay_drop_oldest(r);
+    }
+
+    replay_chunk_t *c = r->newest;
+    if (!c || c->used + need > DEMO_REPLAY_CHUNK) {
+        unsigned cap = (unsigned)((uint64_t)cvar_clamped(sv_demoReplayMB, 16, 1, 256) * 1024 * 1024 / DEMO_REPLAY_CHUNK);
+        while (r->oldest && r->chunks >= cap) {
+            replay_drop_oldest(r);
+        }
+        c            = replay_spare ? replay_spare : malloc(sizeof(*c));
+        replay_spare = NULL;
+        if (!c) {
+            DebugPrint("demo: no memory to hold slot %d's replay\n", slot);
+            replay_release(slot);
+            return;
+        }
+        c->next = NULL;
+        c->used = 0;
+        atomic_init(&c->refs, 1);
+        if (r->newest) {
+            r->newest->next = c;
+        } else {
+            r->oldest = c;
+        }
+        r->newest = c;
+        r->chunks++;
+    }
+
+    unsigned char *out = c->data + c->used;
+    memcpy(out, &e, sizeof(e));
+    memcpy(out + sizeof(e), replay_prelude, e.prelude);
+    memcpy(out + sizeof(e) + e.prelude, data, len);
+    c->used += need;
+    c->newest = svs->time;
+    if (full) {
+        r->last_keyframe = svs->time;
+    }
+}
+
+void Demo_ReplayFrame(void) {
+    if (!demo_replay_seconds() || !svs || !svs->clients) {
         return;
     }
+    for (int slot = 0; slot < MAX_DEMO_CLIENTS; slot++) {
+        replay_slot_t *r = &replay[slot];
+        if (!r->gamestate || svs->time - r->last_keyframe < DEMO_REPLAY_KEYFRAME_MS) {
+            continue;
+        }
+        // Read by SV_WriteSnapshotToClient later this same SV_Frame. A packet from the client
+        // puts their acknowledgement back before the next one, so this costs one snapshot.
+        client_t *client = &svs->clients[slot];
+        if (client->state == CS_ACTIVE) {
+            client->deltaMessage = -1;
+        }
+    }
+}
+
+// demo_build_name goes to the second, and a window only reaches the disk once the writer gets
+// to it, so a second save in the same second would otherwise be given the first one's name and
+// replace it. Names given out lately are remembered by hash; a false match only costs a suffix.
+static void replay_pick_name(char *path, size_t n, int slot) {
+    for (int attempt = 1;; attempt++) {
+        char tag[32] = "_replay";
+        if (attempt > 1) {
+            snprintf(tag, sizeof(tag), "_replay%d", attempt);
+        }
+        demo_build_name(path, n, slot, &svs->clients[slot], tag);
+
+        uLong hash = crc32(0L, (const Bytef *)path, (uInt)strlen(path));
+        int taken  = 0;
+        for (int i = 0; i < DEMO_REPLAY_NAMES && !taken; i++) {
+            taken = replay_names[slot][i] == hash;
+        }
+        char part[512 + 8];
+        demo_part_name(part, sizeof(part), path);
+        if (attempt < 100 && (taken || !access(path, F_OK) || !access(part, F_OK))) {
+            continue;
+        }
+        replay_names[slot][replay_names_next[slot]++ % DEMO_REPLAY_NAMES] = hash;
+        return;
+    }
+}
+
+const char *Demo_SaveWindow(int slot, int seconds) {
+    static char path[512];
+    if (slot < 0 || slot >= MAX_DEMO_CLIENTS || seconds <= 0 || !fs_homepath || !svs || !svs->clients) {
+        return NULL;
+    }
+    replay_slot_t *r = &replay[slot];
+    if (!r->gamestate || !r->newest) {
+        return NULL;
+    }
+    if (seconds > DEMO_REPLAY_MAX_SECONDS) {
+        seconds = DEMO_REPLAY_MAX_SECONDS; // nothing older is kept, and seconds * 1000 stays in range
+    }
+
+    // The last keyframe at or before the start asked for, else the first one held.
+    int start                = svs->time - seconds * 1000;
+    replay_chunk_t *from     = NULL, *earliest = NULL;
+    uint32_t from_off        = 0, earliest_off = 0;
+    for (replay_chunk_t *c = r->oldest; c; c = c->next) {
+        for (uint32_t pos = 0; pos < c->used;) {
+            replay_entry_t e;
+            memcpy(&e, c->data + pos, sizeof(e));
+            if (e.keyframe) {
+                if (!earliest) {
+                    earliest     = c;
+                    earliest_off = pos;
+                }
+                if (e.time - start <= 0) {
+                    from     = c;
+                    from_off = pos;
+                }
+            }
+            pos += (uint32_t)sizeof(e) + e.prelude + e.len;
+        }
+    }
+    if (!from) {
+        from     = earliest;
+        from_off = earliest_off;
+    }
+    if (!from) {
+        return NULL; // not one keyframe yet.
+    }
+
+    replay_entry_t key;
+    memcpy(&key, from->data + from_off, sizeof(key));
+    demo_window_t *w = malloc(sizeof(*w) + r->gamestate_len + key.prelude);
+    if (!w) {
+        DebugPrint("demo: no memory to save slot %d's replay\n", slot);
+        return NULL;
+    }
+    w->first         = from;
+    w->first_off     = from_off;
+    w->last          = r->newest;
+    w->end           = r->newest->used;
+    w->gamestate_seq = r->gamestate_seq;
+    w->gamestate_len = r->gamestate_len;
+    // Numbered just ahead of the keyframe so nothing reading the sequence sees it go back. Later
+    // keyframes' preludes are left out; by then the player has every command they carry.
+    w->prelude_seq = key.seq - 1;
+    w->prelude_len = key.prelude;
+    memcpy(w->data, r->gamestate, r->gamestate_len);
+    memcpy(w->data + r->gamestate_len, from->data + from_off + sizeof(key), key.prelude);
+    for (replay_chunk_t *c = from;; c = c->next) {
+        atomic_fetch_add_explicit(&c->refs, 1, memory_order_relaxed);
+        if (c == w->last) {
+            break;
+        }
+    }
+
     if (!demo_reconcile_thread()) {
+        demo_window_free(w);
+        return NULL;
+    }
+    replay_pick_name(path, sizeof(path), slot);
+
+    // The window, its name and the compression level in one record, so the writer gets all of it
+    // or none of it.
+    unsigned char payload[sizeof(w) + sizeof(path) + 1];
+    size_t plen = strlen(path);
+    memcpy(payload, &w, sizeof(w));
+    memcpy(payload + sizeof(w), path, plen + 1);
+    payload[sizeof(w) + plen + 1] = (unsigned char)demo_compress_level();
+    demo_rec_hdr_t hdr = {DEMO_REC_WINDOW, MAX_DEMO_CLIENTS + slot, 0, (uint32_t)(sizeof(w) + plen + 2)};
+    if (demo_ring_put(&hdr, payload) != 0) {
+        demo_window_free(w);
+        return NULL;
+    }
+    return path;
+}
+
+// Split out of Demo_Capture so the profiler wrapper covers every early return.
+//
+// Each slot's blocks are captured whole even when two clients see the same entities. What we're
+// handed is the Huffman-coded bit stream, delta-compressed against the frame that one client last
+// acknowledged, so shared state comes out as different bits for each client, at different offsets.
+// Storing it once would mean decoding every snapshot here and re-encoding it for each view.
+static void Demo_CaptureBody(msg_t *msg, client_t *client) {
+    if (!sv_demoRecord || !MSG_WriteBits || !svs || !svs->clients || !fs_homepath) {
         return;
     }
     if (msg->cursize <= 0 || msg->cursize > MAX_NETCHAN_MSGLEN) {
@@ -642,6 +1592,28 @@ static void Demo_CaptureBody(msg_t *msg, client_t *client) {
 
     int seq          = client->netchan.outgoingSequence;
     int is_gamestate = (seq == client->gamestateMessageNum);
+    int full         = !is_gamestate && demo_snapshot_is_full(client);
+
+    // Use a scratch buffer, never mutate the live outgoing message. Filled on first use, since
+    // the replay buffer and the recording each may or may not want it.
+    msg_t tmp   = *msg;
+    tmp.data    = demo_scratch;
+    tmp.maxsize = (int)sizeof(demo_scratch);
+    int framed  = 0;
+
+    int seconds = demo_replay_seconds();
+    if (seconds) {
+        memcpy(demo_scratch, msg->data, (size_t)msg->cursize);
+        MSG_WriteBits(&tmp, SVC_EOF, 8); // bit-accurate append.
+        framed = 1;
+        replay_capture((int)slot, client, seconds, seq, is_gamestate, full, demo_scratch, (uint32_t)tmp.cursize);
+    } else if (replay[slot].gamestate) {
+        replay_release((int)slot);
+    }
+
+    if (!demo_reconcile_thread()) {
+        return;
+    }
 
     demo_rec_hdr_t hdr = {0};
     hdr.slot           = (int32_t)slot;
@@ -663,27 +1635,31 @@ static void Demo_CaptureBody(msg_t *msg, client_t *client) {
             demo_ring_put(&hdr, NULL); // OPEN should also finalise the writer-side.
             demo_active[slot] = 0;
         }
-        char path[512];
-        demo_build_name(path, sizeof(path), (int)slot, client);
+        char path[512 + 2];
+        demo_build_name(path, sizeof(path) - 2, (int)slot, client, "");
+        size_t plen = strlen(path);
+        path[plen + 1] = (char)demo_compress_level(); // after the terminator; see DEMO_REC_OPEN
+        path[plen + 2] = (char)(sv_demoIndex && sv_demoIndex->integer);
         hdr.type = DEMO_REC_OPEN;
-        hdr.len  = (uint32_t)strlen(path) + 1;
+        hdr.len  = (uint32_t)plen + 3;
         hdr.seq  = (int32_t)(demo_gen[slot] + 1); // seq is unused for OPEN.
         if (demo_ring_put(&hdr, path) != 0) {
             return; // ring full; retry at this client's next gamestate.
         }
         demo_gen[slot]++;
         demo_active[slot] = 1;
-        snprintf(demo_path[slot], sizeof(demo_path[slot]), "%s", path);
+        memcpy(demo_path[slot], path, plen + 1); // demo_build_name kept it under 512
+        demo_put_mark((int)slot, DEMO_MARK_GAMESTATE, -1, seq, 0, 0);
     } else if (!demo_active[slot]) {
         return; // we have not seen this slot's gamestate yet.
+    } else if (full) {
+        demo_put_mark((int)slot, DEMO_MARK_SNAPSHOT, -1, seq, 0, 0);
     }
 
-    // Use a scratch buffer, never mutate the live outgoing message.
-    msg_t tmp   = *msg;
-    tmp.data    = demo_scratch;
-    tmp.maxsize = (int)sizeof(demo_scratch);
-    memcpy(demo_scratch, msg->data, (size_t)msg->cursize);
-    MSG_WriteBits(&tmp, SVC_EOF, 8); // bit-accurate append.
+    if (!framed) {
+        memcpy(demo_scratch, msg->data, (size_t)msg->cursize);
+        MSG_WriteBits(&tmp, SVC_EOF, 8);
+    }
 
     hdr.type = DEMO_REC_BLOCK;
     hdr.seq  = (int32_t)seq;
@@ -703,11 +1679,19 @@ void Demo_Capture(msg_t *msg, client_t *client) {
     PROF_END(PROF_DEMO_CAPTURE, t_capture);
 }
 
+void Demo_Mark(demo_mark_kind_t kind, int clock, int a, int b, int c) {
+    if (demo_state_cached != DEMO_THREAD_RUNNING || !sv_demoIndex || !sv_demoIndex->integer) {
+        return;
+    }
+    demo_put_mark(-1, kind, clock, a, b, c);
+}
+
 void Demo_ClientDisconnect(int slot) {
     if (slot < 0 || slot >= MAX_DEMO_CLIENTS) {
         return;
     }
     demo_active[slot] = 0;
+    replay_release(slot);
     // Drop the override too: the next player in this slot shouldn't inherit it.
     Demo_Request(slot, 0);
     if (demo_state_cached == DEMO_THREAD_RUNNING) {
@@ -881,3 +1865,23 @@ unsigned Demo_TakeDroppedCount(void) {
     pthread_mutex_unlock(&demo_lock);
     return n;
 }
+
+void Demo_RingFill(uint32_t *used, uint32_t *size) {
+    // Tail first: read the other way round, a writer catching up in between could put it past
+    // the head we already hold.
+    uint64_t tail = atomic_load_explicit(&demo_tail, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&demo_head, memory_order_acquire);
+    *used         = (uint32_t)(head - tail);
+    *size         = DEMO_RING_SIZE;
+}
+
+void Demo_Counters(demo_counters_t *out) {
+    pthread_mutex_lock(&demo_lock);
+    out->segments_finished   = demo_total_finished;
+    out->segments_discarded  = demo_total_discarded;
+    out->segments_failed     = demo_total_failed;
+    out->completions_dropped = demo_total_dropped;
+    pthread_mutex_unlock(&demo_lock);
+    out->bytes_written = atomic_load_explicit(&demo_bytes_written, memory_order_relaxed);
+    Demo_RingFill(&out->ring_used, &out->ring_size);
+}
@@ -27,8 +27,9 @@ typedef struct {
     int slot;
     int discarded;  // held only a gamestate and was removed again; nothing at path
     int failed;     // open/write/rename error; path is the .part left on disk
+    int replay;     // a window saved by Demo_SaveWindow, not the slot's recording
     uint32_t gen;   // demo_gen[slot] at the time the segment was opened
-    long bytes;     // bytes written to the file
+    long bytes;     // bytes written to the file; for a finished gzip segment, its size on disk
     // 512 for the final name, plus room for the ".part" suffix the failure paths report.
     char path[520];
 } demo_finished_t;
@@ -58,4 +59,48 @@ unsigned Demo_PendingFinished(void);
 qboolean Demo_PollFinished(demo_finished_t *out);
 unsigned Demo_TakeDroppedCount(void); // dropped-on-overflow count, then clears it
 
+// Seek index. Under sv_demoIndex, every segment gets a "<path>.idx" beside it: JSON lines, each
+// the offset of the first block at or after something worth jumping to. Offsets are into the demo
+// as expanded, so a .dm_91.gz indexes the same as the plain file. The gamestate and any snapshot
+// sent without a delta are marked by Demo_Capture itself; the rest come in through Demo_Mark.
+typedef enum {
+    DEMO_MARK_GAMESTATE = 0, // a = netchan sequence
+    DEMO_MARK_SNAPSHOT,      // a non-delta snapshot; a = netchan sequence
+    DEMO_MARK_GAME_START,
+    DEMO_MARK_GAME_END,      // a = aborted
+    DEMO_MARK_ROUND_START,   // a = round
+    DEMO_MARK_ROUND_END,     // a = round, b = winning team
+    DEMO_MARK_SCORE,         // a = red, b = blue
+    DEMO_MARK_FRAG,          // a = victim, b = killer or -1, c = means of death
+    DEMO_MARK_COUNT
+} demo_mark_kind_t;
+
+// Marks every segment open right now. clock is milliseconds of level time since the level
+// started, as the in-game clock counts, or -1 when unknown. Game thread only.
+void Demo_Mark(demo_mark_kind_t kind, int clock, int a, int b, int c);
+
+// Instant replay. Under sv_demoReplay, the last that many seconds of every client's stream are
+// kept in memory. Demo_ReplayFrame runs once a frame, ahead of the snapshots, to space out the full
+// snapshots a saved window can start at. Demo_SaveWindow queues the last `seconds` of the slot as
+// a demo of its own and returns the name it will be renamed to, or NULL if there is nothing to
+// save. It reaches back to the nearest full snapshot before that, so a little more may come out.
+// Its completion is reported with replay set. Game thread only.
+void Demo_ReplayFrame(void);
+const char *Demo_SaveWindow(int slot, int seconds);
+
+// Bytes waiting in the ring for the writer thread, out of its capacity. Any thread.
+void Demo_RingFill(uint32_t *used, uint32_t *size);
+
+// Totals since startup, unlike Demo_TakeDroppedCount, which hands its count over once.
+typedef struct {
+    uint64_t bytes_written;        // demo data handed to the file streams, headers included, before any gzip
+    unsigned segments_finished;    // renamed into place
+    unsigned segments_discarded;   // empty, so deleted
+    unsigned segments_failed;      // left as .part
+    unsigned completions_dropped;  // demo_finished events lost to a full queue
+    uint32_t ring_used, ring_size; // as Demo_RingFill
+} demo_counters_t;
+
+void Demo_Counters(demo_counters_t *out); // any thread
+
 #endif /* DEMOS_H */
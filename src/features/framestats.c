@@ -0,0 +1,205 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "framestats.h"
+#include "demos.h"
+#include "profile.h"
+#include "reliable.h"
+#include "engine/quake_common.h"
+
+/* See framestats.h for the layout and how to read it. */
+
+static cvar_t* qlx_frameStats;
+static cvar_t* sv_fps;
+static cvar_t* net_port;
+
+static framestats_page_t* page;
+static int page_failed; // Don't retry shm_open every frame; toggling the cvar does.
+static int page_wants_gil;
+static char page_name[64];
+
+// The recent window, kept here rather than on the page so a reader never sees it half-rolled.
+static uint32_t frame_window[FRAMESTATS_WINDOW];
+static uint32_t gil_window[FRAMESTATS_WINDOW];
+static uint64_t frame_sum, gil_sum;
+static unsigned window_pos, window_fill;
+
+static uint64_t frame_start;
+
+void FrameStats_Init(void) {
+    if (!Cvar_Get) {
+        return;
+    }
+    qlx_frameStats = Cvar_Get("qlx_frameStats", "1", CVAR_ARCHIVE);
+    sv_fps         = Cvar_FindVar("sv_fps");
+    net_port       = Cvar_FindVar("net_port");
+}
+
+static int page_open(void) {
+    snprintf(page_name, sizeof(page_name), "/minqlxtended-%s", (net_port && net_port->string[0]) ? net_port->string : "27960");
+
+    int fd = shm_open(page_name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        DebugPrint("framestats: could not open shared memory %s; qlx_frameStats is off until toggled\n", page_name);
+        return 0;
+    }
+    if (ftruncate(fd, sizeof(framestats_page_t))) {
+        DebugPrint("framestats: could not size %s\n", page_name);
+        close(fd);
+        return 0;
+    }
+    void* p = mmap(NULL, sizeof(framestats_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        DebugPrint("framestats: could not map %s\n", page_name);
+        return 0;
+    }
+
+    // A page left by an earlier run on the same port is taken over, not trusted.
+    page = p;
+    __atomic_store_n(&page->seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memset((char*)page + sizeof(page->magic) + sizeof(page->version) + sizeof(page->seq), 0,
+           sizeof(*page) - sizeof(page->magic) - sizeof(page->version) - sizeof(page->seq));
+    page->magic   = FRAMESTATS_MAGIC;
+    page->version = FRAMESTATS_VERSION;
+    page->pid     = (uint32_t)getpid();
+    __atomic_store_n(&page->seq, 2, __ATOMIC_RELEASE);
+
+    DebugPrint("framestats: publishing to /dev/shm%s\n", page_name);
+    return 1;
+}
+
+static void page_close(void) {
+    munmap(page, sizeof(*page));
+    page           = NULL;
+    page_wants_gil = 0;
+    Profile_TimeGilWait(0);
+}
+
+void FrameStats_FrameStart(void) {
+    if (!qlx_frameStats || !qlx_frameStats->integer) {
+        if (page) {
+            page_close();
+        }
+        page_failed = 0;
+        frame_start = 0;
+        return;
+    }
+    if (!page) {
+        if (page_failed || !page_open()) {
+            page_failed = 1;
+            frame_start = 0;
+            return;
+        }
+    }
+
+    // Keeps PROF_GIL_WAIT timed with qlx_prof off; every other probe stays free.
+    if (!page_wants_gil) {
+        Profile_TimeGilWait(1);
+        page_wants_gil = 1;
+    }
+    frame_start = Profile_Now();
+}
+
+// Pushes one sample into a window, keeping its sum, and returns the window's max.
+static uint32_t window_push(uint32_t* window, uint64_t* sum, uint32_t value) {
+    *sum += value;
+    *sum -= window[window_pos];
+    window[window_pos] = value;
+
+    uint32_t max = 0;
+    for (unsigned i = 0; i < window_fill; i++) {
+        if (window[i] > max) {
+            max = window[i];
+        }
+    }
+    return max;
+}
+
+void FrameStats_FrameEnd(void) {
+    if (!frame_start || !page) {
+        return;
+    }
+
+    uint64_t frame_ns = Profile_Now() - frame_start;
+    uint64_t gil_ns   = Profile_TakeGilWait();
+    uint32_t frame_us = (uint32_t)(frame_ns / 1000);
+    uint32_t gil_us   = (uint32_t)(gil_ns / 1000);
+
+    if (window_fill < FRAMESTATS_WINDOW) {
+        window_fill++;
+    }
+    uint32_t frame_max = window_push(frame_window, &frame_sum, frame_us);
+    uint32_t gil_max   = window_push(gil_window, &gil_sum, gil_us);
+    window_pos         = (window_pos + 1) % FRAMESTATS_WINDOW;
+
+    reliable_status_t rs;
+    Reliable_Status(&rs);
+
+    uint32_t ring_used, ring_size;
+    Demo_RingFill(&ring_used, &ring_size);
+
+    int connected = 0, active = 0, maxclients = sv_maxclients ? sv_maxclients->integer : 0;
+    if (svs && svs->clients) {
+        for (int i = 0; i < maxclients; i++) {
+            connected += svs->clients[i].state != CS_FREE;
+            active += svs->clients[i].state == CS_ACTIVE;
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    // Odd, then the stores, then even. The fences keep a reader from seeing any store outside
+    // the odd window, which is all a seqlock needs.
+    uint32_t seq = page->seq;
+    __atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    page->frames++;
+    page->updated_ms        = (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+    page->sv_fps            = (uint32_t)cvar_clamped(sv_fps, 40, 1, 1000);
+    page->frame_us          = frame_us;
+    page->frame_mean_us     = (uint32_t)(frame_sum / window_fill);
+    page->frame_max_us      = frame_max;
+    page->gil_us            = gil_us;
+    page->gil_mean_us       = (uint32_t)(gil_sum / window_fill);
+    page->gil_max_us        = gil_max;
+    page->reliable_backlog  = rs.backlog;
+    page->reliable_waiting  = rs.waiting;
+    page->reliable_bypassed = rs.bypassed;
+    page->demo_ring_used    = ring_used;
+    page->demo_ring_size    = ring_size;
+    page->clients_connected = connected;
+    page->clients_active    = active;
+    page->maxclients        = maxclients;
+
+    __atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,73 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <stdint.h>
+
+/*
+ * Frame statistics published to a shared-memory page, /dev/shm/minqlxtended-<net_port>, so a
+ * sidecar can scrape every qzeroded on a host by mapping a file: no rcon round trip, and no
+ * Python on either side. On by default through qlx_frameStats. The page is rewritten at the
+ * end of every frame under a seqlock: a reader copies it out between two reads of `seq` and
+ * retries if they differ or are odd.
+ *
+ * The layout below is what readers compile against. Fields are only ever appended; anything
+ * else bumps FRAMESTATS_VERSION. Times are microseconds, "recent" is the last
+ * FRAMESTATS_WINDOW frames.
+ */
+
+#define FRAMESTATS_MAGIC   0x53465851u // "QXFS", little-endian
+#define FRAMESTATS_VERSION 1
+#define FRAMESTATS_WINDOW  256
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;    // Odd while the game thread is writing.
+    uint32_t pid;    // Of the qzeroded writing it; the page outlives the process.
+    uint64_t frames; // Published since the page was created.
+    uint64_t updated_ms; // CLOCK_MONOTONIC at the last publish, so a stale page is obvious.
+
+    uint32_t sv_fps;
+    uint32_t frame_us;      // The last frame, engine included.
+    uint32_t frame_mean_us; // Over the recent window.
+    uint32_t frame_max_us;
+    uint32_t gil_us;        // GIL wait summed over the last frame.
+    uint32_t gil_mean_us;
+    uint32_t gil_max_us;
+
+    int32_t reliable_backlog; // Deepest live per-client backlog, out of 64.
+    int32_t reliable_waiting; // Commands the reliable guard is holding.
+    uint32_t reliable_bypassed;
+
+    uint32_t demo_ring_used; // Bytes waiting for the demo writer.
+    uint32_t demo_ring_size;
+
+    int32_t clients_connected; // Any state past CS_FREE.
+    int32_t clients_active;    // CS_ACTIVE only.
+    int32_t maxclients;
+} framestats_page_t;
+
+void FrameStats_Init(void); // register cvars
+
+// Game thread, bracketing My_G_RunFrame. Cheap when qlx_frameStats is off.
+void FrameStats_FrameStart(void);
+void FrameStats_FrameEnd(void);
+
+#endif /* FRAMESTATS_H */
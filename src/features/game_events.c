@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // First, ahead of any system header: Python.h sets _POSIX_C_SOURCE and _XOPEN_SOURCE.
 #include "python/pyminqlxtended.h"
 
+#include "demos.h"
 #include "game_events.h"
 #include "profile.h"
 #include "engine/quake_common.h"
@@ -54,6 +55,10 @@ static int round_begun_time;
 // serve: despite the name, only Freeze Tag touches it.
 static int last_team_scores[TEAM_NUM_TEAMS];
 
+// Red and blue as last put in the demo index. Kept apart from last_team_scores, which only round
+// gametypes keep current between transitions.
+static int marked_scores[2];
+
 // level->intermissionQueued as of last frame. A match ends when this goes non-zero, and
 // that happens while the level is still standing.
 static int last_intermission_queued;
@@ -106,6 +111,7 @@ void GameEvents_Reset(void) {
     for (int i = 0; i < TEAM_NUM_TEAMS; i++) {
         last_team_scores[i] = 0;
     }
+    marked_scores[0] = marked_scores[1] = 0;
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
         last_team[i]       = TEAM_FREE;
@@ -146,6 +152,11 @@ static int RoundNumber(void) {
     return level->roundState.round;
 }
 
+// What the in-game clock reads, for the demo index.
+static int LevelClock(void) {
+    return level->time - level->startTime;
+}
+
 static void CheckRoundState(void) {
     roundStateState_t current = level->roundState.eCurrent;
 
@@ -170,6 +181,7 @@ static void CheckRoundState(void) {
     if (current == ROUND_BEGUN) {
         round_begun_time = level->time;
         current_round    = RoundNumber();
+        Demo_Mark(DEMO_MARK_ROUND_START, LevelClock(), current_round, 0, 0);
         RoundStartDispatcher(current_round);
         return;
     }
@@ -190,6 +202,7 @@ static void CheckRoundState(void) {
         }
     }
 
+    Demo_Mark(DEMO_MARK_ROUND_END, LevelClock(), current_round, winner, 0);
     RoundEndDispatcher(current_round, winner,
                        round_begun_time ? level->time - round_begun_time : 0);
 
@@ -217,11 +230,13 @@ static void CheckGameState(void) {
     if (now > 0 && was <= 0) {
         GameCountdownDispatcher();
     } else if (now == 0 && was != 0) {
+        Demo_Mark(DEMO_MARK_GAME_START, LevelClock(), 0, 0, 0);
         GameStartDispatcher();
     } else if (now < 0 && was == 0) {
         // In progress and then back to waiting for players, with no intermission queued: a
         // forfeit, or an admin ending it. Never a map change; both My_SV_SpawnServer and
         // My_G_InitGame reset the baseline first, so no frame ever observes that crossing.
+        Demo_Mark(DEMO_MARK_GAME_END, LevelClock(), 1, 0, 0);
         GameEndDispatcher(1);
     }
 }
@@ -235,10 +250,24 @@ static void CheckIntermission(void) {
     if (queued && !was) {
         // One of two paths to game_end, the other being the abandoned match in
         // CheckGameState above. Python's `_game_ended` latches so only one fires per match.
+        Demo_Mark(DEMO_MARK_GAME_END, LevelClock(), level->matchForfeited ? 1 : 0, 0, 0);
         GameEndDispatcher(level->matchForfeited ? 1 : 0);
     }
 }
 
+// Not an event, only a demo index entry. Round gametypes move the team scores at ROUND_OVER, the
+// others on every frag or capture.
+static void CheckScores(void) {
+    int red  = level->teamScores[TEAM_RED];
+    int blue = level->teamScores[TEAM_BLUE];
+    if (red == marked_scores[0] && blue == marked_scores[1]) {
+        return;
+    }
+    marked_scores[0] = red;
+    marked_scores[1] = blue;
+    Demo_Mark(DEMO_MARK_SCORE, LevelClock(), red, blue, 0);
+}
+
 static void CheckVote(void) {
     // The end-of-match map vote borrows voteTime. BeginIntermission (qagame 0x10056d40) calls
     // ClearVote and then sets level.voteTime = level.time, so voteTime goes non-zero with
@@ -370,6 +399,7 @@ void GameEvents_Frame(void) {
     CheckGameState();
     CheckRoundState();
     CheckIntermission();
+    CheckScores();
     CheckVote();
     CheckTeams();
 
@@ -0,0 +1,508 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "metrics.h"
+#include "demos.h"
+#include "profile.h"
+#include "reliable.h"
+#include "workers.h"
+#include "engine/quake_common.h"
+
+/* See metrics.h for what is served and how it stays off the game thread. */
+
+#define METRICS_PUBLISH_MS   1000
+#define METRICS_RETRY_MS     1000 // the first retry after a failed start; doubles from there
+#define METRICS_RETRY_MAX_MS 60000
+
+static cvar_t* qlx_metricsSocket;
+
+// Same order as metric_id_t.
+static const char* const metric_names[METRIC_COUNT] = {
+    "next_frame_dropped",
+    "permission_cache_hits",
+    "permission_cache_misses",
+};
+
+_Static_assert(sizeof(metric_names) / sizeof(*metric_names) == METRIC_COUNT,
+               "metric_names must stay in step with metric_id_t");
+
+static _Atomic uint64_t metric_values[METRIC_COUNT];
+
+// Everything the exporter formats, copied in by the game thread under a seqlock.
+typedef struct {
+    uint64_t published_ms; // CLOCK_MONOTONIC
+    profile_status_t prof;
+    reliable_status_t rel;
+    demo_counters_t demo;
+    int clients_connected;
+    int clients_active;
+    int maxclients;
+} metrics_snapshot_t;
+
+static metrics_snapshot_t snapshot;
+static _Atomic uint32_t snapshot_seq;
+static metrics_snapshot_t staging; // Filled outside the odd window. Game thread only.
+
+// One listening socket and the thread serving it. Once handed to the thread, the thread owns it:
+// the game thread only sets stop and shuts the socket down, and the thread closes and frees.
+typedef struct {
+    int fd;
+    _Atomic int stop;
+    dev_t dev; // the socket file as bound, so metrics_stop removes only our own
+    ino_t ino;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+} metrics_server_t;
+
+// Game thread only.
+static metrics_server_t* metrics_server; // NULL while not serving
+static int metrics_cvar_mod = -1;        // qlx_metricsSocket's modificationCount as last acted on
+static uint64_t metrics_last_ms;
+static uint64_t metrics_retry_at_ms;
+static uint64_t metrics_retry_ms = METRICS_RETRY_MS;
+
+void Metrics_Init(void) {
+    if (!Cvar_Get) {
+        return;
+    }
+    qlx_metricsSocket = Cvar_Get("qlx_metricsSocket", "", CVAR_ARCHIVE);
+}
+
+int Metrics_Lookup(const char* name) {
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (!strcmp(name, metric_names[i])) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void Metrics_Add(metric_id_t id, uint64_t delta) {
+    if (id < METRIC_COUNT) {
+        atomic_fetch_add_explicit(&metric_values[id], delta, memory_order_relaxed);
+    }
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+static void snapshot_read(metrics_snapshot_t* out) {
+    for (;;) {
+        uint32_t before = atomic_load_explicit(&snapshot_seq, memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(out, &snapshot, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&snapshot_seq, memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+static void print_seconds(FILE* f, uint64_t ns) {
+    fprintf(f, "%llu.%09llu", (unsigned long long)(ns / 1000000000ull), (unsigned long long)(ns % 1000000000ull));
+}
+
+static void metrics_format(FILE* f, const metrics_snapshot_t* s) {
+    const profile_status_t* p = &s->prof;
+
+    fprintf(f, "# TYPE qlx_snapshot_age_seconds gauge\n"
+               "# HELP qlx_snapshot_age_seconds How old the figures below are; the game thread publishes once a second.\n");
+    uint64_t age_ms = monotonic_ms() - s->published_ms;
+    fprintf(f, "qlx_snapshot_age_seconds %llu.%03llu\n", (unsigned long long)(age_ms / 1000), (unsigned long long)(age_ms % 1000));
+
+    fprintf(f, "# TYPE qlx_profiler_enabled gauge\nqlx_profiler_enabled %d\n", p->enabled);
+    fprintf(f, "# TYPE qlx_profiler_sampled_seconds gauge\nqlx_profiler_sampled_seconds ");
+    print_seconds(f, p->elapsed_ns);
+    fprintf(f, "\n");
+
+    static const struct {
+        const char* label;
+        size_t offset;
+    } quantiles[] = {
+        {"0.5", offsetof(profile_probe_t, p50_ns)},
+        {"0.9", offsetof(profile_probe_t, p90_ns)},
+        {"0.99", offsetof(profile_probe_t, p99_ns)},
+        {"0.999", offsetof(profile_probe_t, p999_ns)},
+    };
+    fprintf(f, "# TYPE qlx_probe_latency_seconds summary\n"
+               "# HELP qlx_probe_latency_seconds qlx_prof probe latency since the profiler was last reset.\n");
+    for (int i = 0; i < PROF_COUNT; i++) {
+        const profile_probe_t* probe = &p->probes[i];
+        if (!probe->count) {
+            continue;
+        }
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(*quantiles); q++) {
+            fprintf(f, "qlx_probe_latency_seconds{probe=\"%s\",quantile=\"%s\"} ", probe->name, quantiles[q].label);
+            print_seconds(f, *(const uint64_t*)((const char*)probe + quantiles[q].offset));
+            fprintf(f, "\n");
+        }
+        fprintf(f, "qlx_probe_latency_seconds_sum{probe=\"%s\"} ", probe->name);
+        print_seconds(f, probe->total_ns);
+        fprintf(f, "\nqlx_probe_latency_seconds_count{probe=\"%s\"} %llu\n", probe->name, (unsigned long long)probe->count);
+    }
+    fprintf(f, "# TYPE qlx_probe_latency_max_seconds gauge\n");
+    for (int i = 0; i < PROF_COUNT; i++) {
+        const profile_probe_t* probe = &p->probes[i];
+        if (probe->count) {
+            fprintf(f, "qlx_probe_latency_max_seconds{probe=\"%s\"} ", probe->name);
+            print_seconds(f, probe->max_ns);
+            fprintf(f, "\n");
+        }
+    }
+
+    // Per map: Reliable_Reset clears these on every map change, which a scraper reads as a
+    // counter reset.
+    const reliable_status_t* r = &s->rel;
+    fprintf(f, "# TYPE qlx_reliable_guard_enabled gauge\nqlx_reliable_guard_enabled %d\n", r->enabled);
+    fprintf(f, "# TYPE qlx_reliable_watermark gauge\nqlx_reliable_watermark %d\n", r->watermark);
+    fprintf(f, "# TYPE qlx_reliable_burst gauge\nqlx_reliable_burst %d\n", r->burst);
+    fprintf(f, "# TYPE qlx_reliable_waiting gauge\nqlx_reliable_waiting %d\n", r->waiting);
+    fprintf(f, "# TYPE qlx_reliable_queued counter\nqlx_reliable_queued_total %u\n", r->queued);
+    fprintf(f, "# TYPE qlx_reliable_merged counter\nqlx_reliable_merged_total %u\n", r->merged);
+    fprintf(f, "# TYPE qlx_reliable_bypassed counter\nqlx_reliable_bypassed_total %u\n", r->bypassed);
+    fprintf(f, "# TYPE qlx_reliable_coalesced counter\nqlx_reliable_coalesced_total %u\n", r->coalesced);
+    fprintf(f, "# TYPE qlx_reliable_shed counter\nqlx_reliable_shed_total %u\n", r->shed);
+    fprintf(f, "# TYPE qlx_reliable_configstrings_waiting gauge\nqlx_reliable_configstrings_waiting %d\n",
+            r->cs_waiting);
+    fprintf(f, "# TYPE qlx_reliable_configstrings_collapsed counter\nqlx_reliable_configstrings_collapsed_total %u\n",
+            r->cs_collapsed);
+    fprintf(f, "# TYPE qlx_reliable_backlog gauge\nqlx_reliable_backlog %d\n", r->backlog);
+    fprintf(f, "# TYPE qlx_reliable_worst_backlog gauge\nqlx_reliable_worst_backlog %d\n", r->worst_backlog);
+
+    const demo_counters_t* d = &s->demo;
+    fprintf(f, "# TYPE qlx_demo_written_bytes counter\nqlx_demo_written_bytes_total %llu\n",
+            (unsigned long long)d->bytes_written);
+    fprintf(f, "# TYPE qlx_demo_segments counter\n"
+               "qlx_demo_segments_total{result=\"finished\"} %u\n"
+               "qlx_demo_segments_total{result=\"discarded\"} %u\n"
+               "qlx_demo_segments_total{result=\"failed\"} %u\n",
+            d->segments_finished, d->segments_discarded, d->segments_failed);
+    fprintf(f, "# TYPE qlx_demo_completions_dropped counter\nqlx_demo_completions_dropped_total %u\n",
+            d->completions_dropped);
+    fprintf(f, "# TYPE qlx_demo_ring_used_bytes gauge\nqlx_demo_ring_used_bytes %u\n", d->ring_used);
+    fprintf(f, "# TYPE qlx_demo_ring_size_bytes gauge\nqlx_demo_ring_size_bytes %u\n", d->ring_size);
+
+    fprintf(f, "# TYPE qlx_clients gauge\n"
+               "qlx_clients{state=\"connected\"} %d\n"
+               "qlx_clients{state=\"active\"} %d\n",
+            s->clients_connected, s->clients_active);
+    fprintf(f, "# TYPE qlx_maxclients gauge\nqlx_maxclients %d\n", s->maxclients);
+
+    // Not in the snapshot: these are atomics Python bumps, so reading them blocks nobody.
+    fprintf(f, "# TYPE qlx_next_frame_tasks_dropped counter\nqlx_next_frame_tasks_dropped_total %llu\n",
+            (unsigned long long)atomic_load(&metric_values[METRIC_NEXT_FRAME_DROPPED]));
+    fprintf(f, "# TYPE qlx_permission_cache_lookups counter\n"
+               "qlx_permission_cache_lookups_total{result=\"hit\"} %llu\n"
+               "qlx_permission_cache_lookups_total{result=\"miss\"} %llu\n",
+            (unsigned long long)atomic_load(&metric_values[METRIC_PERMISSION_CACHE_HITS]),
+            (unsigned long long)atomic_load(&metric_values[METRIC_PERMISSION_CACHE_MISSES]));
+
+    fprintf(f, "# EOF\n");
+}
+
+static int send_all(int fd, const char* data, size_t len) {
+    while (len) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+
+    return 1;
+}
+
+static void metrics_serve(int fd) {
+    // A scraper that connects and says nothing can't hold the exporter up for long.
+    struct timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Whatever was asked for, the answer is the same, so the request is read only to be
+    // rid of it before the close.
+    char request[1024];
+    (void)recv(fd, request, sizeof(request), 0);
+
+    static metrics_snapshot_t s; // Only ever this thread's.
+    snapshot_read(&s);
+    if (!s.published_ms) {
+        // Every figure would read zero, which a scraper would store as a real sample.
+        static const char unavailable[] = "HTTP/1.0 503 Service Unavailable\r\n"
+                                          "Content-Length: 0\r\n"
+                                          "Connection: close\r\n\r\n";
+        send_all(fd, unavailable, sizeof(unavailable) - 1);
+        return;
+    }
+
+    char* body      = NULL;
+    size_t body_len = 0;
+    FILE* f         = open_memstream(&body, &body_len);
+    if (!f) {
+        return;
+    }
+    metrics_format(f, &s);
+    if (fclose(f)) {
+        free(body);
+        return;
+    }
+
+    char header[256];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.0 200 OK\r\n"
+                     "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n",
+                     body_len);
+    if (send_all(fd, header, (size_t)n)) {
+        send_all(fd, body, body_len);
+    }
+    free(body);
+}
+
+static void* metrics_main(void* arg) {
+    metrics_server_t* server = arg;
+
+    for (;;) {
+        int fd = accept4(server->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (atomic_load_explicit(&server->stop, memory_order_acquire)) {
+                break; // metrics_stop shut the socket down under us.
+            }
+            if (errno != EINTR && errno != ECONNABORTED) {
+                DebugPrint("metrics: accept failed (%s)\n", strerror(errno));
+                sleep(1);
+            }
+            continue;
+        }
+        metrics_serve(fd);
+        close(fd);
+    }
+
+    close(server->fd);
+    free(server);
+    return NULL;
+}
+
+// A socket file left by an earlier run would fail the bind, so one nothing answers on is removed.
+// Anything else at the path is left alone: a mistyped qlx_metricsSocket could name a real file,
+// and a live socket belongs to another server sharing the path.
+static int metrics_clear_stale(const char* path, const struct sockaddr_un* addr) {
+    struct stat st;
+    if (lstat(path, &st)) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        DebugPrint("metrics: %s exists and is not a socket; not replacing it\n", path);
+        return 0;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        DebugPrint("metrics: could not create a socket (%s)\n", strerror(errno));
+        return 0;
+    }
+    int live = !connect(probe, (const struct sockaddr*)addr, sizeof(*addr));
+    int err  = errno;
+    close(probe);
+    if (live || err != ECONNREFUSED) {
+        DebugPrint("metrics: %s is in use by another process; not replacing it\n", path);
+        return 0;
+    }
+    if (unlink(path) && errno != ENOENT) {
+        DebugPrint("metrics: could not remove the stale socket %s (%s)\n", path, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+// Only while the file at the path is still the one we bound; another server may have taken the
+// path over since.
+static void metrics_unlink_own(const metrics_server_t* server) {
+    struct stat st;
+    if (!lstat(server->path, &st) && st.st_dev == server->dev && st.st_ino == server->ino) {
+        unlink(server->path);
+    }
+}
+
+static int metrics_start(void) {
+    metrics_server_t* server = calloc(1, sizeof(*server));
+    if (!server) {
+        return 0;
+    }
+
+    const char* want = qlx_metricsSocket->string;
+    int n;
+    if (want[0] == '/') {
+        n = snprintf(server->path, sizeof(server->path), "%s", want);
+    } else {
+        cvar_t* homepath = Cvar_FindVar("fs_homepath");
+        if (!homepath || !homepath->string[0]) {
+            DebugPrint("metrics: qlx_metricsSocket is relative and fs_homepath is not set\n");
+            free(server);
+            return 0;
+        }
+        n = snprintf(server->path, sizeof(server->path), "%s/%s", homepath->string, want);
+    }
+    if (n < 0 || (size_t)n >= sizeof(server->path)) {
+        DebugPrint("metrics: socket path is over the %zu bytes a Unix socket allows\n", sizeof(server->path) - 1);
+        free(server);
+        return 0;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    memcpy(addr.sun_path, server->path, (size_t)n + 1);
+
+    server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server->fd < 0) {
+        DebugPrint("metrics: could not create a socket (%s)\n", strerror(errno));
+        free(server);
+        return 0;
+    }
+    if (!metrics_clear_stale(server->path, &addr)) {
+        close(server->fd);
+        free(server);
+        return 0;
+    }
+    struct stat st;
+    if (bind(server->fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(server->fd, 8) || lstat(server->path, &st)) {
+        DebugPrint("metrics: could not listen on %s (%s)\n", server->path, strerror(errno));
+        close(server->fd);
+        free(server);
+        return 0;
+    }
+    server->dev = st.st_dev;
+    server->ino = st.st_ino;
+
+    if (Worker_Start("qlx metrics", WORKER_SERVING, metrics_main, server)) {
+        DebugPrint("metrics: could not start the exporter thread\n");
+        close(server->fd);
+        metrics_unlink_own(server);
+        free(server);
+        return 0;
+    }
+    DebugPrint("metrics: serving OpenMetrics on %s\n", server->path);
+    metrics_server = server;
+    return 1;
+}
+
+// A shutdown wakes the thread out of accept, and it finishes a scrape in progress first.
+static void metrics_stop(void) {
+    if (!metrics_server) {
+        return;
+    }
+    metrics_unlink_own(metrics_server);
+    atomic_store_explicit(&metrics_server->stop, 1, memory_order_release);
+    shutdown(metrics_server->fd, SHUT_RDWR);
+    metrics_server = NULL;
+}
+
+static void metrics_publish(uint64_t now) {
+    metrics_last_ms = now;
+
+    // The percentiles cost a walk of every histogram, which is why this is once a second.
+    staging.published_ms = now;
+    Profile_Status(&staging.prof);
+    Reliable_Status(&staging.rel);
+    Demo_Counters(&staging.demo);
+
+    staging.clients_connected = staging.clients_active = 0;
+    staging.maxclients = sv_maxclients ? sv_maxclients->integer : 0;
+    if (svs && svs->clients) {
+        for (int i = 0; i < staging.maxclients; i++) {
+            staging.clients_connected += svs->clients[i].state != CS_FREE;
+            staging.clients_active += svs->clients[i].state == CS_ACTIVE;
+        }
+    }
+
+    uint32_t seq = atomic_load_explicit(&snapshot_seq, memory_order_relaxed);
+    atomic_store_explicit(&snapshot_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&snapshot, &staging, sizeof(snapshot));
+    atomic_store_explicit(&snapshot_seq, seq + 2, memory_order_release);
+}
+
+void Metrics_Frame(void) {
+    if (!qlx_metricsSocket) {
+        return;
+    }
+
+    // A new path, or none, takes down what was serving and starts over without waiting out a
+    // backoff meant for the old one.
+    if (qlx_metricsSocket->modificationCount != metrics_cvar_mod) {
+        metrics_cvar_mod = qlx_metricsSocket->modificationCount;
+        metrics_stop();
+        metrics_retry_at_ms = 0;
+        metrics_retry_ms    = METRICS_RETRY_MS;
+    }
+    if (!qlx_metricsSocket->string[0]) {
+        return;
+    }
+
+    uint64_t now = monotonic_ms();
+    if (!metrics_server) {
+        if (now < metrics_retry_at_ms) {
+            return;
+        }
+        // Published before anything can connect, so no scrape finds the snapshot empty.
+        metrics_publish(now);
+        if (!metrics_start()) {
+            // Usually the directory is not there yet, or another process holds the path.
+            DebugPrint("metrics: trying again in %llu s\n", (unsigned long long)(metrics_retry_ms / 1000));
+            metrics_retry_at_ms = now + metrics_retry_ms;
+            metrics_retry_ms *= 2;
+            if (metrics_retry_ms > METRICS_RETRY_MAX_MS) {
+                metrics_retry_ms = METRICS_RETRY_MAX_MS;
+            }
+            return;
+        }
+        metrics_retry_ms = METRICS_RETRY_MS;
+        return;
+    }
+
+    if (now - metrics_last_ms >= METRICS_PUBLISH_MS) {
+        metrics_publish(now);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+/*
+ * OpenMetrics text over a Unix domain socket, for Prometheus through a socket-capable scraper or
+ * `curl --unix-socket <path> http://localhost/metrics`. Off unless qlx_metricsSocket names a
+ * path; a relative one is taken from fs_homepath. The socket is served by its own thread, which
+ * answers every connection with an HTTP/1.0 response and never touches the game thread's state:
+ * once a second Metrics_Frame copies what it exposes into a seqlocked snapshot, and the thread
+ * formats from that copy. A scrape therefore never takes the GIL or holds up a frame, and the
+ * figures are up to a second old. Until the first copy is made a scrape gets a 503.
+ *
+ * Something already at the path is replaced only if it is a socket nothing answers on, and on the
+ * way out the socket file is removed only if it is still ours.
+ *
+ * A socket that cannot be set up is tried again, a second later and then backing off to a minute.
+ * Changing qlx_metricsSocket moves the exporter to the new path at the next frame, and clearing
+ * it stops the exporter.
+ */
+
+// Counters Python bumps through the metric_add() native. Any thread holding the GIL.
+typedef enum {
+    METRIC_NEXT_FRAME_DROPPED = 0,
+    METRIC_PERMISSION_CACHE_HITS,
+    METRIC_PERMISSION_CACHE_MISSES,
+    METRIC_COUNT
+} metric_id_t;
+
+void Metrics_Init(void);  // register cvars
+void Metrics_Frame(void); // game thread, once per frame
+
+// The metric_id_t with that name, or -1.
+int Metrics_Lookup(const char* name);
+void Metrics_Add(metric_id_t id, uint64_t delta);
+
+#endif /* METRICS_H */
@@ -19,20 +19,55 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define _GNU_SOURCE
 #endif
 
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 
 #include "common.h"
 #include "profile.h"
+#include "workers.h"
 #include "engine/quake_common.h"
 
-int prof_enabled = 0;
+int prof_enabled   = 0;
+int prof_gil_timed = 0;
+static uint64_t prof_gil_pending; // Profile_TakeGilWait.
+
+// Log-linear histogram, as HdrHistogram lays it out: below 16ns one bucket per nanosecond,
+// then every power of two split into 16 equal buckets, so a bucket is never wider than 1/16th
+// of what it holds. Anything past 2^36ns (68s) lands in the last bucket.
+#define PROF_SUB_BITS    4
+#define PROF_SUB_COUNT   (1 << PROF_SUB_BITS)
+#define PROF_TOP_BIT     35
+#define PROF_BUCKETS     ((PROF_TOP_BIT - PROF_SUB_BITS + 2) * PROF_SUB_COUNT)
+
+// Hardware counters, in the order prof_pmc_events lists them.
+typedef enum {
+    PROF_PMC_INSTRUCTIONS = 0,
+    PROF_PMC_CYCLES,
+    PROF_PMC_CACHE_MISSES,
+    PROF_PMC_BRANCH_MISSES,
+    PROF_PMC_COUNT
+} prof_pmc_t;
 
 typedef struct {
     uint64_t count;
     uint64_t total_ns;
     uint64_t max_ns;
+    uint32_t hist[PROF_BUCKETS];
+    uint64_t pmc_count; // Samples taken with the counters on, which pmc[] is the sum over.
+    uint64_t pmc[PROF_PMC_COUNT];
 } prof_slot_t;
 
 static prof_slot_t prof_slots[PROF_COUNT];
@@ -41,6 +76,35 @@ static prof_slot_t prof_slots[PROF_COUNT];
 static uint64_t prof_since_ns;
 static uint64_t prof_elapsed_ns;
 
+// The trace ring. Events land when their probe ends, so a child always precedes its parent;
+// nesting depth is worked out from containment when the ring is written, which an early
+// return between PROF_BEGIN and PROF_END can't throw off the way a running counter would.
+#define PROF_TRACE_EVENTS      (1 << 17) // 2 MB, minutes of a busy server at sv_fps 125.
+#define PROF_TRACE_MAX_SECONDS 300
+#define PROF_TRACE_MAX_DEPTH   32
+
+typedef struct {
+    uint64_t start_ns;
+    uint32_t dur_ns;
+    uint16_t id;
+    uint16_t depth; // Only filled in by the trace writer.
+} prof_trace_event_t;
+
+typedef struct {
+    prof_trace_event_t* events;
+    uint32_t count;
+    uint32_t dropped;
+    uint64_t start_ns;
+    char path[512];
+} prof_trace_job_t;
+
+static prof_trace_event_t prof_trace[PROF_TRACE_EVENTS];
+static uint32_t prof_trace_next;     // Events recorded this trace, including any overwritten.
+static uint64_t prof_trace_start_ns;
+static uint64_t prof_trace_until_ns; // 0 when not tracing.
+static int prof_trace_owns_enable;   // The trace turned the profiler on, so it turns it off.
+static char prof_trace_path[512];
+
 // Same order as prof_id_t.
 static const char* const prof_names[PROF_COUNT] = {
     "frame (incl. engine)",
@@ -89,12 +153,377 @@ static const char* const prof_names[PROF_COUNT] = {
 _Static_assert(sizeof(prof_names) / sizeof(*prof_names) == PROF_COUNT,
                "prof_names must stay in step with prof_id_t");
 
-uint64_t Profile_Now(void) {
+static unsigned prof_bucket(uint64_t ns) {
+    if (ns < PROF_SUB_COUNT) {
+        return (unsigned)ns;
+    }
+
+    unsigned msb = 63 - (unsigned)__builtin_clzll(ns);
+    if (msb > PROF_TOP_BIT) {
+        return PROF_BUCKETS - 1;
+    }
+
+    unsigned shift = msb - PROF_SUB_BITS;
+    return (shift + 1) * PROF_SUB_COUNT + (unsigned)((ns >> shift) - PROF_SUB_COUNT);
+}
+
+// The largest value that maps to the bucket.
+static uint64_t prof_bucket_top(unsigned bucket) {
+    if (bucket < PROF_SUB_COUNT) {
+        return bucket;
+    }
+
+    unsigned shift = bucket / PROF_SUB_COUNT - 1;
+    uint64_t sub   = bucket % PROF_SUB_COUNT + PROF_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+// The value below which per_10000/10000ths of the samples fell.
+static uint64_t prof_percentile(const prof_slot_t* slot, unsigned per_10000) {
+    if (!slot->count) {
+        return 0;
+    }
+
+    // Rank of the sample we want, rounded up, so p99.9 of 100 samples is the worst one.
+    uint64_t rank = (slot->count * per_10000 + 9999) / 10000;
+    if (!rank) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < PROF_BUCKETS; i++) {
+        seen += slot->hist[i];
+        if (seen >= rank) {
+            uint64_t top = prof_bucket_top(i);
+            return top < slot->max_ns ? top : slot->max_ns;
+        }
+    }
+
+    // Only if a bucket's 32-bit count wrapped.
+    return slot->max_ns;
+}
+
+// The probe clock. rdtsc costs a couple of dozen cycles where clock_gettime costs several times
+// that even through the vDSO, and the vDSO is skipped outright on a VM whose clocksource isn't
+// the TSC. It's only used when CPUID says the TSC is invariant, i.e. ticks at a constant rate
+// across P-states and C-states and is kept in step across cores, so a game thread migrated
+// between cores reads one clock. Calibration happens against CLOCK_MONOTONIC over the first
+// PROF_CAL_NS of use, with clock_gettime answering until then. No stall, and the switch
+// re-anchors both clocks at the same instant so a probe spanning it is off by one reading's
+// jitter at most.
+#define PROF_CAL_NS      50000000ull   // 50ms of ticks against the kernel clock: ~2ppm.
+#define PROF_TSC_MIN_KHZ 100000ull     // Anything slower than 100MHz is a bad measurement.
+
+typedef enum {
+    PROF_CLOCK_UNCHECKED = 0,
+    PROF_CLOCK_CALIBRATING,
+    PROF_CLOCK_TSC,
+    PROF_CLOCK_MONOTONIC, // Final: no invariant TSC, or calibration came out implausible.
+} prof_clock_t;
+
+#if defined(__x86_64__)
+static prof_clock_t prof_clock;
+#else
+static prof_clock_t prof_clock = PROF_CLOCK_MONOTONIC; // Nothing to check.
+#endif
+static uint64_t prof_tsc_base;
+static uint64_t prof_ns_base;
+static uint64_t prof_tsc_mult; // Nanoseconds per tick, as 32.32 fixed point.
+
+static uint64_t prof_monotonic_ns(void) {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 }
 
+#if defined(__x86_64__)
+// CPUID.80000007H:EDX[8], the invariant TSC flag.
+static int prof_tsc_invariant(void) {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+        return 0;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx >> 8) & 1;
+}
+
+// The slow path: deciding on a clock, and calibrating the TSC if that's the one.
+static uint64_t prof_clock_settle(void) {
+    uint64_t ns = prof_monotonic_ns();
+
+    if (prof_clock == PROF_CLOCK_UNCHECKED) {
+        if (!prof_tsc_invariant()) {
+            prof_clock = PROF_CLOCK_MONOTONIC;
+            return ns;
+        }
+        prof_tsc_base = __rdtsc();
+        prof_ns_base  = ns;
+        prof_clock    = PROF_CLOCK_CALIBRATING;
+        return ns;
+    }
+
+    if (ns - prof_ns_base < PROF_CAL_NS) {
+        return ns;
+    }
+
+    uint64_t tsc   = __rdtsc();
+    uint64_t ticks = tsc - prof_tsc_base;
+    // 128-bit, as below: a calibration left waiting while the profiler was off can span hours.
+    uint64_t khz = (uint64_t)((unsigned __int128)ticks * 1000000ull / (ns - prof_ns_base));
+    if (khz < PROF_TSC_MIN_KHZ) {
+        prof_clock = PROF_CLOCK_MONOTONIC;
+        return ns;
+    }
+
+    prof_tsc_mult = (uint64_t)((((unsigned __int128)(ns - prof_ns_base)) << 32) / ticks);
+    prof_tsc_base = tsc;
+    prof_ns_base  = ns;
+    prof_clock    = PROF_CLOCK_TSC;
+    return ns;
+}
+#endif
+
+// Nanoseconds on an arbitrary base. Game thread only, as the calibration state is unguarded.
+uint64_t Profile_Now(void) {
+#if defined(__x86_64__)
+    if (prof_clock == PROF_CLOCK_TSC) {
+        uint64_t ticks = __rdtsc() - prof_tsc_base;
+        return prof_ns_base + (uint64_t)(((unsigned __int128)ticks * prof_tsc_mult) >> 32);
+    }
+    if (prof_clock != PROF_CLOCK_MONOTONIC) {
+        return prof_clock_settle();
+    }
+#endif
+    return prof_monotonic_ns();
+}
+
+// Hardware counters, "qlx_prof counters". Wall time can't say whether a probe is slow because
+// it stalls on memory or because it simply runs too many instructions; these can. The events
+// are opened as one group on the game thread, user mode only, which is all a
+// perf_event_paranoid of 2 (the usual default) allows. Where the kernel lets userspace read the
+// PMCs directly the group is read with rdpmc, costing about as much as the probe's own clock
+// reads; otherwise with one read() per mark, which is a syscall each side of every probe and
+// inflates what it measures, so the report says which.
+//
+// PROF_BEGIN only hands back a timestamp, so the readings taken at the start of a probe are
+// filed in a small ring under that timestamp and looked up again at its end. An early return
+// between the two leaves a mark behind that is simply overwritten later.
+#define PROF_MARKS 64 // Deeper than any nesting of probes.
+
+static const struct {
+    const char* name;
+    uint64_t config;
+} prof_pmc_events[PROF_PMC_COUNT] = {
+    {"instructions", PERF_COUNT_HW_INSTRUCTIONS},
+    {"cycles", PERF_COUNT_HW_CPU_CYCLES},
+    {"cache misses", PERF_COUNT_HW_CACHE_MISSES},
+    {"branch misses", PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t value[PROF_PMC_COUNT];
+} prof_mark_t;
+
+static int prof_counting;
+static int prof_pmc_fd[PROF_PMC_COUNT] = {-1, -1, -1, -1};
+static int prof_pmc_leader = -1;
+static int prof_pmc_slot[PROF_PMC_COUNT]; // Where each event sits in a group read, -1 if unopened.
+static int prof_pmc_opened;
+static struct perf_event_mmap_page* prof_pmc_page[PROF_PMC_COUNT];
+static int prof_pmc_rdpmc; // Every opened event offered rdpmc when the group was set up.
+static prof_mark_t prof_marks[PROF_MARKS];
+static unsigned prof_mark_next;
+
+static int prof_perf_event_open(struct perf_event_attr* attr, int group) {
+    // pid 0 and cpu -1: this thread, wherever it runs. Which is why the group has to be
+    // opened from the game thread.
+    return (int)syscall(SYS_perf_event_open, attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+// Fills in every opened event. The group read is the fallback, and the answer whenever the
+// kernel has the group descheduled, where rdpmc has nothing to read.
+static void prof_pmc_read(uint64_t* out) {
+#if defined(__x86_64__)
+    if (prof_pmc_rdpmc) {
+        int ok = 1;
+        for (int i = 0; i < PROF_PMC_COUNT && ok; i++) {
+            struct perf_event_mmap_page* pc = prof_pmc_page[i];
+            if (!pc) {
+                out[i] = 0; // Unopened, as the group read below leaves it.
+                continue;
+            }
+            uint32_t seq;
+            do {
+                seq = pc->lock;
+                __asm__ volatile("" ::: "memory");
+                uint32_t idx = pc->index;
+                if (!pc->cap_user_rdpmc || !idx) {
+                    ok = 0;
+                    break;
+                }
+                // The counter is pmc_width bits wide; sign-extend it before adding the offset.
+                int64_t pmc = (int64_t)__rdpmc((int)(idx - 1));
+                unsigned shift = 64 - pc->pmc_width;
+                out[i] = (uint64_t)(pc->offset + ((pmc << shift) >> shift));
+                __asm__ volatile("" ::: "memory");
+            } while (pc->lock != seq);
+        }
+        if (ok) {
+            return;
+        }
+    }
+#endif
+
+    uint64_t buf[1 + PROF_PMC_COUNT];
+    if (read(prof_pmc_fd[prof_pmc_leader], buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t)) {
+        memset(out, 0, PROF_PMC_COUNT * sizeof(*out));
+        return;
+    }
+    for (int i = 0; i < PROF_PMC_COUNT; i++) {
+        out[i] = prof_pmc_slot[i] >= 0 && (uint64_t)prof_pmc_slot[i] < buf[0] ? buf[1 + prof_pmc_slot[i]] : 0;
+    }
+}
+
+static void prof_pmc_close(void) {
+    prof_counting = 0;
+    for (int i = 0; i < PROF_PMC_COUNT; i++) {
+        if (prof_pmc_page[i]) {
+            munmap(prof_pmc_page[i], (size_t)sysconf(_SC_PAGESIZE));
+            prof_pmc_page[i] = NULL;
+        }
+        if (prof_pmc_fd[i] >= 0) {
+            close(prof_pmc_fd[i]);
+            prof_pmc_fd[i] = -1;
+        }
+        prof_pmc_slot[i] = -1;
+    }
+    prof_pmc_leader = -1;
+    prof_pmc_opened = 0;
+    prof_pmc_rdpmc  = 0;
+}
+
+static int prof_paranoid(void) {
+    int level = -100;
+    FILE* f   = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+    if (f) {
+        if (fscanf(f, "%d", &level) != 1) {
+            level = -100;
+        }
+        fclose(f);
+    }
+    return level;
+}
+
+void Profile_SetCounters(int on) {
+    if (!on) {
+        if (prof_pmc_opened) {
+            prof_pmc_close();
+            ENGINE_PRINTF("Hardware counters off.\n");
+        }
+        return;
+    }
+    if (prof_pmc_opened) {
+        ENGINE_PRINTF("Hardware counters are already on.\n");
+        return;
+    }
+
+    int err = 0;
+    for (int i = 0; i < PROF_PMC_COUNT; i++) {
+        prof_pmc_slot[i] = -1;
+        struct perf_event_attr attr = {0};
+        attr.size                   = sizeof(attr);
+        attr.type                   = PERF_TYPE_HARDWARE;
+        attr.config                 = prof_pmc_events[i].config;
+        attr.read_format            = PERF_FORMAT_GROUP;
+        attr.exclude_kernel         = 1;
+        attr.exclude_hv             = 1;
+        // A PMU short of one event (a VM often is) still gives us the rest.
+        int fd = prof_perf_event_open(&attr, prof_pmc_leader >= 0 ? prof_pmc_fd[prof_pmc_leader] : -1);
+        if (fd < 0) {
+            err = errno;
+            continue;
+        }
+        prof_pmc_fd[i]   = fd;
+        prof_pmc_slot[i] = prof_pmc_opened++;
+        if (prof_pmc_leader < 0) {
+            prof_pmc_leader = i;
+        }
+    }
+
+    if (!prof_pmc_opened) {
+        int paranoid = prof_paranoid();
+        if (err == EACCES || err == EPERM) {
+            ENGINE_PRINTF("Hardware counters unavailable: perf_event_paranoid is %d and this process may not "
+                          "count its own events. 2 or lower allows it.\n", paranoid);
+        } else {
+            ENGINE_PRINTF("Hardware counters unavailable: %s. There may be no PMU exposed here, as on many "
+                          "VMs.\n", strerror(err));
+        }
+        prof_pmc_close();
+        return;
+    }
+
+#if defined(__x86_64__)
+    prof_pmc_rdpmc = 1;
+    for (int i = 0; i < PROF_PMC_COUNT; i++) {
+        if (prof_pmc_fd[i] < 0) {
+            continue;
+        }
+        void* page = mmap(NULL, (size_t)sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, prof_pmc_fd[i], 0);
+        if (page == MAP_FAILED) {
+            prof_pmc_rdpmc = 0;
+            continue;
+        }
+        prof_pmc_page[i] = page;
+        if (!prof_pmc_page[i]->cap_user_rdpmc) {
+            prof_pmc_rdpmc = 0;
+        }
+    }
+#endif
+
+    memset(prof_marks, 0, sizeof(prof_marks));
+    prof_counting = 1;
+    ENGINE_PRINTF("Hardware counters on: %d of %d events, read with %s.\n", prof_pmc_opened, PROF_PMC_COUNT,
+                  prof_pmc_rdpmc ? "rdpmc" : "read(), which adds a syscall to each end of every probe");
+}
+
+uint64_t Profile_Begin(void) {
+    uint64_t now = Profile_Now();
+    if (prof_counting && prof_enabled) {
+        prof_mark_t* mark = &prof_marks[prof_mark_next++ % PROF_MARKS];
+        mark->start_ns    = now;
+        prof_pmc_read(mark->value);
+    }
+    return now;
+}
+
+// The most recent mark taken at `start`, or NULL if it has been overwritten or never taken.
+static const prof_mark_t* prof_mark_find(uint64_t start) {
+    for (unsigned i = 1; i <= PROF_MARKS; i++) {
+        const prof_mark_t* mark = &prof_marks[(prof_mark_next - i) % PROF_MARKS];
+        if (mark->start_ns == start) {
+            return mark;
+        }
+    }
+    return NULL;
+}
+
+static void prof_pmc_charge(prof_id_t id, uint64_t start) {
+    const prof_mark_t* mark = prof_mark_find(start);
+    if (!mark) {
+        return;
+    }
+
+    uint64_t now[PROF_PMC_COUNT] = {0};
+    prof_pmc_read(now);
+    prof_slot_t* slot = &prof_slots[id];
+    slot->pmc_count++;
+    for (int i = 0; i < PROF_PMC_COUNT; i++) {
+        slot->pmc[i] += now[i] - mark->value[i];
+    }
+}
+
 void Profile_Record(prof_id_t id, uint64_t ns) {
     if (id >= PROF_COUNT) {
         return;
@@ -103,11 +532,189 @@ void Profile_Record(prof_id_t id, uint64_t ns) {
     prof_slot_t* slot = &prof_slots[id];
     slot->count++;
     slot->total_ns += ns;
+    slot->hist[prof_bucket(ns)]++;
     if (ns > slot->max_ns) {
         slot->max_ns = ns;
     }
 }
 
+static int prof_trace_order(const void* a, const void* b) {
+    const prof_trace_event_t* x = a;
+    const prof_trace_event_t* y = b;
+    if (x->start_ns != y->start_ns) {
+        return x->start_ns < y->start_ns ? -1 : 1;
+    }
+    // Same start: the longer one is the parent.
+    return x->dur_ns > y->dur_ns ? -1 : x->dur_ns < y->dur_ns;
+}
+
+// Runs detached, so a few megabytes of JSON don't land in the middle of a frame.
+static void* prof_trace_writer_main(void* arg) {
+    prof_trace_job_t* job = arg;
+
+    qsort(job->events, job->count, sizeof(*job->events), prof_trace_order);
+
+    // Sorted by start, each event's depth is how many earlier events are still open.
+    uint64_t open_until[PROF_TRACE_MAX_DEPTH];
+    unsigned depth = 0;
+    for (uint32_t i = 0; i < job->count; i++) {
+        prof_trace_event_t* ev = &job->events[i];
+        while (depth && open_until[depth - 1] <= ev->start_ns) {
+            depth--;
+        }
+        ev->depth = (uint16_t)depth;
+        if (depth < PROF_TRACE_MAX_DEPTH) {
+            open_until[depth++] = ev->start_ns + ev->dur_ns;
+        }
+    }
+
+    char part[sizeof(job->path) + 8];
+    snprintf(part, sizeof(part), "%s.part", job->path);
+    FILE* f = fopen(part, "w");
+    if (!f) {
+        DebugPrint("profile: could not open %s\n", part);
+        goto out;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%u},\"traceEvents\":[\n", job->dropped);
+    for (uint32_t i = 0; i < job->count; i++) {
+        const prof_trace_event_t* ev = &job->events[i];
+        uint64_t ts                  = ev->start_ns - job->start_ns;
+        fprintf(f,
+                "%s{\"name\":\"%s\",\"cat\":\"qlx\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"args\":{\"depth\":%u}}",
+                i ? ",\n" : "", prof_names[ev->id],
+                (unsigned long long)(ts / 1000ull), (unsigned long long)(ts % 1000ull),
+                (unsigned long long)(ev->dur_ns / 1000u), (unsigned long long)(ev->dur_ns % 1000u),
+                (unsigned)ev->depth);
+    }
+    fprintf(f, "\n]}\n");
+
+    if (ferror(f) | fclose(f)) {
+        DebugPrint("profile: write failed on %s\n", part);
+        remove(part);
+        goto out;
+    }
+    if (rename(part, job->path)) {
+        DebugPrint("profile: could not rename %s into place\n", part);
+        goto out;
+    }
+    DebugPrint("profile: trace of %u events written to %s\n", job->count, job->path);
+
+out:
+    free(job->events);
+    free(job);
+    return NULL;
+}
+
+// Hands the ring, oldest event first, to a writer thread and stops tracing.
+static void prof_trace_finish(void) {
+    prof_trace_until_ns = 0;
+
+    uint32_t count   = prof_trace_next < PROF_TRACE_EVENTS ? prof_trace_next : PROF_TRACE_EVENTS;
+    uint32_t oldest  = prof_trace_next < PROF_TRACE_EVENTS ? 0 : prof_trace_next % PROF_TRACE_EVENTS;
+    prof_trace_job_t* job = malloc(sizeof(*job));
+    prof_trace_event_t* events = malloc((count ? count : 1) * sizeof(*events));
+    if (!job || !events) {
+        free(job);
+        free(events);
+        ENGINE_PRINTF("Trace finished, but there was no memory to write it out.\n");
+    } else {
+        uint32_t tail = PROF_TRACE_EVENTS - oldest;
+        if (tail > count) {
+            tail = count;
+        }
+        memcpy(events, &prof_trace[oldest], tail * sizeof(*events));
+        memcpy(events + tail, prof_trace, (count - tail) * sizeof(*events));
+
+        job->events   = events;
+        job->count    = count;
+        job->dropped  = prof_trace_next - count;
+        job->start_ns = prof_trace_start_ns;
+        memcpy(job->path, prof_trace_path, sizeof(job->path));
+
+        if (Worker_Start("qlx trace", WORKER_BACKGROUND, prof_trace_writer_main, job)) {
+            free(events);
+            free(job);
+            ENGINE_PRINTF("Trace finished, but the writer thread could not be started.\n");
+        } else {
+            ENGINE_PRINTF("Trace finished: %u events (%u overwritten), writing %s\n", count,
+                          prof_trace_next - count, prof_trace_path);
+        }
+    }
+
+    if (prof_trace_owns_enable) {
+        prof_trace_owns_enable = 0;
+        Profile_SetEnabled(0);
+    }
+}
+
+void Profile_End(prof_id_t id, uint64_t start) {
+    uint64_t now = Profile_Now();
+    if (id == PROF_GIL_WAIT) {
+        prof_gil_pending += now - start;
+    }
+    if (!prof_enabled) {
+        return;
+    }
+    Profile_Record(id, now - start);
+    if (prof_counting && id < PROF_COUNT) {
+        prof_pmc_charge(id, start);
+    }
+
+    if (!prof_trace_until_ns) {
+        return;
+    }
+    // A probe already open when the trace began has no place on its timeline.
+    if (start >= prof_trace_start_ns && id < PROF_COUNT) {
+        uint64_t dur           = now - start;
+        prof_trace_event_t* ev = &prof_trace[prof_trace_next++ % PROF_TRACE_EVENTS];
+        ev->start_ns           = start;
+        ev->dur_ns             = dur > UINT32_MAX ? UINT32_MAX : (uint32_t)dur;
+        ev->id                 = (uint16_t)id;
+        ev->depth              = 0;
+    }
+    if (now >= prof_trace_until_ns) {
+        prof_trace_finish();
+    }
+}
+
+void Profile_TraceStart(int seconds) {
+    if (prof_trace_until_ns) {
+        ENGINE_PRINTF("A trace is already running.\n");
+        return;
+    }
+    if (seconds < 1 || seconds > PROF_TRACE_MAX_SECONDS) {
+        ENGINE_PRINTF("Trace length must be between 1 and %d seconds.\n", PROF_TRACE_MAX_SECONDS);
+        return;
+    }
+
+    cvar_t* homepath = Cvar_FindVar ? Cvar_FindVar("fs_homepath") : NULL;
+    if (!homepath || !homepath->string[0]) {
+        ENGINE_PRINTF("fs_homepath is not set, so there is nowhere to write a trace.\n");
+        return;
+    }
+
+    char stamp[32];
+    time_t t = time(NULL);
+    struct tm tm;
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime_r(&t, &tm));
+    if ((size_t)snprintf(prof_trace_path, sizeof(prof_trace_path), "%s/qlx_trace_%s.json", homepath->string, stamp) >=
+        sizeof(prof_trace_path)) {
+        ENGINE_PRINTF("fs_homepath is too long to write a trace under.\n");
+        return;
+    }
+
+    if (!prof_enabled) {
+        Profile_SetEnabled(1);
+        prof_trace_owns_enable = 1;
+    }
+    prof_trace_next     = 0;
+    prof_trace_start_ns = Profile_Now();
+    prof_trace_until_ns = prof_trace_start_ns + (uint64_t)seconds * 1000000000ull;
+    ENGINE_PRINTF("Tracing for %d second(s); the result goes to %s\n", seconds, prof_trace_path);
+}
+
 void Profile_Reset(void) {
     memset(prof_slots, 0, sizeof(prof_slots));
     prof_elapsed_ns = 0;
@@ -124,6 +731,16 @@ static uint64_t prof_elapsed(void) {
     return elapsed;
 }
 
+void Profile_TimeGilWait(int on) {
+    prof_gil_timed = on;
+}
+
+uint64_t Profile_TakeGilWait(void) {
+    uint64_t ns      = prof_gil_pending;
+    prof_gil_pending = 0;
+    return ns;
+}
+
 void Profile_SetEnabled(int enabled) {
     if (enabled) {
         // Starting always means a fresh measurement. Profile_Reset checks prof_enabled to
@@ -134,6 +751,11 @@ void Profile_SetEnabled(int enabled) {
         if (!prof_enabled) {
             return;
         }
+        // Stopping cuts a trace short rather than losing it.
+        if (prof_trace_until_ns) {
+            prof_trace_owns_enable = 0;
+            prof_trace_finish();
+        }
         prof_enabled = 0;
         // Bank the window that just ended and stop the clock, so the counters can be
         // read later on without the idle time skewing anything.
@@ -142,6 +764,60 @@ void Profile_SetEnabled(int enabled) {
     }
 }
 
+// Per-call means of the hardware counters, for the probes sampled while they were on. An event
+// the PMU didn't have shows as "-".
+static void prof_pmc_report(void) {
+    int any = 0;
+    for (int i = 0; i < PROF_COUNT && !any; i++) {
+        any = prof_slots[i].pmc_count != 0;
+    }
+    if (!any) {
+        if (prof_counting) {
+            ENGINE_PRINTF("Hardware counters are on, but nothing has been sampled with them yet.\n");
+        }
+        return;
+    }
+
+    ENGINE_PRINTF("Hardware counters, user mode, mean per call (%s):\n",
+                  !prof_counting ? "now off" : prof_pmc_rdpmc ? "rdpmc" : "read()");
+    ENGINE_PRINTF("%-22s %10s %12s %12s %6s %12s %12s\n", "probe", "calls", "instructions", "cycles", "IPC",
+                  "cache miss", "branch miss");
+    for (int i = 0; i < PROF_COUNT; i++) {
+        const prof_slot_t* slot = &prof_slots[i];
+        if (!slot->pmc_count) {
+            continue;
+        }
+
+        char cell[PROF_PMC_COUNT][24];
+        for (int e = 0; e < PROF_PMC_COUNT; e++) {
+            if (!slot->pmc[e] && prof_pmc_fd[e] < 0) {
+                snprintf(cell[e], sizeof(cell[e]), "-");
+                continue;
+            }
+            // Misses are few enough per call that the tenths matter.
+            uint64_t x10 = slot->pmc[e] * 10ull / slot->pmc_count;
+            if (e == PROF_PMC_CACHE_MISSES || e == PROF_PMC_BRANCH_MISSES) {
+                snprintf(cell[e], sizeof(cell[e]), "%llu.%llu", (unsigned long long)(x10 / 10), (unsigned long long)(x10 % 10));
+            } else {
+                snprintf(cell[e], sizeof(cell[e]), "%llu", (unsigned long long)(x10 / 10));
+            }
+        }
+
+        char ipc[24] = "-";
+        uint64_t cycles = slot->pmc[PROF_PMC_CYCLES];
+        if (cycles) {
+            uint64_t ipc_x100 = slot->pmc[PROF_PMC_INSTRUCTIONS] * 100ull / cycles;
+            snprintf(ipc, sizeof(ipc), "%llu.%02llu", (unsigned long long)(ipc_x100 / 100), (unsigned long long)(ipc_x100 % 100));
+        }
+
+        ENGINE_PRINTF("%-22s %10llu %12s %12s %6s %12s %12s\n", prof_names[i], (unsigned long long)slot->pmc_count,
+                      cell[PROF_PMC_INSTRUCTIONS], cell[PROF_PMC_CYCLES], ipc, cell[PROF_PMC_CACHE_MISSES],
+                      cell[PROF_PMC_BRANCH_MISSES]);
+    }
+    ENGINE_PRINTF("Low IPC with many cache misses is memory-bound; high IPC with a high instruction count is\n"
+                  "just doing a lot. The counters include the probe reads themselves.\n");
+}
+
 // Prints through Com_Printf with literal formats. After hooking that symbol holds the
 // trampoline to the engine's own, so the report can't recurse into console_print.
 void Profile_Report(void) {
@@ -149,7 +825,21 @@ void Profile_Report(void) {
 
     ENGINE_PRINTF("minqlxtended profiler: %s, %llu.%03llus sampled\n", prof_enabled ? "on" : "off",
                (unsigned long long)(elapsed_ms / 1000), (unsigned long long)(elapsed_ms % 1000));
-    ENGINE_PRINTF("%-22s %10s %8s %12s %10s %10s\n", "probe", "count", "per sec", "total ms", "mean us", "max us");
+    if (prof_clock == PROF_CLOCK_TSC) {
+        // Ticks per microsecond from the 32.32 nanoseconds-per-tick, to one decimal.
+        uint64_t mhz_x10 = prof_tsc_mult ? (10000ull << 32) / prof_tsc_mult : 0;
+        ENGINE_PRINTF("Clock: invariant TSC at %llu.%llu MHz.\n", (unsigned long long)(mhz_x10 / 10),
+                   (unsigned long long)(mhz_x10 % 10));
+    } else if (prof_clock == PROF_CLOCK_CALIBRATING) {
+        ENGINE_PRINTF("Clock: clock_gettime while the TSC is calibrated.\n");
+    } else if (prof_clock == PROF_CLOCK_UNCHECKED) {
+        // Decided on the first timed probe, so nothing has been timed yet.
+        ENGINE_PRINTF("Clock: TSC not yet checked; clock_gettime until then.\n");
+    } else {
+        ENGINE_PRINTF("Clock: clock_gettime; no invariant TSC here, or it calibrated implausibly.\n");
+    }
+    ENGINE_PRINTF("%-22s %10s %8s %12s %10s %10s %10s %10s %10s %10s\n", "probe", "count", "per sec", "total ms",
+               "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
 
     for (int i = 0; i < PROF_COUNT; i++) {
         const prof_slot_t* slot = &prof_slots[i];
@@ -160,17 +850,52 @@ void Profile_Report(void) {
         // Fixed-point throughout, since we don't hand floats to the engine's printf.
         uint64_t per_sec_x10 = elapsed_ms ? (slot->count * 10000ull / elapsed_ms) : 0;
         uint64_t mean_ns     = slot->total_ns / slot->count;
+        uint64_t p50_ns      = prof_percentile(slot, 5000);
+        uint64_t p90_ns      = prof_percentile(slot, 9000);
+        uint64_t p99_ns      = prof_percentile(slot, 9900);
+        uint64_t p999_ns     = prof_percentile(slot, 9990);
 
-        ENGINE_PRINTF("%-22s %10llu %6llu.%1llu %8llu.%03llu %7llu.%02llu %7llu.%02llu\n", prof_names[i],
+        ENGINE_PRINTF("%-22s %10llu %6llu.%1llu %8llu.%03llu %7llu.%02llu %7llu.%02llu %7llu.%02llu %7llu.%02llu %7llu.%02llu %7llu.%02llu\n",
+                   prof_names[i],
                    (unsigned long long)slot->count, (unsigned long long)(per_sec_x10 / 10), (unsigned long long)(per_sec_x10 % 10),
                    (unsigned long long)(slot->total_ns / 1000000ull), (unsigned long long)((slot->total_ns % 1000000ull) / 1000ull),
                    (unsigned long long)(mean_ns / 1000ull), (unsigned long long)((mean_ns % 1000ull) / 10ull),
+                   (unsigned long long)(p50_ns / 1000ull), (unsigned long long)((p50_ns % 1000ull) / 10ull),
+                   (unsigned long long)(p90_ns / 1000ull), (unsigned long long)((p90_ns % 1000ull) / 10ull),
+                   (unsigned long long)(p99_ns / 1000ull), (unsigned long long)((p99_ns % 1000ull) / 10ull),
+                   (unsigned long long)(p999_ns / 1000ull), (unsigned long long)((p999_ns % 1000ull) / 10ull),
                    (unsigned long long)(slot->max_ns / 1000ull), (unsigned long long)((slot->max_ns % 1000ull) / 10ull));
     }
 
+    prof_pmc_report();
     if (!prof_enabled) {
         ENGINE_PRINTF("Profiler is off. Use \"qlx_prof on\" to start sampling.\n");
     }
-    ENGINE_PRINTF("Read the max column first; it is the jitter that costs frames. Totals for nested\n"
-               "dispatches overlap, so do not sum them. \"frame\" includes the engine's own work.\n");
+    if (prof_trace_until_ns) {
+        uint64_t left_ms = (prof_trace_until_ns - Profile_Now()) / 1000000ull;
+        ENGINE_PRINTF("Tracing: %u events so far, %llu.%01llus left.\n", prof_trace_next,
+                   (unsigned long long)(left_ms / 1000), (unsigned long long)((left_ms % 1000) / 100));
+    }
+    ENGINE_PRINTF("Read the p99 and max columns first; they are the jitter that costs frames. Percentiles\n"
+               "are bucket tops, up to 1/16th high. Totals for nested dispatches overlap, so do not\n"
+               "sum them. \"frame\" includes the engine's own work.\n");
+}
+
+void Profile_Status(profile_status_t* out) {
+    out->enabled    = prof_enabled;
+    out->elapsed_ns = prof_elapsed();
+
+    for (int i = 0; i < PROF_COUNT; i++) {
+        const prof_slot_t* slot = &prof_slots[i];
+        profile_probe_t* probe  = &out->probes[i];
+
+        probe->name     = prof_names[i];
+        probe->count    = slot->count;
+        probe->total_ns = slot->total_ns;
+        probe->max_ns   = slot->max_ns;
+        probe->p50_ns   = prof_percentile(slot, 5000);
+        probe->p90_ns   = prof_percentile(slot, 9000);
+        probe->p99_ns   = prof_percentile(slot, 9900);
+        probe->p999_ns  = prof_percentile(slot, 9990);
+    }
 }
@@ -21,10 +21,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 
 // Latency probes for everything added to the game thread, driven by the "qlx_prof" console
-// command. No cvar, since sampling costs a clock_gettime per probe. A frame is 25ms at sv_fps 40
+// command. Probes read the TSC where CPUID reports it invariant, a few tens of nanoseconds per
+// pair, and clock_gettime elsewhere; Profile_Report says which. A frame is 25ms at sv_fps 40
 // and as little as 5ms once it has been raised. PROF_GIL_WAIT is kept apart: the game thread
 // drops the GIL after init, so every dispatcher reacquires it and blocks whenever a worker holds
 // it. Dispatches nest, so don't sum the totals. Game thread only, so the counters need no locking.
+// "qlx_prof counters on" adds instructions, cycles, cache and branch misses per probe, read
+// through perf_event_open, where the kernel's perf_event_paranoid allows it.
 
 typedef enum {
     PROF_FRAME_TOTAL = 0, // My_G_RunFrame, engine frame included.
@@ -71,20 +74,59 @@ typedef enum {
 
 // Off by default.
 extern int prof_enabled;
+// Set by Profile_TimeGilWait, so PROF_GIL_BEGIN times the GIL wait with the profiler off. The
+// other probes take no timestamp at all until qlx_prof is on.
+extern int prof_gil_timed;
+
+// One probe's figures for Profile_Status. Percentiles come out of a log-linear histogram, so
+// each is the top of the bucket the sample fell in: at most 1/16th high, never low, and never
+// past max_ns.
+typedef struct {
+    const char* name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} profile_probe_t;
+
+typedef struct {
+    int enabled;
+    uint64_t elapsed_ns; // Time spent sampling, over every on/off window since the last reset.
+    profile_probe_t probes[PROF_COUNT];
+} profile_status_t;
 
 uint64_t Profile_Now(void);
+// Profile_Now, plus a hardware counter reading for Profile_End when counters are on.
+uint64_t Profile_Begin(void);
 void Profile_Record(prof_id_t id, uint64_t ns);
 void Profile_SetEnabled(int enabled);
 void Profile_Reset(void);
 void Profile_Report(void);
+void Profile_Status(profile_status_t* out);
+// Closes a probe opened at `start`, recording it and adding it to any trace in progress.
+void Profile_End(prof_id_t id, uint64_t start);
+// Starts a trace, turning the profiler on for its length if it is off.
+void Profile_TraceStart(int seconds);
+// Keeps PROF_GIL_WAIT timed with the profiler off, for Profile_TakeGilWait.
+void Profile_TimeGilWait(int on);
+// PROF_GIL_WAIT summed since the last call, whether or not the profiler is on.
+uint64_t Profile_TakeGilWait(void);
+// Opens or closes the hardware counters. Must be called on the game thread, as that is the
+// thread they count.
+void Profile_SetCounters(int on);
 
 // A zero timestamp means no sampling.
-#define PROF_BEGIN(v) uint64_t v = prof_enabled ? Profile_Now() : 0
-#define PROF_END(id, v)                                \
-    do {                                               \
-        if (v) {                                       \
-            Profile_Record((id), Profile_Now() - (v)); \
-        }                                              \
+#define PROF_BEGIN(v) uint64_t v = prof_enabled ? Profile_Begin() : 0
+// For PROF_GIL_WAIT only, which framestats reads whether or not the profiler is on.
+#define PROF_GIL_BEGIN(v) uint64_t v = (prof_enabled || prof_gil_timed) ? Profile_Begin() : 0
+#define PROF_END(id, v)             \
+    do {                            \
+        if (v) {                    \
+            Profile_End((id), (v)); \
+        }                           \
     } while (0)
 
 #endif /* PROFILE_H */
@@ -30,35 +30,129 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define RELIABLE_RING     MAX_RELIABLE_COMMANDS // 64 slots per client, engine-fixed
 #define RELIABLE_CMD_MAX  1022                  // SV_SendServerCommand silently drops >= 1023
-#define RELIABLE_QUEUE    128                   // entries; beyond this we stop pacing and send straight through
+#define RELIABLE_ARENA    1024                  // entries shared by every client's queue
+#define RELIABLE_QUEUE    128                   // entries per client; beyond this that client is sent straight through
+#define RELIABLE_FRAME_MAX 256                  // releases per flush across all clients, to bound the frame's cost
 #define PRINT_PAYLOAD_MAX 980                   // leaves room for the print "..."\n wrapper
 
 // How many frames an entry may be held before it goes out regardless of the backlog. Anything
-// held this long is waiting on a client whose acknowledge has stopped advancing, and unbounded
-// that head entry blocks every other client's commands behind it.
+// held this long is waiting on a client whose acknowledge has stopped advancing. The queue is that
+// client's alone, but left unbounded it would fill and turn everything after it into a bypass.
 #define RELIABLE_MAX_HOLD 40
 
+// Frames past twice the round trip that a client's acknowledge may sit still, with commands
+// outstanding, before its window is halved.
+#define RELIABLE_STALL_SLACK 4
+
+// The floor of an adapted window. Its ceiling is qlx_reliableWatermark, for the reason given at
+// watermark(): how far behind reliableAcknowledge the cgame really is cannot be measured, so no
+// client is trusted with a deeper window than the operator set.
+#define RELIABLE_WINDOW_MIN 8
+
+// Configstring writes a plugin made, held so a run of them to one index goes out as the last
+// value only, and so a mass update is spread over frames. Values are kept whole, so anything
+// longer than a slot goes straight through, as does everything once the slots are full.
+#define RELIABLE_CS_PENDING 128
+#define RELIABLE_CS_VALUE   MAX_STRING_CHARS
+
+// Frames of backlog kept per client for Reliable_History: 6.4 seconds at the default sv_fps.
+// "Near the ring" in the report means within 16 of it.
+#define RELIABLE_HISTORY  RELIABLE_HISTORY_FRAMES
+#define RELIABLE_NEAR     (RELIABLE_RING - 16)
+
+// What a paced command is, in the order a client's queue releases them. Critical commands are
+// the ones is_cosmetic refuses and are never queued; the rest are released highest class first,
+// and in submission order within a class. Under pressure the lowest class is what gets shed.
+typedef enum {
+    REL_CRITICAL = -1,
+    REL_GAMEPLAY,  // print and sounds from the game module
+    REL_CHAT,      // chat, tchat
+    REL_CENTER,    // cp, pcp; a newer one replaces a queued one of the same kind
+    REL_COSMETIC,  // prints and sounds a plugin sent
+    REL_CLASSES
+} rel_class_t;
+
+// Queued commands live in one static arena, threaded into a FIFO per client and class through
+// next, with the unused entries on a free list. Nothing on the game thread allocates.
 typedef struct {
-    int slot; // -1 for a broadcast
+    short next;     // arena index of the next entry in the same list, -1 at the end
     unsigned frame; // rel_frame when it was queued
     char cmd[RELIABLE_CMD_MAX + 1];
 } rel_entry_t;
 
-static rel_entry_t rel_queue[RELIABLE_QUEUE];
-static int rel_head, rel_count;
+typedef struct {
+    short head[REL_CLASSES], tail[REL_CLASSES]; // arena indices, -1 when empty
+    int count;                                  // across every class
+    int sent; // commands that left for this client this frame, straight through or released
+} rel_queue_t;
+
+static rel_entry_t rel_arena[RELIABLE_ARENA];
+static short rel_free = -1;
+static qboolean rel_arena_ready;
+static rel_queue_t rel_queues[MAX_CLIENTS];
+static int rel_waiting; // entries in use across every queue
+static int rel_cursor;  // the client the next flush serves first
+static int rel_plugin;  // nesting depth of Reliable_BeginPluginSend
+static int rel_merge;   // nesting depth of Reliable_BeginMergeablePrints
+
+// Each client's own watermark and burst, when qlx_reliableAdaptive is on, steered by how fast it
+// acknowledges. The window grows by one, up to qlx_reliableWatermark, for every frame its
+// acknowledge advances while the backlog fills at least half of it, and halves when the
+// acknowledge stalls well past the client's round trip: additive increase and multiplicative
+// decrease, as TCP does. The burst is
+// the window spread over one round trip, or the measured acknowledge rate if that is higher.
+typedef struct {
+    qboolean live; // tracking this client; cleared when the slot empties
+    int last_ack;
+    int stalled;  // frames the acknowledge has sat still with commands outstanding
+    int rate_x16; // acknowledged commands per frame, smoothed, times 16
+    int window;
+    int burst;
+} rel_pace_t;
+
+static rel_pace_t rel_pace[MAX_CLIENTS];
+
+// Each client's backlog as the frame started, one byte a frame, written at rel_frame modulo the
+// ring so every client's newest sample is at the same place. samples counts up to the ring size
+// from when the slot was last seen primed; anything older belonged to whoever had it before.
+typedef struct {
+    unsigned char backlog[RELIABLE_HISTORY];
+    int samples;
+    int near;  // samples at or past RELIABLE_NEAR, of those held
+    int total; // sum of the samples held, for the average
+} rel_history_t;
+
+static rel_history_t rel_history[MAX_CLIENTS];
+
+typedef struct {
+    int index;      // -1 for a free slot
+    unsigned frame; // rel_frame of the first write since the last release
+    unsigned order; // submission order across slots, so release is first come, first served
+    char value[RELIABLE_CS_VALUE];
+} rel_cs_t;
+
+static rel_cs_t rel_cs[RELIABLE_CS_PENDING];
+static short rel_cs_at[MAX_CONFIGSTRINGS]; // rel_cs slot held for each index, -1 for none
+static int rel_cs_waiting;
+static unsigned rel_cs_order;
 
 static unsigned rel_frame; // counts Reliable_Flush calls; only differences are used
-static int rel_sent_this_frame;
 static int rel_warned; // one "we had to pace" line per map, however many bursts
 
 static cvar_t* qlx_reliableGuard;
 static cvar_t* qlx_reliableWatermark;
 static cvar_t* qlx_reliableBurst;
+static cvar_t* qlx_reliableAdaptive;
+static cvar_t* qlx_reliableConfigstringWindow;
+static cvar_t* sv_fps;
 
 static struct {
     unsigned queued;   // commands held back at least one frame
-    unsigned merged;   // broadcast prints folded into a preceding batch
-    unsigned bypassed; // sent straight through, unpaced, because the queue was full
+    unsigned merged;   // queued prints folded into the one ahead of them
+    unsigned bypassed; // sent straight through, unpaced, because a queue or the arena was full
+    unsigned coalesced; // replaced by a newer center print, or a repeat of the print before it
+    unsigned shed;      // dropped from a full queue to make room for a higher class
+    unsigned cs_collapsed; // plugin configstring writes overtaken by a later one to the same index
     int worst_backlog; // deepest reliableSequence - reliableAcknowledge ever seen
     int worst_slot;
     // Seeded here as well as in Reliable_Reset: a "qlx_reliable" from a config that runs
@@ -72,20 +166,68 @@ void Reliable_Init(void) {
     qlx_reliableGuard     = Cvar_Get("qlx_reliableGuard", "1", CVAR_ARCHIVE);
     qlx_reliableWatermark = Cvar_Get("qlx_reliableWatermark", "32", CVAR_ARCHIVE);
     qlx_reliableBurst     = Cvar_Get("qlx_reliableBurst", "8", CVAR_ARCHIVE);
+    qlx_reliableAdaptive  = Cvar_Get("qlx_reliableAdaptive", "0", CVAR_ARCHIVE);
+    qlx_reliableConfigstringWindow = Cvar_Get("qlx_reliableConfigstringWindow", "0", CVAR_ARCHIVE);
+    sv_fps                = Cvar_FindVar("sv_fps");
 }
 
 // Deferring starts here. Kept well below the ring size because the client's cgame is
 // always further behind than reliableAcknowledge suggests.
 static int watermark(void) { return cvar_clamped(qlx_reliableWatermark, 32, 8, RELIABLE_RING - 8); }
 
-// Commands allowed straight out per frame before pacing starts, and the number released
-// per frame once it has.
+// Commands allowed straight out to one client per frame before pacing starts, and the number
+// released to it per frame once it has.
 static int burst(void) { return cvar_clamped(qlx_reliableBurst, 8, 1, 32); }
 
 static qboolean enabled(void) {
     return (qlx_reliableGuard && qlx_reliableGuard->integer && svs && svs->clients && sv_maxclients) ? qtrue : qfalse;
 }
 
+static void arena_reset(void) {
+    for (int i = 0; i < RELIABLE_ARENA; i++) {
+        rel_arena[i].next = (short)(i + 1 < RELIABLE_ARENA ? i + 1 : -1);
+    }
+    rel_free = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        for (int c = 0; c < REL_CLASSES; c++) {
+            rel_queues[i].head[c] = rel_queues[i].tail[c] = -1;
+        }
+        rel_queues[i].count = rel_queues[i].sent = 0;
+    }
+    rel_waiting     = 0;
+    rel_cursor      = 0;
+    rel_arena_ready = qtrue;
+
+    for (int i = 0; i < RELIABLE_CS_PENDING; i++) {
+        rel_cs[i].index = -1;
+    }
+    memset(rel_cs_at, 0xff, sizeof(rel_cs_at));
+    rel_cs_waiting = 0;
+}
+
+// Detaches the head of one class of a client's queue into *out and returns its entry to the
+// free list.
+static void queue_pop(rel_queue_t* q, rel_class_t c, rel_entry_t* out) {
+    short i        = q->head[c];
+    rel_entry_t* e = &rel_arena[i];
+    if (out) {
+        *out = *e;
+    }
+    q->head[c] = e->next;
+    if (q->head[c] < 0) {
+        q->tail[c] = -1;
+    }
+    q->count--;
+    rel_waiting--;
+    e->next  = rel_free;
+    rel_free = i;
+}
+
+static int clients(void) {
+    return (sv_maxclients && sv_maxclients->integer > 0 && sv_maxclients->integer <= MAX_CLIENTS) ? sv_maxclients->integer
+                                                                                                  : MAX_CLIENTS;
+}
+
 // Only output the client merely displays is eligible for pacing. Anything its state machine reads
 // (cs, bcs0/1/2, tinfo, scores, disconnect, map_restart) and anything not listed here goes out
 // untouched.
@@ -101,6 +243,19 @@ static qboolean is_cosmetic(const char* cmd) {
     return qfalse;
 }
 
+static rel_class_t classify(const char* cmd) {
+    if (!is_cosmetic(cmd)) {
+        return REL_CRITICAL;
+    }
+    if (cmd_word_is(cmd, "chat") || cmd_word_is(cmd, "tchat")) {
+        return REL_CHAT;
+    }
+    if (cmd_word_is(cmd, "cp") || cmd_word_is(cmd, "pcp")) {
+        return REL_CENTER;
+    }
+    return rel_plugin ? REL_COSMETIC : REL_GAMEPLAY;
+}
+
 // Splits print "text" into its payload so consecutive ones can be concatenated. Refuses anything
 // it cannot rebuild byte for byte: an embedded quote, which the engine's tokeniser would treat as
 // the end of the argument, or trailing junk after the closing quote.
@@ -127,6 +282,77 @@ static int backlog_of(const client_t* cl) {
     return cl->reliableSequence - cl->reliableAcknowledge;
 }
 
+// SV_SendServerCommand's filter for a broadcast: nothing below CS_PRIMED, and a CS_PRIMED client
+// receives nothing but "chat ".
+static qboolean receives_broadcast(const client_t* cl, qboolean is_chat) {
+    return (cl->state > CS_PRIMED || (cl->state == CS_PRIMED && is_chat)) ? qtrue : qfalse;
+}
+
+static qboolean adaptive(void) {
+    return (qlx_reliableAdaptive && qlx_reliableAdaptive->integer) ? qtrue : qfalse;
+}
+
+// The watermark and burst that apply to one client: its own under qlx_reliableAdaptive, the
+// cvars otherwise and until it has been measured.
+static int client_watermark(int slot) {
+    return (adaptive() && rel_pace[slot].live) ? rel_pace[slot].window : watermark();
+}
+
+static int client_burst(int slot) {
+    return (adaptive() && rel_pace[slot].live) ? rel_pace[slot].burst : burst();
+}
+
+// The client's ping in frames, the unit its acknowledge moves in. At least one.
+static int rtt_frames(const client_t* cl) {
+    int fps    = cvar_clamped(sv_fps, 40, 1, 1000);
+    int frames = (cl->ping > 0 && cl->ping < 999) ? cl->ping * fps / 1000 : 0;
+    return frames < 1 ? 1 : (frames > 32 ? 32 : frames);
+}
+
+// Once per frame, for every client, before the flush releases anything.
+static void pace_update(int slot, const client_t* cl) {
+    rel_pace_t* p = &rel_pace[slot];
+    if (cl->state < CS_PRIMED) {
+        p->live = qfalse;
+        return;
+    }
+    if (!p->live) {
+        // Starts from the cvars; the first frame only takes a reading.
+        *p = (rel_pace_t){.live = qtrue, .last_ack = cl->reliableAcknowledge, .window = watermark(), .burst = burst()};
+        return;
+    }
+
+    int acked   = cl->reliableAcknowledge - p->last_ack;
+    p->last_ack = cl->reliableAcknowledge;
+    if (acked < 0) {
+        acked = 0;
+    }
+    p->rate_x16 += (acked * 16 - p->rate_x16) / 8;
+
+    int backlog = backlog_of(cl);
+    int rtt     = rtt_frames(cl);
+    int top     = watermark();
+    if (acked > 0) {
+        p->stalled = 0;
+        if (backlog * 2 >= p->window && p->window < top) {
+            p->window++;
+        }
+    } else if (backlog > 0 && ++p->stalled > 2 * rtt + RELIABLE_STALL_SLACK) {
+        p->window  = p->window / 2 < RELIABLE_WINDOW_MIN ? RELIABLE_WINDOW_MIN : p->window / 2;
+        p->stalled = 0;
+    }
+    if (p->window > top) {
+        p->window = top; // the cvar was lowered since
+    }
+
+    int b        = p->window / rtt;
+    int measured = (p->rate_x16 + 15) / 16;
+    if (measured > b) {
+        b = measured;
+    }
+    p->burst = b < 1 ? 1 : (b > 32 ? 32 : b);
+}
+
 // How close to the ring the worst affected client is. For a broadcast this mirrors the engine's
 // delivery filter (SV_SendServerCommand skips clients below CS_PRIMED, and a CS_PRIMED client
 // receives nothing but "chat "), so a client that will never see the command cannot hold it back
@@ -147,7 +373,7 @@ static int backlog_for(int slot, const char* cmd, int* worst_slot) {
     int worst        = 0;
     for (int i = 0; i < sv_maxclients->integer; i++) {
         const client_t* cl = &svs->clients[i];
-        if (cl->state <= CS_CONNECTED || (cl->state == CS_PRIMED && !is_chat)) {
+        if (!receives_broadcast(cl, is_chat)) {
             continue;
         }
         int b = backlog_of(cl);
@@ -184,39 +410,148 @@ static void send_now(int slot, const char* cmd) {
     // The real SV_SendServerCommand, going around our own hook. The server_command event
     // already fired for this text when it was first submitted.
     SV_SendServerCommand(cl, "%s", cmd);
-    rel_sent_this_frame++;
+    if (slot >= 0) {
+        rel_queues[slot].sent++;
+    }
+}
+
+// Takes a command the queue already has an equivalent for. A center print overwrites the queued
+// one of the same kind, since only the newest would be on screen by the time either arrived. A
+// print identical to the one queued just before it in its class is a repeat and is dropped.
+static qboolean coalesce(rel_queue_t* q, rel_class_t c, const char* cmd) {
+    if (c == REL_CENTER) {
+        qboolean pcp = cmd_word_is(cmd, "pcp");
+        for (short i = q->head[c]; i >= 0; i = rel_arena[i].next) {
+            if (cmd_word_is(rel_arena[i].cmd, "pcp") == pcp) {
+                snprintf(rel_arena[i].cmd, sizeof(rel_arena[i].cmd), "%s", cmd);
+                rel_stats.coalesced++;
+                return qtrue;
+            }
+        }
+        return qfalse;
+    }
+    if (q->tail[c] >= 0 && cmd_word_is(cmd, "print") && !strcmp(rel_arena[q->tail[c]].cmd, cmd)) {
+        rel_stats.coalesced++;
+        return qtrue;
+    }
+    return qfalse;
+}
+
+// Room in a full queue for a command of class c: the oldest entry of the lowest class below it
+// goes. qfalse if there is nothing of lower priority to give up.
+static qboolean shed_below(rel_queue_t* q, rel_class_t c) {
+    for (int lower = REL_CLASSES - 1; lower > (int)c; lower--) {
+        if (q->head[lower] >= 0) {
+            queue_pop(q, (rel_class_t)lower, NULL);
+            rel_stats.shed++;
+            return qtrue;
+        }
+    }
+    return qfalse;
 }
 
-static qboolean enqueue(int slot, const char* cmd, int backlog) {
-    if (rel_count >= RELIABLE_QUEUE) {
-        // Nothing is discarded: qfalse makes Reliable_Intercept decline the command and
-        // My_SV_SendServerCommand sends it itself, ahead of everything still queued. Pacing
-        // and submission order are both lost at this depth.
+// held: a print Reliable_BeginMergeablePrints is holding back; see held_for_merge.
+static qboolean enqueue(int slot, const char* cmd, rel_class_t c, int backlog, qboolean held) {
+    rel_queue_t* q = &rel_queues[slot];
+    // Not a held print: a plugin's run of lines there can repeat one on purpose.
+    if (!held && coalesce(q, c, cmd)) {
+        return qtrue;
+    }
+    if ((q->count >= RELIABLE_QUEUE || rel_free < 0) && !shed_below(q, c)) {
+        if (c == REL_COSMETIC) {
+            // Plugin decoration behind a full queue. Sending it anyway is what fills the
+            // client's ring and cycles out the commands that matter.
+            rel_stats.shed++;
+            return qtrue;
+        }
+        // Otherwise nothing is discarded: qfalse has the caller send the command itself, ahead
+        // of everything still queued for this client. Pacing and submission order are both lost
+        // for it at this depth; the other clients' queues are unaffected.
         rel_stats.bypassed++;
         return qfalse;
     }
-    rel_entry_t* e = &rel_queue[(rel_head + rel_count) % RELIABLE_QUEUE];
-    e->slot        = slot;
+    short i        = rel_free;
+    rel_entry_t* e = &rel_arena[i];
+    rel_free       = e->next;
+    e->next        = -1;
     e->frame       = rel_frame;
     snprintf(e->cmd, sizeof(e->cmd), "%s", cmd);
-    rel_count++;
+    if (q->tail[c] >= 0) {
+        rel_arena[q->tail[c]].next = i;
+    } else {
+        q->head[c] = i;
+    }
+    q->tail[c] = i;
+    q->count++;
+    rel_waiting++;
     rel_stats.queued++;
 
-    if (!rel_warned) {
+    if (!rel_warned && !held) {
         rel_warned = 1;
-        // The backlog measured for *this* command. rel_stats' running worst would name a
+        // The backlog measured for *this* client. rel_stats' running worst could name a
         // client with nothing to do with this burst.
-        if (slot < 0) {
-            ENGINE_PRINTF(DEBUG_PRINT_PREFIX "pacing reliable commands: a broadcast found a client %d/%d "
-                                          "commands behind. See \"qlx_reliable\".\n",
-                       backlog, RELIABLE_RING);
+        ENGINE_PRINTF(DEBUG_PRINT_PREFIX "pacing reliable commands: client %d is %d/%d commands behind. "
+                                      "See \"qlx_reliable\".\n",
+                   slot, backlog, RELIABLE_RING);
+    }
+    return qtrue;
+}
+
+// A print to particular clients inside Reliable_BeginMergeablePrints, which waits for the lines
+// sent after it. Broadcasts never are: the callers only ask this for targeted sends.
+static qboolean held_for_merge(const char* cmd) {
+    return rel_merge && cmd_word_is(cmd, "print") ? qtrue : qfalse;
+}
+
+// Whether a command for this client can leave now without adding to anything: nothing of theirs
+// is waiting ahead of it, they are under this frame's burst, and their ring has room. A held
+// print never can.
+static qboolean can_send_now(int slot, int backlog, qboolean held) {
+    const rel_queue_t* q = &rel_queues[slot];
+    if (held) {
+        return qfalse;
+    }
+    return (!q->count && q->sent < client_burst(slot) && backlog < client_watermark(slot)) ? qtrue : qfalse;
+}
+
+// The engine's console echo for a broadcast print, which a broadcast fanned out to each client
+// no longer gets from SV_SendServerCommand. Newlines are escaped, as SV_ExpandNewlines does.
+static void echo_broadcast(const char* cmd) {
+    char buf[MAX_STRING_CHARS];
+    size_t n = 0;
+    for (const char* p = cmd; *p && n < sizeof(buf) - 2; p++) {
+        if (*p == '\n') {
+            buf[n++] = '\\';
+            buf[n++] = 'n';
         } else {
-            ENGINE_PRINTF(DEBUG_PRINT_PREFIX "pacing reliable commands: client %d is %d/%d commands behind. "
-                                          "See \"qlx_reliable\".\n",
-                       slot, backlog, RELIABLE_RING);
+            buf[n++] = *p;
         }
     }
-    return qtrue;
+    buf[n] = '\0';
+    My_Com_Printf("broadcast: %s\n", buf);
+}
+
+// One client's copy of a command several are getting: now if it can take it, otherwise on the
+// end of its own queue, so one slow client delays only itself.
+static void deliver(int slot, const char* cmd, rel_class_t c, qboolean held) {
+    int backlog = backlog_of(&svs->clients[slot]);
+    if (c == REL_CRITICAL || can_send_now(slot, backlog, held) || !enqueue(slot, cmd, c, backlog, held)) {
+        send_now(slot, cmd);
+    }
+}
+
+// A broadcast with at least one receiving client behind.
+static void fan_out(const char* cmd, rel_class_t c) {
+    qboolean is_chat = cmd_word_is(cmd, "chat");
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        if (receives_broadcast(&svs->clients[i], is_chat)) {
+            deliver(i, cmd, c, qfalse);
+        }
+    }
+    // Last, once every queue is consistent: it reaches the hooked Com_Printf. See reliable.h.
+    if (!strncmp(cmd, "print", 5)) {
+        echo_broadcast(cmd);
+    }
 }
 
 qboolean Reliable_Intercept(client_t* cl, const char* cmd) {
@@ -241,102 +576,374 @@ qboolean Reliable_Intercept(client_t* cl, const char* cmd) {
     int backlog    = backlog_for(slot, cmd, &worst_slot);
     note_backlog(worst_slot, backlog);
 
-    if (!is_cosmetic(cmd)) {
+    rel_class_t c = classify(cmd);
+    if (c == REL_CRITICAL) {
         return qfalse;
     }
 
+    if (!rel_arena_ready) {
+        arena_reset();
+    }
+
     // Nothing waiting and plenty of ring left: the common case, sent with no added latency.
-    // Otherwise it queues, keeping submission order. The counter covers commands let through
-    // as well as ones the flush emits, so the cap is on everything leaving in a frame.
-    if (!rel_count && rel_sent_this_frame < burst() && backlog < watermark()) {
-        rel_sent_this_frame++;
+    // Otherwise it queues behind that client's earlier commands, keeping their order. The sent
+    // counter covers commands let through as well as ones the flush emits, so the burst is on
+    // everything leaving for a client in a frame.
+    if (slot >= 0) {
+        qboolean held = held_for_merge(cmd);
+        if (can_send_now(slot, backlog, held)) {
+            rel_queues[slot].sent++;
+            return qfalse;
+        }
+        return enqueue(slot, cmd, c, backlog, held);
+    }
+
+    // A broadcast goes out as one engine call when every receiving client could take it.
+    qboolean is_chat = cmd_word_is(cmd, "chat");
+    qboolean all     = qtrue;
+    for (int i = 0; i < sv_maxclients->integer && all; i++) {
+        const client_t* cl = &svs->clients[i];
+        all = !receives_broadcast(cl, is_chat) || can_send_now(i, backlog_of(cl), qfalse);
+    }
+    if (all) {
+        for (int i = 0; i < sv_maxclients->integer; i++) {
+            if (receives_broadcast(&svs->clients[i], is_chat)) {
+                rel_queues[i].sent++;
+            }
+        }
         return qfalse;
     }
 
-    return enqueue(slot, cmd, backlog);
+    fan_out(cmd, c);
+    return qtrue;
 }
 
-void Reliable_Flush(void) {
-    rel_frame++;
-    rel_sent_this_frame = 0;
-    if (!rel_count) {
+// The class a client's queue releases from next: the highest with anything in it. While the
+// client is over the watermark, only an entry held RELIABLE_MAX_HOLD frames goes, oldest first.
+// REL_CRITICAL if nothing is due.
+static rel_class_t next_class(int slot, qboolean paced) {
+    const rel_queue_t* q = &rel_queues[slot];
+    if (!q->count || (paced && q->sent >= client_burst(slot))) {
+        return REL_CRITICAL;
+    }
+    if (!paced || backlog_for(slot, NULL, NULL) < client_watermark(slot)) {
+        for (int c = 0; c < REL_CLASSES; c++) {
+            if (q->head[c] >= 0) {
+                return (rel_class_t)c;
+            }
+        }
+    }
+    rel_class_t oldest = REL_CRITICAL;
+    for (int c = 0; c < REL_CLASSES; c++) {
+        if (q->head[c] >= 0 && (rel_frame - rel_arena[q->head[c]].frame) >= RELIABLE_MAX_HOLD &&
+            (oldest == REL_CRITICAL || (int)(rel_arena[q->head[c]].frame - rel_arena[q->head[oldest]].frame) < 0)) {
+            oldest = (rel_class_t)c;
+        }
+    }
+    return oldest;
+}
+
+void Reliable_SendMany(const int* slots, int count, const char* cmd) {
+    if (!svs || !svs->clients || !sv_maxclients || !cmd || !cmd[0]) {
         return;
     }
+    if (!rel_arena_ready) {
+        arena_reset();
+    }
+
+    // Classified once for the lot. Unpaced, or too long to queue whole, it still goes out one
+    // engine call per client, which is all SV_SendServerCommand would have done with it.
+    rel_class_t c = (enabled() && strlen(cmd) <= RELIABLE_CMD_MAX) ? classify(cmd) : REL_CRITICAL;
+    qboolean held = held_for_merge(cmd);
+    for (int i = 0; i < count; i++) {
+        if (slots[i] < 0 || slots[i] >= sv_maxclients->integer) {
+            continue;
+        }
+        note_backlog(slots[i], backlog_of(&svs->clients[slots[i]]));
+        deliver(slots[i], cmd, c, held);
+    }
+}
+
+// Releases the next entry of one client's queue, folding in what can be merged with it. qfalse if
+// the client has nothing due this frame.
+static qboolean release_one(int slot, qboolean paced) {
+    rel_class_t c = next_class(slot, paced);
+    if (c == REL_CRITICAL) {
+        return qfalse; // still too deep, or had its share; try again next frame
+    }
+
+    // Off the queue before anything else can run, and by value. send_now below can drop the
+    // client, and Reliable_ClientGone then empties this queue underneath us. See reliable.h.
+    rel_queue_t* q = &rel_queues[slot];
+    rel_entry_t entry;
+    queue_pop(q, c, &entry);
 
-    // Turned off mid-match with output still held. Hand it all back so nothing strands.
-    qboolean paced = enabled();
-    int budget     = paced ? burst() : rel_count;
     char batch[RELIABLE_CMD_MAX + 1];
     char payload[PRINT_PAYLOAD_MAX + 1];
+    const char* text = entry.cmd;
+    const char* p;
+    size_t plen, used = 0;
+
+    // Fold as many consecutive prints of the same class as fit into one command, whether they
+    // were fanned out from a broadcast or sent to this client alone. Only newline-terminated
+    // payloads are merged, so no two lines are ever run together. Nothing here can re-enter, so
+    // the queue is still ours to walk.
+    if (print_payload(entry.cmd, &p, &plen) && plen <= PRINT_PAYLOAD_MAX) {
+        memcpy(payload, p, plen);
+        used = plen;
+        while (used && payload[used - 1] == '\n' && q->head[c] >= 0) {
+            const rel_entry_t* next = &rel_arena[q->head[c]];
+            if (!print_payload(next->cmd, &p, &plen) || used + plen > PRINT_PAYLOAD_MAX) {
+                break;
+            }
+            memcpy(payload + used, p, plen);
+            used += plen;
+            queue_pop(q, c, NULL);
+            rel_stats.merged++;
+        }
+        payload[used] = '\0';
+        snprintf(batch, sizeof(batch), "print \"%s\"\n", payload);
+        text = batch;
+    }
+
+    send_now(slot, text);
+    return qtrue;
+}
+
+// Frames a plugin's configstring write is held for later writes to collapse into, before it may
+// be released. 0 turns deferral off.
+static int cs_window(void) { return cvar_clamped(qlx_reliableConfigstringWindow, 0, 0, 40); }
+
+static void cs_drop(short i) {
+    rel_cs_at[rel_cs[i].index] = -1;
+    rel_cs[i].index            = -1;
+    rel_cs_waiting--;
+}
+
+qboolean Reliable_DeferConfigstring(int index, const char* value) {
+    if (index < 0 || index >= MAX_CONFIGSTRINGS || !rel_arena_ready) {
+        return qfalse;
+    }
+    short at = rel_cs_at[index];
+
+    // Only a plugin's writes wait. The game module's own, and everything with deferral off, go
+    // out now; a pending plugin value for the same index is older than that and goes with it.
+    if (!rel_plugin || !enabled() || !cs_window()) {
+        if (at >= 0) {
+            cs_drop(at);
+        }
+        return qfalse;
+    }
+
+    // Too long to hold. Anything held for the index is older, so it is dropped and this goes now.
+    if (strlen(value) >= RELIABLE_CS_VALUE) {
+        if (at >= 0) {
+            cs_drop(at);
+        }
+        return qfalse;
+    }
+    if (at >= 0) {
+        memcpy(rel_cs[at].value, value, strlen(value) + 1);
+        rel_stats.cs_collapsed++;
+        return qtrue;
+    }
+    if (rel_cs_waiting >= RELIABLE_CS_PENDING) {
+        return qfalse;
+    }
+    for (short i = 0; i < RELIABLE_CS_PENDING; i++) {
+        if (rel_cs[i].index < 0) {
+            rel_cs[i].index = index;
+            rel_cs[i].frame = rel_frame;
+            rel_cs[i].order = rel_cs_order++;
+            snprintf(rel_cs[i].value, sizeof(rel_cs[i].value), "%s", value);
+            rel_cs_at[index] = i;
+            rel_cs_waiting++;
+            return qtrue;
+        }
+    }
+    return qfalse;
+}
+
+const char* Reliable_PendingConfigstring(int index) {
+    if (index < 0 || index >= MAX_CONFIGSTRINGS || !rel_arena_ready || rel_cs_at[index] < 0) {
+        return NULL;
+    }
+    return rel_cs[rel_cs_at[index]].value;
+}
+
+// Whether every client a configstring goes to has room for it. The engine sends one to each client
+// from CS_PRIMED up, so the whole set is the audience; a client past its watermark holds every
+// pending write until it catches up or RELIABLE_MAX_HOLD runs out.
+static qboolean cs_room(void) {
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        const client_t* cl = &svs->clients[i];
+        if (cl->state >= CS_PRIMED && backlog_of(cl) >= client_watermark(i)) {
+            return qfalse;
+        }
+    }
+    return qtrue;
+}
 
-    while (rel_count > 0 && budget > 0) {
-        rel_entry_t* head = &rel_queue[rel_head];
-        if (paced && backlog_for(head->slot, head->cmd, NULL) >= watermark() &&
-            (rel_frame - head->frame) < RELIABLE_MAX_HOLD) {
-            break; // still too deep; try again next frame
+// Releases due configstrings, oldest first, up to a burst per frame.
+static void cs_flush(void) {
+    qboolean paced = enabled();
+    int window     = cs_window();
+    int budget     = burst();
+    while (rel_cs_waiting > 0 && (!paced || budget > 0)) {
+        short oldest = -1;
+        for (short i = 0; i < RELIABLE_CS_PENDING; i++) {
+            if (rel_cs[i].index >= 0 && (oldest < 0 || (int)(rel_cs[i].order - rel_cs[oldest].order) < 0)) {
+                oldest = i;
+            }
+        }
+        unsigned age = rel_frame - rel_cs[oldest].frame;
+        if (paced && (age < (unsigned)window || (!cs_room() && age < RELIABLE_MAX_HOLD))) {
+            return;
         }
 
-        // Off the queue before anything else can run, and by value. send_now below reaches
-        // Com_Printf, which is hooked, so a console_print handler can queue more or drop a
-        // client, and Reliable_ClientGone then compacts this queue. Advancing the head afterwards
-        // would be advancing past an entry already compacted away. See reliable.h.
-        rel_entry_t entry = *head;
-        rel_head          = (rel_head + 1) % RELIABLE_QUEUE;
-        rel_count--;
+        // By value and off the table first. The engine's "cs" reaches My_SV_SendServerCommand,
+        // whose server_command handlers can write configstrings of their own.
+        int index = rel_cs[oldest].index;
+        char value[RELIABLE_CS_VALUE];
+        memcpy(value, rel_cs[oldest].value, sizeof(value));
+        cs_drop(oldest);
         budget--;
 
-        const char* text = entry.cmd;
-        const char* p;
-        size_t plen, used = 0;
-
-        // Fold as many consecutive broadcast prints as fit into one command. Only
-        // newline-terminated payloads are merged, so no two lines are ever run together.
-        // Nothing here can re-enter, so the queue is still ours to walk.
-        if (entry.slot == -1 && print_payload(entry.cmd, &p, &plen) && plen <= PRINT_PAYLOAD_MAX) {
-            memcpy(payload, p, plen);
-            used = plen;
-            while (used && payload[used - 1] == '\n' && rel_count > 0) {
-                rel_entry_t* next = &rel_queue[rel_head];
-                if (next->slot != -1 || !print_payload(next->cmd, &p, &plen) || used + plen > PRINT_PAYLOAD_MAX) {
-                    break;
+        // The real one: the set_configstring event fired when the plugin made the write.
+        SV_SetConfigstring(index, value);
+    }
+}
+
+// Records the frame's backlog for one client. The byte it overwrites drops out of the running
+// counts first, so the report never has to walk the ring.
+static void history_sample(int slot, const client_t* cl) {
+    rel_history_t* h = &rel_history[slot];
+    if (cl->state < CS_PRIMED) {
+        h->samples = h->near = h->total = 0;
+        return;
+    }
+    unsigned at = rel_frame % RELIABLE_HISTORY;
+    if (h->samples == RELIABLE_HISTORY) {
+        h->total -= h->backlog[at];
+        h->near -= h->backlog[at] >= RELIABLE_NEAR;
+    } else {
+        h->samples++;
+    }
+    int b          = backlog_of(cl);
+    h->backlog[at] = (unsigned char)(b < 0 ? 0 : (b > 255 ? 255 : b));
+    h->total += h->backlog[at];
+    h->near += h->backlog[at] >= RELIABLE_NEAR;
+}
+
+void Reliable_Flush(void) {
+    rel_frame++;
+    // No dispatch is running here, so no bracket can be open. One still counted was left by a
+    // caller that never closed it, and would hold every print for the rest of the map.
+    rel_merge = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        rel_queues[i].sent = 0;
+    }
+    if (svs && svs->clients && sv_maxclients) {
+        // Kept with the guard off too: the trend is what tells you whether to turn it on.
+        for (int i = 0; i < sv_maxclients->integer; i++) {
+            history_sample(i, &svs->clients[i]);
+        }
+    }
+    if (enabled() && adaptive()) {
+        for (int i = 0; i < sv_maxclients->integer; i++) {
+            pace_update(i, &svs->clients[i]);
+        }
+    }
+    if (rel_cs_waiting) {
+        cs_flush();
+    }
+    if (!rel_waiting) {
+        return;
+    }
+
+    // Turned off mid-match with output still held. Hand it all back so nothing strands.
+    qboolean paced = enabled();
+    int budget     = paced ? RELIABLE_FRAME_MAX : rel_waiting;
+    int n          = clients();
+    int first      = rel_cursor % n;
+
+    // Round robin, one command per client per pass, so every client with something due gets its
+    // turn before anyone gets a second. Whoever the frame's budget ran out on goes first next
+    // frame; otherwise the first turn just rotates.
+    rel_cursor = (first + 1) % n;
+    for (qboolean progress = qtrue; progress && budget > 0 && rel_waiting > 0;) {
+        progress = qfalse;
+        for (int k = 0; k < n && budget > 0; k++) {
+            int slot = (first + k) % n;
+            if (release_one(slot, paced)) {
+                progress = qtrue;
+                if (!--budget) {
+                    rel_cursor = (slot + 1) % n;
                 }
-                memcpy(payload + used, p, plen);
-                used += plen;
-                rel_head = (rel_head + 1) % RELIABLE_QUEUE;
-                rel_count--;
-                rel_stats.merged++;
             }
-            payload[used] = '\0';
-            snprintf(batch, sizeof(batch), "print \"%s\"\n", payload);
-            text = batch;
         }
+    }
+}
+
+void Reliable_BeginPluginSend(void) {
+    rel_plugin++;
+}
+
+void Reliable_EndPluginSend(void) {
+    if (rel_plugin > 0) {
+        rel_plugin--;
+    }
+}
+
+int Reliable_SuspendPluginSend(void) {
+    int depth  = rel_plugin;
+    rel_plugin = 0;
+    return depth;
+}
+
+void Reliable_ResumePluginSend(int depth) {
+    rel_plugin = depth;
+}
+
+void Reliable_BeginMergeablePrints(void) {
+    rel_merge++;
+}
 
-        send_now(entry.slot, text);
+void Reliable_EndMergeablePrints(void) {
+    if (rel_merge > 0) {
+        rel_merge--;
     }
 }
 
+int Reliable_MergeablePrintsDepth(void) {
+    return rel_merge;
+}
+
+void Reliable_RestoreMergeablePrints(int depth) {
+    rel_merge = depth;
+}
+
 void Reliable_ClientGone(int slot) {
-    if (!rel_count) {
+    if (slot < 0 || slot >= MAX_CLIENTS || !rel_arena_ready) {
         return;
     }
-    // Compact in place; broadcasts and other clients' commands keep their order.
-    int kept = 0;
-    for (int i = 0; i < rel_count; i++) {
-        rel_entry_t* src = &rel_queue[(rel_head + i) % RELIABLE_QUEUE];
-        if (src->slot == slot) {
-            continue;
-        }
-        rel_entry_t* dst = &rel_queue[(rel_head + kept) % RELIABLE_QUEUE];
-        if (dst != src) {
-            *dst = *src;
+    // Their queue only; broadcasts already fanned out to everyone else stay where they are.
+    rel_queue_t* q = &rel_queues[slot];
+    for (int c = 0; c < REL_CLASSES; c++) {
+        while (q->head[c] >= 0) {
+            queue_pop(q, (rel_class_t)c, NULL);
         }
-        kept++;
     }
-    rel_count = kept;
+    q->sent              = 0;
+    rel_pace[slot].live = qfalse; // whoever takes the slot next is measured afresh
+    rel_history[slot].samples = rel_history[slot].near = rel_history[slot].total = 0;
 }
 
 void Reliable_Reset(void) {
-    rel_head = rel_count = rel_sent_this_frame = 0;
+    arena_reset();
+    rel_merge = 0;
+    memset(rel_pace, 0, sizeof(rel_pace));
+    memset(rel_history, 0, sizeof(rel_history));
     rel_warned = 0;
     memset(&rel_stats, 0, sizeof(rel_stats));
     rel_stats.worst_slot = -1;
@@ -346,10 +953,14 @@ void Reliable_Status(reliable_status_t* out) {
     out->enabled       = enabled() == qtrue;
     out->watermark     = watermark();
     out->burst         = burst();
-    out->waiting       = rel_count;
+    out->waiting       = rel_waiting;
     out->queued        = rel_stats.queued;
     out->merged        = rel_stats.merged;
     out->bypassed      = rel_stats.bypassed;
+    out->coalesced     = rel_stats.coalesced;
+    out->shed          = rel_stats.shed;
+    out->cs_waiting    = rel_cs_waiting;
+    out->cs_collapsed  = rel_stats.cs_collapsed;
     // The chat variant of the delivery filter, the most inclusive one, so the number
     // is honest for the widest audience a plugin can address.
     out->backlog       = backlog_for(-1, "chat", NULL);
@@ -357,23 +968,52 @@ void Reliable_Status(reliable_status_t* out) {
     out->worst_slot    = rel_stats.worst_slot;
 }
 
+int Reliable_History(int slot, unsigned char* out, int max) {
+    if (slot < 0 || slot >= MAX_CLIENTS || !out || max <= 0) {
+        return 0;
+    }
+    const rel_history_t* h = &rel_history[slot];
+    int n                  = h->samples < max ? h->samples : max;
+    // The newest n, oldest first. The newest sits at rel_frame's own position.
+    for (int k = 0; k < n; k++) {
+        out[k] = h->backlog[(rel_frame - (unsigned)(n - 1 - k)) % RELIABLE_HISTORY];
+    }
+    return n;
+}
+
 void Reliable_Report(void) {
-    ENGINE_PRINTF("Reliable command guard: %s, watermark %d of %d, burst %d/frame.\n",
-               (qlx_reliableGuard && qlx_reliableGuard->integer) ? "on" : "off", watermark(), RELIABLE_RING, burst());
+    ENGINE_PRINTF("Reliable command guard: %s, watermark %d of %d, burst %d per client per frame%s.\n",
+               (qlx_reliableGuard && qlx_reliableGuard->integer) ? "on" : "off", watermark(), RELIABLE_RING, burst(),
+               adaptive() ? ", adapted per client below that" : "");
     ENGINE_PRINTF("Since the last map: %u queued, %u merged into a batch, %u sent unpaced. "
                "Deepest backlog %d (client %d).\n",
                rel_stats.queued, rel_stats.merged, rel_stats.bypassed, rel_stats.worst_backlog, rel_stats.worst_slot);
-    ENGINE_PRINTF("Waiting now: %d.\n", rel_count);
+    ENGINE_PRINTF("Under pressure: %u replaced by a newer center print or dropped as a repeat, %u plugin "
+               "messages shed for room.\n",
+               rel_stats.coalesced, rel_stats.shed);
+    ENGINE_PRINTF("Plugin configstring writes: held %d frame(s), %u overtaken by a later write to the same "
+               "index.\n",
+               cs_window(), rel_stats.cs_collapsed);
+    ENGINE_PRINTF("Waiting now: %d of %d arena entries, %d of %d configstrings.\n", rel_waiting, RELIABLE_ARENA,
+               rel_cs_waiting, RELIABLE_CS_PENDING);
 
     if (!svs || !svs->clients || !sv_maxclients) {
         return;
     }
-    ENGINE_PRINTF("slot  state  backlog  name\n");
+    int fps = cvar_clamped(sv_fps, 40, 1, 1000);
+    // avg and near% cover the last RELIABLE_HISTORY frames, or as many as the client has been
+    // primed for: a client that keeps showing up near the ring is one to look at, whatever its
+    // backlog happens to be this frame.
+    ENGINE_PRINTF("slot  state  backlog  avg  near%%  queued  window  burst  acks/s  name\n");
     for (int i = 0; i < sv_maxclients->integer; i++) {
-        const client_t* cl = &svs->clients[i];
+        const client_t* cl     = &svs->clients[i];
+        const rel_history_t* h = &rel_history[i];
         if (cl->state == CS_FREE) {
             continue;
         }
-        ENGINE_PRINTF("%4d  %5d  %7d  %s\n", i, cl->state, backlog_of(cl), cl->name);
+        ENGINE_PRINTF("%4d  %5d  %7d  %3d  %5d  %6d  %6d  %5d  %6d  %s\n", i, cl->state, backlog_of(cl),
+                   h->samples ? h->total / h->samples : 0, h->samples ? h->near * 100 / h->samples : 0,
+                   rel_queues[i].count, client_watermark(i), client_burst(i),
+                   rel_pace[i].live ? rel_pace[i].rate_x16 * fps / 16 : 0, cl->name);
     }
 }
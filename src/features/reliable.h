@@ -28,9 +28,25 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  * before it reaches the snapshot an older one was attached to.
  *
  * This sits in My_SV_SendServerCommand, spreading a burst over several frames and merging
- * consecutive broadcast prints into as few commands as the engine's 1022-character limit allows.
- * Commands the client's state machine depends on are never touched, configstrings included, so a
- * configstring flood is the one burst this cannot pace. "qlx_reliable" can only measure it.
+ * consecutive queued prints into as few commands as the engine's 1022-character limit allows.
+ * Each client has its own queue, drawn from a fixed arena, and the flush serves them round robin.
+ * A broadcast goes out as one engine call while every receiving client can take it. Otherwise it
+ * is split per client, so one client whose acknowledge has stalled holds back only its own output.
+ * Within a client's queue, game prints go before chat, chat before center prints, and those before
+ * what plugins send. A queued center print is replaced by a newer one of the same kind, and a print
+ * identical to the one queued just before it is dropped. A full queue sheds its lowest class
+ * first, and plugin prints and sounds that still find no room are dropped, not sent unpaced.
+ *
+ * With qlx_reliableAdaptive on (off by default), each client's window and burst start from
+ * qlx_reliableWatermark and qlx_reliableBurst and follow its measured acknowledge rate and ping,
+ * so a LAN-quality client drains at once and a 200 ms one is paced to what it keeps up with. The
+ * watermark stays a ceiling: a window only ever shrinks below it and recovers back up to it.
+ * Commands the client's state machine depends on are never touched, configstrings included. What
+ * can be paced is a plugin's configstring writes, before the engine turns them into commands. Off
+ * by default; with qlx_reliableConfigstringWindow above 0, each is held for that many frames, a
+ * later write to the same index replaces it, and they are released oldest first, a burst per
+ * frame, while every client has room. The game module's own writes go straight out and replace
+ * any plugin value still held for that index.
  *
  * These functions re-enter each other, despite being game-thread only. Releasing a command
  * reaches Com_Printf, which is hooked, so a console_print handler runs from inside the flush and
@@ -44,6 +60,40 @@ void Reliable_Init(void); // register cvars; safe to call more than once
 // ownership of it and the caller must not send it. Game thread only, as are the rest.
 qboolean Reliable_Intercept(client_t* cl, const char* cmd);
 
+// The same command to several clients, for send_server_command_many: classified once, then each
+// recipient is sent it or has it queued as Reliable_Intercept would, all in one pass. Whatever
+// is not queued is sent here, so unlike Reliable_Intercept there is nothing left for the caller.
+void Reliable_SendMany(const int* slots, int count, const char* cmd);
+
+// Brackets a send made on a plugin's behalf, so its prints and sounds are paced as the
+// lowest class. Nests.
+void Reliable_BeginPluginSend(void);
+void Reliable_EndPluginSend(void);
+
+// Lifts the bracket for the length of an event handler, which the native that opened it may
+// have dispatched. What the handler sends brackets itself; what it has the engine or the game do
+// is theirs and goes out as such. Resume with what Suspend returned.
+int Reliable_SuspendPluginSend(void);
+void Reliable_ResumePluginSend(int depth);
+
+// Brackets prints a plugin is happy to have arrive a frame late in exchange for sharing
+// reliable slots: each print to a client inside is queued even when it could go straight out,
+// and the next flush folds it in with whatever else that client has queued. Broadcasts are not
+// held. Nests.
+void Reliable_BeginMergeablePrints(void);
+void Reliable_EndMergeablePrints(void);
+
+// The depth before an event handler ran, put back once it returns, so one that raised inside a
+// bracket or never closed it cannot leave prints held after it. Reliable_Flush clears it too.
+int Reliable_MergeablePrintsDepth(void);
+void Reliable_RestoreMergeablePrints(int depth);
+
+// Called from My_SV_SetConfigstring once the set_configstring event has run. qtrue means the write
+// is held and the caller must not make it; Reliable_Flush does, later. Until then,
+// Reliable_PendingConfigstring has the value the index is going to get, or NULL.
+qboolean Reliable_DeferConfigstring(int index, const char* value);
+const char* Reliable_PendingConfigstring(int index);
+
 void Reliable_Flush(void);          // release what is due; call once per game frame
 void Reliable_ClientGone(int slot); // forget anything still queued for that slot
 void Reliable_Reset(void);          // map change: queued output is stale, drop it
@@ -53,12 +103,16 @@ void Reliable_Report(void);         // "qlx_reliable" console output
 // worst backlog, so a plugin about to mass-message can pace itself against the ring.
 typedef struct {
     int enabled;       // the guard cvar, and the engine pointers it needs
-    int watermark;     // backlog depth where pacing starts
-    int burst;         // commands released per frame once pacing has started
-    int waiting;       // commands held in the queue right now
+    int watermark;     // backlog depth where pacing starts; each client's ceiling if adaptive
+    int burst;         // commands released per client per frame once pacing has started, likewise
+    int waiting;       // commands held across every client's queue right now
     unsigned queued;   // commands held back at least one frame, since map start
     unsigned merged;   // broadcast prints folded into a preceding batch
-    unsigned bypassed; // sent straight through, unpaced, because the queue was full
+    unsigned bypassed; // sent straight through, unpaced, because a queue was full
+    unsigned coalesced; // superseded center prints and repeated prints dropped, since map start
+    unsigned shed;      // lowest-class commands dropped from a full queue, since map start
+    int cs_waiting;         // plugin configstring writes held right now
+    unsigned cs_collapsed;  // held writes replaced by a later one to the same index, since map start
     int backlog;       // deepest live reliableSequence - reliableAcknowledge right now
     int worst_backlog; // deepest ever seen this map
     int worst_slot;    // the client that reached worst_backlog, -1 for none yet
@@ -66,4 +120,10 @@ typedef struct {
 
 void Reliable_Status(reliable_status_t* out); // game thread only, like the rest
 
+// A client's backlog, one sample per Reliable_Flush, as the frame started: the newest
+// RELIABLE_HISTORY_FRAMES at most, from when the slot last became primed. Copies the newest
+// max of them into out, oldest first, clamped to 255, and returns how many it wrote.
+#define RELIABLE_HISTORY_FRAMES 256
+int Reliable_History(int slot, unsigned char* out, int max);
+
 #endif /* RELIABLE_H */
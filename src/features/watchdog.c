@@ -0,0 +1,252 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// First, ahead of any system header: Python.h sets _POSIX_C_SOURCE and _XOPEN_SOURCE.
+#include "python/pyminqlxtended.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "watchdog.h"
+#include "workers.h"
+#include "engine/quake_common.h"
+
+/* See watchdog.h for what this catches and what it costs. */
+
+#define WATCHDOG_COOLDOWN_S 10
+#define WATCHDOG_LOG_MAX    (1024 * 1024)
+
+_Atomic(void*) watchdog_dispatch_slot;
+
+static cvar_t* qlx_frameWatchdog;
+static cvar_t* qlx_frameWatchdogPercent;
+static cvar_t* sv_fps;
+
+// Deadline and frame number, written by the game thread and waited on by the watchdog thread.
+static pthread_mutex_t wd_lock;
+static pthread_cond_t wd_cond;
+static uint32_t wd_gen;          // Frames armed so far.
+static struct timespec wd_deadline;
+static uint64_t wd_budget_ns;
+
+static _Atomic uint32_t wd_finished_gen; // Last frame that reached Watchdog_FrameEnd.
+static _Atomic uint32_t wd_capture_gen;  // Last frame the watchdog captured.
+
+// Game thread only.
+static int wd_started;
+static int wd_failed;
+static uint64_t wd_frame_start_ns;
+static unsigned long wd_game_thread;
+static char wd_log_path[512];
+
+void Watchdog_Init(void) {
+    if (!Cvar_Get) {
+        return;
+    }
+    qlx_frameWatchdog        = Cvar_Get("qlx_frameWatchdog", "0", CVAR_ARCHIVE);
+    qlx_frameWatchdogPercent = Cvar_Get("qlx_frameWatchdogPercent", "100", CVAR_ARCHIVE);
+    sv_fps                   = Cvar_FindVar("sv_fps");
+}
+
+// Not Profile_Now, which may not be on CLOCK_MONOTONIC; the deadline has to be.
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void append_log(const char* header, const char* stacks) {
+    FILE* f = fopen(wd_log_path, "a");
+    if (!f) {
+        DebugPrint("watchdog: could not open %s\n", wd_log_path);
+        return;
+    }
+
+    if (ftell(f) > WATCHDOG_LOG_MAX) {
+        fclose(f);
+        char old[sizeof(wd_log_path) + 2];
+        snprintf(old, sizeof(old), "%s.1", wd_log_path);
+        rename(wd_log_path, old);
+        if (!(f = fopen(wd_log_path, "a"))) {
+            DebugPrint("watchdog: could not reopen %s\n", wd_log_path);
+            return;
+        }
+    }
+
+    fprintf(f, "%s%s\n", header, stacks);
+    if (ferror(f) | fclose(f)) {
+        DebugPrint("watchdog: write failed on %s\n", wd_log_path);
+    }
+}
+
+// Off the game thread, which is still inside the frame that overran.
+static void capture(uint32_t gen, uint64_t budget_ns, uint64_t late_ns) {
+    // Read before taking the GIL, which the game thread may well be holding in that handler.
+    const char* dispatcher = HandlerSlotName(atomic_load_explicit(&watchdog_dispatch_slot, memory_order_relaxed));
+    uint64_t asked_ns      = monotonic_ns();
+
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    uint64_t waited_ns      = monotonic_ns() - asked_ns;
+
+    PyObject* module = PyImport_ImportModule("minqlxtended");
+    PyObject* result = NULL;
+    if (module != NULL) {
+        result = PyObject_CallMethod(module, "watchdog_stacks", "k", wd_game_thread);
+    }
+
+    const char* stacks = result ? PyUnicode_AsUTF8(result) : NULL;
+    if (!stacks) {
+        PyErr_Clear();
+        stacks = "Could not format the Python stacks.\n";
+    }
+
+    char header[512];
+    time_t now = time(NULL);
+    struct tm tm;
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm));
+    snprintf(header, sizeof(header),
+             "=== %s frame %u passed its %llu.%02llu ms budget; %llu.%02llu ms over when sampled, "
+             "%llu.%02llu ms of that waiting for the GIL. Dispatcher: %s\n",
+             stamp, gen, (unsigned long long)(budget_ns / 1000000ull),
+             (unsigned long long)((budget_ns % 1000000ull) / 10000ull),
+             (unsigned long long)((late_ns + waited_ns) / 1000000ull),
+             (unsigned long long)(((late_ns + waited_ns) % 1000000ull) / 10000ull),
+             (unsigned long long)(waited_ns / 1000000ull), (unsigned long long)((waited_ns % 1000000ull) / 10000ull),
+             dispatcher ? dispatcher : "none");
+
+    // Still holding the GIL, so the Python string stays valid while it's written.
+    append_log(header, stacks);
+
+    Py_XDECREF(result);
+    Py_XDECREF(module);
+    PyGILState_Release(gstate);
+}
+
+static void* watchdog_main(void* unused) {
+    (void)unused;
+
+    uint32_t seen          = 0;
+    uint64_t last_capture  = 0;
+
+    pthread_mutex_lock(&wd_lock);
+    for (;;) {
+        while (wd_gen == seen) {
+            pthread_cond_wait(&wd_cond, &wd_lock);
+        }
+        seen                     = wd_gen;
+        struct timespec deadline = wd_deadline;
+        uint64_t budget_ns       = wd_budget_ns;
+
+        // Woken early only by the next frame being armed, which means this one finished.
+        int rc = 0;
+        while (rc != ETIMEDOUT && wd_gen == seen) {
+            rc = pthread_cond_timedwait(&wd_cond, &wd_lock, &deadline);
+        }
+        if (wd_gen != seen || atomic_load(&wd_finished_gen) == seen) {
+            continue;
+        }
+
+        uint64_t now = monotonic_ns();
+        if (last_capture && now - last_capture < WATCHDOG_COOLDOWN_S * 1000000000ull) {
+            continue;
+        }
+        last_capture = now;
+        atomic_store(&wd_capture_gen, seen);
+
+        uint64_t deadline_ns = (uint64_t)deadline.tv_sec * 1000000000ull + (uint64_t)deadline.tv_nsec;
+        pthread_mutex_unlock(&wd_lock);
+        capture(seen, budget_ns, now - deadline_ns);
+        pthread_mutex_lock(&wd_lock);
+    }
+
+    return NULL;
+}
+
+static int start_thread(void) {
+    cvar_t* homepath = Cvar_FindVar("fs_homepath");
+    if (!homepath || !homepath->string[0] ||
+        (size_t)snprintf(wd_log_path, sizeof(wd_log_path), "%s/qlx_watchdog.log", homepath->string) >= sizeof(wd_log_path)) {
+        DebugPrint("watchdog: no usable fs_homepath to log under; watchdog disabled\n");
+        return 0;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wd_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&wd_lock, NULL);
+
+    if (Worker_Start("qlx watchdog", WORKER_TIMELY, watchdog_main, NULL)) {
+        DebugPrint("watchdog: could not start the watchdog thread; watchdog disabled\n");
+        return 0;
+    }
+
+    // What threading.get_ident() returns for this thread, so the stacks can pick it out.
+    wd_game_thread = (unsigned long)pthread_self();
+    DebugPrint("watchdog: thread started, logging to %s\n", wd_log_path);
+    return 1;
+}
+
+void Watchdog_FrameStart(void) {
+    wd_frame_start_ns = 0;
+    if (!qlx_frameWatchdog || !qlx_frameWatchdog->integer || wd_failed) {
+        return;
+    }
+    if (!wd_started) {
+        if (!start_thread()) {
+            wd_failed = 1;
+            return;
+        }
+        wd_started = 1;
+    }
+
+    uint64_t frame_ns  = 1000000000ull / (uint64_t)cvar_clamped(sv_fps, 40, 1, 1000);
+    uint64_t budget_ns = frame_ns * (uint64_t)cvar_clamped(qlx_frameWatchdogPercent, 100, 50, 1000) / 100;
+    wd_frame_start_ns  = monotonic_ns();
+    uint64_t deadline  = wd_frame_start_ns + budget_ns;
+
+    pthread_mutex_lock(&wd_lock);
+    wd_gen++;
+    wd_budget_ns        = budget_ns;
+    wd_deadline.tv_sec  = (time_t)(deadline / 1000000000ull);
+    wd_deadline.tv_nsec = (long)(deadline % 1000000000ull);
+    pthread_cond_signal(&wd_cond);
+    pthread_mutex_unlock(&wd_lock);
+}
+
+void Watchdog_FrameEnd(void) {
+    if (!wd_frame_start_ns) {
+        return;
+    }
+
+    // wd_gen only changes on this thread, so the read needs no lock.
+    atomic_store(&wd_finished_gen, wd_gen);
+    if (atomic_load(&wd_capture_gen) == wd_gen) {
+        uint64_t took_ns = monotonic_ns() - wd_frame_start_ns;
+        ENGINE_PRINTF("Frame watchdog: a frame took %llu.%02llu ms; Python stacks are in %s\n",
+                      (unsigned long long)(took_ns / 1000000ull), (unsigned long long)((took_ns % 1000000ull) / 10000ull),
+                      wd_log_path);
+    }
+}
@@ -0,0 +1,44 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdatomic.h>
+
+/*
+ * Frame budget watchdog, off unless qlx_frameWatchdog is set. My_G_RunFrame arms a deadline at
+ * qlx_frameWatchdogPercent of 1000/sv_fps milliseconds. If the frame is still running when it
+ * passes, a helper thread takes the GIL and writes every Python thread's stack, the game
+ * thread's first, to qlx_watchdog.log under fs_homepath, along with the dispatcher the game
+ * thread was inside. A stall in a handler shows up as that handler's frames; one spent waiting
+ * for the GIL shows up as the worker thread that held it.
+ *
+ * Taking the GIL costs the stalled frame up to one switch interval more, since the interpreter
+ * only hands it over between bytecodes. Captures are at most one per WATCHDOG_COOLDOWN_S, and
+ * the log rolls over to a single .1 at WATCHDOG_LOG_MAX bytes.
+ */
+
+void Watchdog_Init(void);       // register cvars
+void Watchdog_FrameStart(void); // game thread, top of My_G_RunFrame
+void Watchdog_FrameEnd(void);   // game thread, bottom of My_G_RunFrame
+
+// The handler slot CallHandlerStatus is calling, or NULL outside a dispatch. Read by the
+// watchdog thread, so published with relaxed atomics.
+extern _Atomic(void*) watchdog_dispatch_slot;
+
+#endif /* WATCHDOG_H */
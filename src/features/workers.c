@@ -0,0 +1,176 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "workers.h"
+#include "engine/quake_common.h"
+
+// From linux/ioprio.h, which not every libc ships.
+#define WORKER_IOPRIO_WHO_PROCESS 1
+#define WORKER_IOPRIO_CLASS_IDLE  3
+#define WORKER_IOPRIO_CLASS_SHIFT 13
+
+static cvar_t* qlx_workerCpus;
+static cvar_t* qlx_workerSched;
+static cvar_t* qlx_workerIdleIO;
+
+// Everything the new thread needs, read from the cvars on the game thread and handed over whole.
+typedef struct {
+    void* (*fn)(void*);
+    void* arg;
+    worker_kind_t kind;
+    char name[16];
+    int have_cpus;
+    cpu_set_t cpus;
+    int sched; // as qlx_workerSched
+    int idle_io;
+} worker_start_t;
+
+void Workers_Init(void) {
+    if (!Cvar_Get) {
+        return;
+    }
+    qlx_workerCpus   = Cvar_Get("qlx_workerCpus", "", CVAR_ARCHIVE);
+    qlx_workerSched  = Cvar_Get("qlx_workerSched", "0", CVAR_ARCHIVE);
+    qlx_workerIdleIO = Cvar_Get("qlx_workerIdleIO", "0", CVAR_ARCHIVE);
+}
+
+// "0-3,8,10-11", as taskset -c and cpuset take it. Returns 0 if it is malformed or names no CPU.
+static int worker_parse_cpus(const char* list, cpu_set_t* out) {
+    CPU_ZERO(out);
+    const char* p = list;
+    while (*p) {
+        char* end;
+        errno     = 0;
+        long from = strtol(p, &end, 10);
+        if (end == p || errno || from < 0) {
+            return 0;
+        }
+        long to = from;
+        p       = end;
+        if (*p == '-') {
+            p++;
+            to = strtol(p, &end, 10);
+            if (end == p || errno || to < from) {
+                return 0;
+            }
+            p = end;
+        }
+        if (to >= CPU_SETSIZE) {
+            return 0;
+        }
+        for (long cpu = from; cpu <= to; cpu++) {
+            CPU_SET((int)cpu, out);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return 0;
+        }
+    }
+    return CPU_COUNT(out) > 0;
+}
+
+// Runs before the worker's own code, so it is placed before it does anything.
+static void* worker_main(void* data) {
+    worker_start_t start = *(worker_start_t*)data;
+    free(data);
+
+    pthread_setname_np(pthread_self(), start.name);
+
+    int err;
+    if (start.have_cpus && (err = pthread_setaffinity_np(pthread_self(), sizeof(start.cpus), &start.cpus))) {
+        // Usually a CPU outside the cpuset the server runs in.
+        DebugPrint("%s: could not apply qlx_workerCpus (%s)\n", start.name, strerror(err));
+    }
+
+    if (start.kind != WORKER_TIMELY && start.sched) {
+        struct sched_param param = {0};
+        int policy               = start.sched == 2 && start.kind == WORKER_BACKGROUND ? SCHED_IDLE : SCHED_BATCH;
+        if ((err = pthread_setschedparam(pthread_self(), policy, &param))) {
+            DebugPrint("%s: could not apply qlx_workerSched (%s)\n", start.name, strerror(err));
+        }
+    }
+
+    if (start.kind == WORKER_BACKGROUND) {
+        // Who 0 is the calling thread, not the whole process.
+        if (start.idle_io && syscall(SYS_ioprio_set, WORKER_IOPRIO_WHO_PROCESS, 0,
+                                     WORKER_IOPRIO_CLASS_IDLE << WORKER_IOPRIO_CLASS_SHIFT)) {
+            DebugPrint("%s: could not apply qlx_workerIdleIO (%s)\n", start.name, strerror(errno));
+        }
+    }
+
+    return start.fn(start.arg);
+}
+
+int Worker_Start(const char* name, worker_kind_t kind, void* (*fn)(void*), void* arg) {
+    worker_start_t* start = calloc(1, sizeof(*start));
+    if (!start) {
+        return ENOMEM;
+    }
+    start->fn   = fn;
+    start->arg  = arg;
+    start->kind = kind;
+    snprintf(start->name, sizeof(start->name), "%s", name);
+
+    const char* cpus = qlx_workerCpus ? qlx_workerCpus->string : "";
+    if (cpus[0]) {
+        start->have_cpus = worker_parse_cpus(cpus, &start->cpus);
+        if (!start->have_cpus) {
+            DebugPrint("%s: qlx_workerCpus \"%s\" is not a CPU list like \"2-3,6\"; ignoring it\n", start->name, cpus);
+        }
+    }
+    start->sched   = qlx_workerSched ? cvar_clamped(qlx_workerSched, 0, 0, 2) : 0;
+    start->idle_io = qlx_workerIdleIO && qlx_workerIdleIO->integer;
+
+    // Inherited by the worker, which keeps the engine's asynchronous signal handling on the main
+    // thread from its first instruction. SIGSEGV, SIGBUS, SIGFPE and SIGILL stay unblocked, since
+    // blocking a fault the thread raises itself is undefined, and SIGABRT with them so the engine
+    // still prints a backtrace.
+    sigset_t all, old;
+    sigfillset(&all);
+    sigdelset(&all, SIGSEGV);
+    sigdelset(&all, SIGBUS);
+    sigdelset(&all, SIGFPE);
+    sigdelset(&all, SIGILL);
+    sigdelset(&all, SIGABRT);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    pthread_t th;
+    int err = pthread_create(&th, NULL, worker_main, start);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        free(start);
+        return err;
+    }
+    pthread_detach(th);
+    return 0;
+}
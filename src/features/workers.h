@@ -0,0 +1,54 @@
+/*
+Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <pthread.h>
+
+/*
+ * Placement of our own threads, so they stay off the core the game thread is pinned to. A thread
+ * inherits the process's affinity, so under `taskset -c 3 qzeroded` every writer would otherwise
+ * share core 3 with the frame. The qlx_worker* cvars are read as each thread starts and apply to
+ * it for its lifetime; one already running keeps what it started with.
+ *
+ *   qlx_workerCpus    CPU list for every worker, as taskset -c takes it ("2", "4-7,10"). Empty
+ *                     leaves the inherited affinity alone.
+ *   qlx_workerSched   0 normal, 1 SCHED_BATCH, 2 SCHED_IDLE.
+ *   qlx_workerIdleIO  1 puts the thread's disk I/O in the idle class. Only schedulers with I/O
+ *                     priorities (BFQ) act on it.
+ *
+ * The last two apply to WORKER_BACKGROUND threads in full. The metrics exporter answers scrapes
+ * that time out, and SCHED_IDLE on a core the frame keeps busy could starve it past that, so for
+ * it qlx_workerSched 2 means SCHED_BATCH. The watchdog has to run while the frame it is timing
+ * spins, so it takes the CPU list and nothing else.
+ */
+
+typedef enum {
+    WORKER_BACKGROUND = 0, // the writers: placement, scheduling class and I/O class
+    WORKER_SERVING,        // the exporter: placement, and SCHED_BATCH at most
+    WORKER_TIMELY,         // placement only
+} worker_kind_t;
+
+void Workers_Init(void); // register cvars
+
+// pthread_create plus the above, and pthread_detach; every worker is detached. name is at most
+// 15 characters and shows in top -H and /proc. Game thread only, since it reads the cvars.
+// Returns 0 on success, as pthread_create does.
+int Worker_Start(const char *name, worker_kind_t kind, void *(*fn)(void *), void *arg);
+
+#endif /* WORKERS_H */
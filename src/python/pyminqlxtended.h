@@ -68,6 +68,8 @@ typedef struct {
     PyObject** handler;
 } handler_t;
 extern PyObject* client_command_handler;
+/* Gated, like damage, and further narrowed by SetServerCommandFilter. The game module sends
+ * hundreds of "scores" a second on a full server. */
 extern PyObject* server_command_handler;
 extern PyObject* client_connect_handler;
 extern PyObject* client_loaded_handler;
@@ -130,11 +132,23 @@ extern int allow_free_client;
  * the game thread: a leaked error indicator survives into the next Ensure. */
 void DispatcherRelease(PyGILState_STATE gstate);
 
+// The event name behind a handler slot, or NULL if it isn't one. Any thread.
+const char* HandlerSlotName(const void* slot);
+// The reverse, for replaying a capture. NULL for an unknown name.
+PyObject** HandlerSlotByName(const char* name);
+
 /* Dispatchers, called from the hooks. Return values often decide what reaches the engine,
  * so a handler can filter chat, rewrite a userinfo command, or drop a broken UTF sequence
  * before it reaches a client. */
 char* ClientCommandDispatcher(int client_id, char* cmd);
 char* ServerCommandDispatcher(int client_id, char* cmd);
+void ServerCommandManyDispatcher(const int* ids, int count, char* cmd, char** out);
+
+/* Narrows the server_command dispatch to commands whose first word is one of these; NULL lets
+ * every command through again. qfalse if a word could not be added (empty, 32 characters or
+ * more, or the 64-word table already full), in which case everything is let through. Needs
+ * the GIL; the dispatchers read it without. */
+qboolean SetServerCommandFilter(const char* const* words, int count);
 void FrameDispatcher(void);
 char* ClientConnectDispatcher(int client_id, int is_bot);
 int ClientLoadedDispatcher(int client_id);
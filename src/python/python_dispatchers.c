@@ -17,8 +17,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <Python.h>
+#include <stdatomic.h>
 
+#include "features/capture.h"
 #include "features/profile.h"
+#include "features/reliable.h"
+#include "features/watchdog.h"
 #include "pyminqlxtended.h"
 #include "engine/quake_common.h"
 
@@ -61,8 +65,18 @@ static PyObject* CallHandlerStatus(PyObject** slot, PyObject** argv, Py_ssize_t
     }
 
     if (handler) {
-        st     = HANDLER_RAN;
-        result = PyObject_Vectorcall(handler, argv, (size_t)argc, NULL);
+        st = HANDLER_RAN;
+        if (capture_active) {
+            Capture_Event(slot, (void* const*)argv, (int)argc);
+        }
+        // Dispatches nest, so put back whichever was running rather than clearing it.
+        void* outer = atomic_exchange_explicit(&watchdog_dispatch_slot, (void*)slot, memory_order_relaxed);
+        int plugin  = Reliable_SuspendPluginSend();
+        int merge   = Reliable_MergeablePrintsDepth();
+        result      = PyObject_Vectorcall(handler, argv, (size_t)argc, NULL);
+        Reliable_RestoreMergeablePrints(merge);
+        Reliable_ResumePluginSend(plugin);
+        atomic_store_explicit(&watchdog_dispatch_slot, outer, memory_order_relaxed);
     }
 
 done:
@@ -121,7 +135,7 @@ char* ClientCommandDispatcher(int client_id, char* cmd) {
         return ret; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -160,14 +174,72 @@ char* ClientCommandDispatcher(int client_id, char* cmd) {
     return ret;
 }
 
+/* server_command's prefix filter: the first words the event's hooks asked for, or everything.
+ * Written under the GIL from whichever thread changed the hooks, and read without it by every
+ * server command, so it is built to be read lock-free. A word, once in the table, is never
+ * changed or removed, and which of them are wanted is one atomic mask published after the word
+ * is in place. A reader racing a change sees the old set or the new one, and the Python side
+ * filters each handler again anyway. */
+#define SCMD_FILTER_WORDS 64
+#define SCMD_FILTER_LEN   32
+static char scmd_words[SCMD_FILTER_WORDS][SCMD_FILTER_LEN];
+static int scmd_word_count; // only grows; the GIL serialises writers
+static _Atomic uint64_t scmd_wanted;
+static atomic_int scmd_filtering;
+
+qboolean SetServerCommandFilter(const char* const* words, int count) {
+    uint64_t wanted = 0;
+    for (int i = 0; words && i < count; i++) {
+        int k = 0;
+        while (k < scmd_word_count && strcmp(scmd_words[k], words[i])) {
+            k++;
+        }
+        if (k == scmd_word_count) {
+            size_t len = strlen(words[i]);
+            if (k == SCMD_FILTER_WORDS || !len || len >= SCMD_FILTER_LEN) {
+                // No bit for it. Everything goes through, as with no filter at all.
+                atomic_store_explicit(&scmd_filtering, 0, memory_order_release);
+                return qfalse;
+            }
+            memcpy(scmd_words[k], words[i], len + 1);
+            scmd_word_count++;
+        }
+        wanted |= UINT64_C(1) << k;
+    }
+
+    if (!words) {
+        atomic_store_explicit(&scmd_filtering, 0, memory_order_release);
+        return qtrue;
+    }
+    atomic_store_explicit(&scmd_wanted, wanted, memory_order_release);
+    atomic_store_explicit(&scmd_filtering, 1, memory_order_release);
+    return qtrue;
+}
+
+// Whether any server_command hook wants this command, judged on its first word alone.
+static qboolean ServerCommandWanted(const char* cmd) {
+    if (!atomic_load_explicit(&scmd_filtering, memory_order_acquire)) {
+        return qtrue;
+    }
+    uint64_t wanted = atomic_load_explicit(&scmd_wanted, memory_order_acquire);
+    for (int k = 0; wanted; k++, wanted >>= 1) {
+        if ((wanted & 1) && cmd_word_is(cmd, scmd_words[k])) {
+            return qtrue;
+        }
+    }
+    return qfalse;
+}
+
 char* ServerCommandDispatcher(int client_id, char* cmd) {
     char* ret = cmd;
     static char scmd_buf[4096];
-    if (!server_command_handler) {
-        return ret; // No registered handler.
+    // Gated, and filtered on the first word, so a scoreboard update nothing asked for never
+    // reaches the GIL, let alone becomes a Python str.
+    if (!server_command_handler || !ServerCommandWanted(cmd)) {
+        return ret;
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -206,12 +278,73 @@ char* ServerCommandDispatcher(int client_id, char* cmd) {
     return ret;
 }
 
+// The server_command event for one command going to several clients, in a single call into
+// Python: the handler gets the recipients as a tuple of client ids. out[i] receives what goes to
+// ids[i]: cmd itself, a replacement, or NULL for nothing. Python answers with one str or False for
+// everyone, or a list with one per recipient.
+void ServerCommandManyDispatcher(const int* ids, int count, char* cmd, char** out) {
+    static char scmd_many_buf[MAX_CLIENTS][4096];
+    for (int i = 0; i < count; i++) {
+        out[i] = cmd;
+    }
+    if (!server_command_handler || count < 1 || !ServerCommandWanted(cmd)) {
+        return; // No registered handler, or none that wants this command.
+    }
+
+    PROF_GIL_BEGIN(t_gil);
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    PROF_END(PROF_GIL_WAIT, t_gil);
+    PROF_BEGIN(t_work);
+
+    PyObject* recipients = PyTuple_New(count);
+    for (int i = 0; recipients && i < count; i++) {
+        PyTuple_SET_ITEM(recipients, i, PyLong_FromLong(ids[i]));
+    }
+    PyObject* argv[]  = {recipients, FromEngine(cmd)};
+    PyObject* result  = CallHandler(&server_command_handler, argv, 2);
+
+    if (result == NULL) {
+        DebugError("CallHandler() returned NULL.\n",
+                   __FILE__, __LINE__, __func__);
+    } else if (PyBool_Check(result) && result == Py_False) {
+        for (int i = 0; i < count; i++) {
+            out[i] = NULL;
+        }
+    } else if (PyList_Check(result) && PyList_GET_SIZE(result) == count) {
+        for (int i = 0; i < count; i++) {
+            PyObject* r = PyList_GET_ITEM(result, i);
+            Py_ssize_t len;
+            const char* s;
+            if (r == Py_False) {
+                out[i] = NULL;
+            } else if (PyUnicode_Check(r) && (s = PyUnicode_AsUTF8AndSize(r, &len)) != NULL &&
+                       ((size_t)len != strlen(cmd) || memcmp(s, cmd, (size_t)len))) {
+                out[i] = CopyReplacement(scmd_many_buf[i], sizeof(scmd_many_buf[i]), s, len, "server_command");
+            }
+        }
+    } else if (PyUnicode_Check(result)) {
+        Py_ssize_t len;
+        const char* s = PyUnicode_AsUTF8AndSize(result, &len);
+        if (s && ((size_t)len != strlen(cmd) || memcmp(s, cmd, (size_t)len))) {
+            char* copy = CopyReplacement(scmd_many_buf[0], sizeof(scmd_many_buf[0]), s, len, "server_command");
+            for (int i = 0; i < count; i++) {
+                out[i] = copy;
+            }
+        }
+    }
+
+    Py_XDECREF(result);
+
+    PROF_END(PROF_SERVER_COMMAND, t_work);
+    DispatcherRelease(gstate);
+}
+
 void FrameDispatcher(void) {
     if (!frame_handler) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -235,7 +368,7 @@ char* ClientConnectDispatcher(int client_id, int is_bot) {
         return ret; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -274,7 +407,7 @@ void ClientDisconnectDispatcher(int client_id, const char* reason) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -309,7 +442,7 @@ int ClientLoadedDispatcher(int client_id) {
         return ret; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -341,7 +474,7 @@ void SpawnServerDispatcher(void) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
 
@@ -361,7 +494,7 @@ void NewGameDispatcher(int restart) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -389,7 +522,7 @@ char* SetConfigstringDispatcher(int index, char* value) {
         return ret; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -431,7 +564,7 @@ void RconDispatcher(const char* cmd) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -458,7 +591,7 @@ char* ConsolePrintDispatcher(char* text) {
         return ret; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -500,7 +633,7 @@ void ClientSpawnDispatcher(int client_id) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -525,7 +658,7 @@ void KamikazeUseDispatcher(int client_id) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -550,7 +683,7 @@ void KamikazeExplodeDispatcher(int client_id, int is_used_on_demand) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -578,7 +711,7 @@ void DemoFinishedDispatcher(int client_id, const char* path, long bytes, int dis
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -612,7 +745,7 @@ void PlayerDeathDispatcher(int victim_id, int killer_id, int mod) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -639,7 +772,7 @@ void RoundCountdownDispatcher(int round_number) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -664,7 +797,7 @@ void RoundStartDispatcher(int round_number) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -689,7 +822,7 @@ void RoundEndDispatcher(int round_number, int winning_team, int time_ms) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -716,7 +849,7 @@ void GameCountdownDispatcher(void) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -738,7 +871,7 @@ void GameStartDispatcher(void) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -760,7 +893,7 @@ void GameEndDispatcher(int aborted) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -786,7 +919,7 @@ int TeamSwitchDispatcher(int client_id, int old_team, int new_team) {
         return ret; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -816,7 +949,7 @@ void ItemPickupDispatcher(int client_id, const char* item_name) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -845,7 +978,7 @@ int VoteCalledDispatcher(int client_id, const char* vote, const char* args) {
         return ret; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -884,7 +1017,7 @@ void VoteStartedDispatcher(int caller_id, const char* vote_string) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -910,7 +1043,7 @@ void VoteEndedDispatcher(int passed, const char* vote_string, int yes, int no) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -939,7 +1072,7 @@ int ChatDispatcher(int client_id, int target_id, int mode, const char* text) {
         return ret;
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -973,7 +1106,7 @@ int TeamSwitchAttemptDispatcher(int client_id, int old_team, const char* target)
         return ret;
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -1010,7 +1143,7 @@ void WeaponFiredDispatcher(int client_id, int weapon) {
         return; // Nothing has hooked the event.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -1037,7 +1170,7 @@ int UserinfoDispatcher(int client_id, const char* infostring, char* out, size_t
         return ret;
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -1088,7 +1221,7 @@ void ObjectiveDispatcher(int client_id, int kind, int count) {
         return; // No registered handler.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -1119,7 +1252,7 @@ void DamageDispatcher(int target_id, int attacker_id, int damage, int dflags, in
         return; // Nothing has hooked the event.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -1152,7 +1285,7 @@ void CvarChangedDispatcher(const char* name, const char* old_value, const char*
         return; // Nothing has hooked the event.
     }
 
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
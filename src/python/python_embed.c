@@ -30,6 +30,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "engine/quake_common.h"
 #include "features/console_command.h"
 #include "features/demos.h"
+#include "features/metrics.h"
+#include "features/profile.h"
 #include "features/reliable.h"
 #include "pyminqlxtended.h"
 #include "python_objects.h"
@@ -138,6 +140,33 @@ static handler_t handlers[] = {
 
     {NULL, NULL}};
 
+// The event a handler slot belongs to, or NULL. For the frame watchdog, which only has the
+// slot pointer CallHandlerStatus published. The table is never written after startup, so
+// this is safe off the game thread.
+const char* HandlerSlotName(const void* slot) {
+    if (!slot) {
+        return NULL;
+    }
+    for (handler_t* h = handlers; h->name; h++) {
+        if ((const void*)h->handler == slot) {
+            return h->name;
+        }
+    }
+
+    return NULL;
+}
+
+// The handler slot for an event name, or NULL. For the capture replay in src/bench.
+PyObject** HandlerSlotByName(const char* name) {
+    for (handler_t* h = handlers; h->name; h++) {
+        if (!strcmp(h->name, name)) {
+            return h->handler;
+        }
+    }
+
+    return NULL;
+}
+
 // Struct Sequences
 
 // Players
@@ -300,14 +329,18 @@ static PyTypeObject reliable_status_type = {0};
 static PyStructSequence_Field reliable_status_fields[] = {
     {"enabled", "Whether the reliable command guard is pacing at all."},
     {"watermark", "The backlog depth where pacing starts."},
-    {"burst", "Commands released per frame once pacing has started."},
-    {"waiting", "Commands held in the pacing queue right now."},
+    {"burst", "Commands released per client per frame once pacing has started."},
+    {"waiting", "Commands held in the per-client pacing queues right now."},
     {"queued", "Commands held back at least one frame since the map started."},
     {"merged", "Broadcast prints folded into a preceding batch since the map started."},
-    {"bypassed", "Commands sent unpaced because the queue was full."},
+    {"bypassed", "Commands sent unpaced because a client's queue was full."},
     {"backlog", "The deepest live per-client backlog right now, out of the 64-slot ring."},
     {"worst_backlog", "The deepest backlog seen this map."},
     {"worst_slot", "The client that reached worst_backlog, or -1 for none yet."},
+    {"coalesced", "Center prints replaced by a newer one, and repeated prints dropped, since the map started."},
+    {"shed", "Plugin messages dropped from a full queue since the map started."},
+    {"cs_waiting", "Plugin configstring writes held for pacing right now."},
+    {"cs_collapsed", "Held configstring writes replaced by a later one to the same index since the map started."},
     {NULL}};
 
 static PyStructSequence_Desc reliable_status_desc = {
@@ -316,6 +349,40 @@ static PyStructSequence_Desc reliable_status_desc = {
     reliable_status_fields,
     (sizeof(reliable_status_fields) / sizeof(PyStructSequence_Field)) - 1};
 
+// qlx_prof figures, from profile.c. One ProfileProbe per prof_id_t, in the same order.
+static PyTypeObject profile_probe_type = {0};
+
+static PyStructSequence_Field profile_probe_fields[] = {
+    {"name", "The probe's name, as qlx_prof prints it."},
+    {"count", "Samples taken."},
+    {"total_ns", "Time summed across every sample, in nanoseconds."},
+    {"max_ns", "The slowest sample."},
+    {"p50_ns", "Median sample, as the top of its histogram bucket."},
+    {"p90_ns", "90th percentile sample."},
+    {"p99_ns", "99th percentile sample."},
+    {"p999_ns", "99.9th percentile sample."},
+    {NULL}};
+
+static PyStructSequence_Desc profile_probe_desc = {
+    "ProfileProbe",
+    "One qlx_prof probe's latency figures.",
+    profile_probe_fields,
+    (sizeof(profile_probe_fields) / sizeof(PyStructSequence_Field)) - 1};
+
+static PyTypeObject profile_status_type = {0};
+
+static PyStructSequence_Field profile_status_fields[] = {
+    {"enabled", "Whether the profiler is sampling right now."},
+    {"elapsed_ns", "Time spent sampling since the last reset."},
+    {"probes", "A tuple of ProfileProbe, one per probe, including those with no samples."},
+    {NULL}};
+
+static PyStructSequence_Desc profile_status_desc = {
+    "ProfileStatus",
+    "A snapshot of the qlx_prof profiler.",
+    profile_status_fields,
+    (sizeof(profile_status_fields) / sizeof(PyStructSequence_Field)) - 1};
+
 // Indexed straight by powerup_t. Not the Powerups sequence, which covers only
 // PW_QUAD..PW_INVULNERABILITY and skips PW_FLIGHT.
 static PyTypeObject stat_powerups_type = {0};
@@ -694,7 +761,9 @@ static PyObject* PyMinqlxtended_SendServerCommand(PyObject* self, PyObject* args
     }
 
     if (client_id == Py_None) {
+        Reliable_BeginPluginSend();
         My_SV_SendServerCommand(NULL, "%s\n", cmd); // Send to all.
+        Reliable_EndPluginSend();
         Py_RETURN_TRUE;
     }
 
@@ -716,10 +785,97 @@ static PyObject* PyMinqlxtended_SendServerCommand(PyObject* self, PyObject* args
         Py_RETURN_FALSE;
     }
 
+    Reliable_BeginPluginSend();
     My_SV_SendServerCommand(&svs->clients[i], "%s\n", cmd);
+    Reliable_EndPluginSend();
     Py_RETURN_TRUE;
 }
 
+// begin_mergeable_prints, end_mergeable_prints
+
+static PyObject* PyMinqlxtended_BeginMergeablePrints(PyObject* self, PyObject* args) {
+    if (!qlx_on_game_thread("begin_mergeable_prints()")) {
+        return NULL;
+    }
+    Reliable_BeginMergeablePrints();
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyMinqlxtended_EndMergeablePrints(PyObject* self, PyObject* args) {
+    if (!qlx_on_game_thread("end_mergeable_prints()")) {
+        return NULL;
+    }
+    Reliable_EndMergeablePrints();
+    Py_RETURN_NONE;
+}
+
+// send_server_command_many
+
+static PyObject* PyMinqlxtended_SendServerCommandMany(PyObject* self, PyObject* args) {
+    PyObject* client_ids;
+    char* cmd;
+    if (!PyArg_ParseTuple(args, "Os:send_server_command_many", &client_ids, &cmd)) {
+        return NULL;
+    }
+
+    PyObject* seq = PySequence_Fast(client_ids, "client_ids must be a sequence of ints.");
+    if (!seq) {
+        return NULL;
+    }
+
+    // Validated whole before anything is sent, so a bad id sends nothing. Inactive clients
+    // are skipped, as send_server_command returns False for them, and repeats go once.
+    int ids[MAX_CLIENTS], count = 0;
+    qboolean seen[MAX_CLIENTS] = {qfalse};
+    for (Py_ssize_t k = 0; k < PySequence_Fast_GET_SIZE(seq); k++) {
+        PyObject* item = PySequence_Fast_GET_ITEM(seq, k);
+        int i;
+        if (!PyLong_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "client_ids must be a sequence of ints.");
+            Py_DECREF(seq);
+            return NULL;
+        }
+        if (!qlx_as_int(item, &i, "client_id") || !qlx_valid_client_id(i)) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+        if (svs->clients[i].state == CS_ACTIVE && !seen[i]) {
+            seen[i]       = qtrue;
+            ids[count++] = i;
+        }
+    }
+    Py_DECREF(seq);
+
+    if (count) {
+        char buffer[MAX_MSGLEN];
+        snprintf(buffer, sizeof(buffer), "%s\n", cmd);
+
+        // One dispatch for the set. Each distinct result then goes to the guard in one pass.
+        char* out[MAX_CLIENTS];
+        int slots[MAX_CLIENTS];
+        ServerCommandManyDispatcher(ids, count, buffer, out);
+        Reliable_BeginPluginSend();
+        for (int i = 0; i < count; i++) {
+            if (!out[i]) {
+                continue;
+            }
+            int n = 0;
+            for (int j = i; j < count; j++) {
+                if (out[j] == out[i]) {
+                    slots[n++] = ids[j];
+                    if (j != i) {
+                        out[j] = NULL; // sent with this group
+                    }
+                }
+            }
+            Reliable_SendMany(slots, n, out[i]);
+        }
+        Reliable_EndPluginSend();
+    }
+
+    return PyLong_FromLong(count);
+}
+
 // client_command
 
 static PyObject* PyMinqlxtended_ClientCommand(PyObject* self, PyObject* args) {
@@ -909,6 +1065,12 @@ static PyObject* PyMinqlxtended_GetConfigstring(PyObject* self, PyObject* args)
         return NULL;
     }
 
+    // A write the reliable guard is still holding is the value the index is about to have.
+    const char* pending = Reliable_PendingConfigstring(i);
+    if (pending) {
+        return PyUnicode_DecodeUTF8(pending, strlen(pending), "ignore");
+    }
+
     SV_GetConfigstring(i, csbuffer, sizeof(csbuffer));
     return PyUnicode_DecodeUTF8(csbuffer, strlen(csbuffer), "ignore");
 }
@@ -929,7 +1091,9 @@ static PyObject* PyMinqlxtended_SetConfigstring(PyObject* self, PyObject* args)
         return NULL;
     }
 
+    Reliable_BeginPluginSend();
     My_SV_SetConfigstring(i, cs);
+    Reliable_EndPluginSend();
 
     Py_RETURN_NONE;
 }
@@ -1017,6 +1181,48 @@ static PyObject* PyMinqlxtended_RegisterHandler(PyObject* self, PyObject* args)
     return NULL;
 }
 
+// set_server_command_filter
+
+static PyObject* PyMinqlxtended_SetServerCommandFilter(PyObject* self, PyObject* args) {
+    PyObject* words;
+    if (!PyArg_ParseTuple(args, "O:set_server_command_filter", &words)) {
+        return NULL;
+    }
+
+    if (words == Py_None) {
+        SetServerCommandFilter(NULL, 0);
+        Py_RETURN_TRUE;
+    }
+
+    PyObject* seq = PySequence_Fast(words, "words must be a sequence of str, or None.");
+    if (!seq) {
+        return NULL;
+    }
+    const char* list[64];
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    if (n > (Py_ssize_t)(sizeof(list) / sizeof(list[0]))) {
+        // More than the table could ever hold.
+        Py_DECREF(seq);
+        SetServerCommandFilter(NULL, 0);
+        Py_RETURN_FALSE;
+    }
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject* item = PySequence_Fast_GET_ITEM(seq, i);
+        list[i]        = PyUnicode_Check(item) ? PyUnicode_AsUTF8(item) : NULL;
+        if (!list[i]) {
+            if (!PyErr_Occurred()) {
+                PyErr_SetString(PyExc_TypeError, "words must be a sequence of str, or None.");
+            }
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+
+    qboolean ok = SetServerCommandFilter(list, (int)n);
+    Py_DECREF(seq);
+    return PyBool_FromLong(ok);
+}
+
 // player_state
 
 /* Store *value* in *seq*, taking over its reference. -1 when the value is NULL, with the
@@ -2328,6 +2534,30 @@ static PyObject* PyMinqlxtended_DemoStatus(PyObject* self, PyObject* args) {
     return status;
 }
 
+// save_demo_window
+
+static PyObject* PyMinqlxtended_SaveDemoWindow(PyObject* self, PyObject* args) {
+    int client_id, seconds;
+    if (!PyArg_ParseTuple(args, "ii:save_demo_window", &client_id, &seconds)) {
+        return NULL;
+    }
+
+    if (!qlx_on_game_thread("save_demo_window()") || !qlx_valid_client_id(client_id)) {
+        return NULL;
+    }
+
+    if (seconds <= 0) {
+        PyErr_SetString(PyExc_ValueError, "seconds must be positive.");
+        return NULL;
+    }
+
+    const char* path = Demo_SaveWindow(client_id, seconds);
+    if (!path) {
+        Py_RETURN_NONE;
+    }
+    return PyUnicode_FromString(path);
+}
+
 // reliable_status
 
 static PyObject* PyMinqlxtended_ReliableStatus(PyObject* self, PyObject* args) {
@@ -2353,6 +2583,102 @@ static PyObject* PyMinqlxtended_ReliableStatus(PyObject* self, PyObject* args) {
     PyStructSequence_SetItem(status, 7, PyLong_FromLong(rs.backlog));
     PyStructSequence_SetItem(status, 8, PyLong_FromLong(rs.worst_backlog));
     PyStructSequence_SetItem(status, 9, PyLong_FromLong(rs.worst_slot));
+    PyStructSequence_SetItem(status, 10, PyLong_FromUnsignedLong(rs.coalesced));
+    PyStructSequence_SetItem(status, 11, PyLong_FromUnsignedLong(rs.shed));
+    PyStructSequence_SetItem(status, 12, PyLong_FromLong(rs.cs_waiting));
+    PyStructSequence_SetItem(status, 13, PyLong_FromUnsignedLong(rs.cs_collapsed));
+
+    return status;
+}
+
+// reliable_history
+
+static PyObject* PyMinqlxtended_ReliableHistory(PyObject* self, PyObject* args) {
+    int client_id, frames = RELIABLE_HISTORY_FRAMES;
+    if (!PyArg_ParseTuple(args, "i|i:reliable_history", &client_id, &frames)) {
+        return NULL;
+    }
+
+    if (!qlx_on_game_thread("reliable_history()") || !qlx_valid_client_id(client_id)) {
+        return NULL;
+    }
+    if (frames < 0) {
+        PyErr_SetString(PyExc_ValueError, "frames cannot be negative");
+        return NULL;
+    }
+
+    unsigned char samples[RELIABLE_HISTORY_FRAMES];
+    int n = Reliable_History(client_id, samples, frames < RELIABLE_HISTORY_FRAMES ? frames : RELIABLE_HISTORY_FRAMES);
+    return PyBytes_FromStringAndSize((const char*)samples, n);
+}
+
+// metric_add
+
+static PyObject* PyMinqlxtended_MetricAdd(PyObject* self, PyObject* args) {
+    const char* name;
+    long long delta = 1;
+
+    if (!PyArg_ParseTuple(args, "s|L:metric_add", &name, &delta)) {
+        return NULL;
+    }
+
+    int id = Metrics_Lookup(name);
+    if (id < 0) {
+        PyErr_Format(PyExc_ValueError, "no metric named '%s'", name);
+        return NULL;
+    }
+    if (delta < 0) {
+        PyErr_SetString(PyExc_ValueError, "metrics are counters and only go up.");
+        return NULL;
+    }
+
+    Metrics_Add((metric_id_t)id, (uint64_t)delta);
+    Py_RETURN_NONE;
+}
+
+// profile_status
+
+static PyObject* PyMinqlxtended_ProfileStatus(PyObject* self, PyObject* args) {
+    if (!qlx_on_game_thread("profile_status()")) {
+        return NULL;
+    }
+
+    profile_status_t ps;
+    Profile_Status(&ps);
+
+    PyObject* probes = PyTuple_New(PROF_COUNT);
+    if (probes == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < PROF_COUNT; i++) {
+        const profile_probe_t* p = &ps.probes[i];
+        PyObject* probe          = PyStructSequence_New(&profile_probe_type);
+        if (probe == NULL) {
+            Py_DECREF(probes);
+            return NULL;
+        }
+
+        PyStructSequence_SetItem(probe, 0, PyUnicode_FromString(p->name));
+        PyStructSequence_SetItem(probe, 1, PyLong_FromUnsignedLongLong(p->count));
+        PyStructSequence_SetItem(probe, 2, PyLong_FromUnsignedLongLong(p->total_ns));
+        PyStructSequence_SetItem(probe, 3, PyLong_FromUnsignedLongLong(p->max_ns));
+        PyStructSequence_SetItem(probe, 4, PyLong_FromUnsignedLongLong(p->p50_ns));
+        PyStructSequence_SetItem(probe, 5, PyLong_FromUnsignedLongLong(p->p90_ns));
+        PyStructSequence_SetItem(probe, 6, PyLong_FromUnsignedLongLong(p->p99_ns));
+        PyStructSequence_SetItem(probe, 7, PyLong_FromUnsignedLongLong(p->p999_ns));
+        PyTuple_SET_ITEM(probes, i, probe);
+    }
+
+    PyObject* status = PyStructSequence_New(&profile_status_type);
+    if (status == NULL) {
+        Py_DECREF(probes);
+        return NULL;
+    }
+
+    PyStructSequence_SetItem(status, 0, PyBool_FromLong(ps.enabled));
+    PyStructSequence_SetItem(status, 1, PyLong_FromUnsignedLongLong(ps.elapsed_ns));
+    PyStructSequence_SetItem(status, 2, probes);
 
     return status;
 }
@@ -2371,6 +2697,17 @@ static PyMethodDef minqlxtendedMethods[] = {
      "Returns a string with a player's userinfo."},
     {"send_server_command", PyMinqlxtended_SendServerCommand, METH_VARARGS,
      "Sends a server command to either one specific client or all the clients."},
+    {"begin_mergeable_prints", PyMinqlxtended_BeginMergeablePrints, METH_NOARGS,
+     "begin_mergeable_prints() -- until the matching end_mergeable_prints(), prints sent to "
+     "particular clients wait for the next frame and share reliable commands with whatever "
+     "else each client has queued.\n\n"
+     "Nests. Broadcasts are unaffected. Not exported by the package: use the "
+     "minqlxtended.mergeable_prints() context manager, which always closes what it opens."},
+    {"end_mergeable_prints", PyMinqlxtended_EndMergeablePrints, METH_NOARGS,
+     "end_mergeable_prints() -- closes the innermost begin_mergeable_prints()."},
+    {"send_server_command_many", PyMinqlxtended_SendServerCommandMany, METH_VARARGS,
+     "send_server_command_many(client_ids, cmd) -- sends one server command to several clients, "
+     "dispatching server_command once for them all. Returns how many active clients it went to."},
     {"client_command", PyMinqlxtended_ClientCommand, METH_VARARGS,
      "Tells the server to process a command from a specific client."},
     {"console_command", PyMinqlxtended_ConsoleCommand, METH_VARARGS,
@@ -2401,6 +2738,12 @@ static PyMethodDef minqlxtendedMethods[] = {
      "Adds a console command that will be handled by Python code."},
     {"register_handler", PyMinqlxtended_RegisterHandler, METH_VARARGS,
      "Register an event handler. Can be called more than once per event, but only the last one will work."},
+    {"set_server_command_filter", PyMinqlxtended_SetServerCommandFilter, METH_VARARGS,
+     "set_server_command_filter(words) -- only dispatch server commands whose first word is in "
+     "words; None dispatches them all.\n\n"
+     "Kept up to date by the server_command dispatcher from its hooks' commands=. Returns False, "
+     "and filters nothing, if a word could not be added: empty, 32 characters or longer, or past "
+     "the 64 distinct words the filter can tell apart."},
     {"entities", (PyCFunction)(void (*)(void))PyMinqlxtended_Entities,
      METH_VARARGS | METH_KEYWORDS,
      "entities(inuse=True, etype=None, start=0, stop=MAX_GENTITIES, classname=None) -- "
@@ -2457,10 +2800,27 @@ static PyMethodDef minqlxtendedMethods[] = {
      "Stops recording the player and finalises any open demo, even if sv_demoRecord is on."},
     {"demo_status", PyMinqlxtended_DemoStatus, METH_VARARGS,
      "Returns the player's demo recording state."},
+    {"save_demo_window", PyMinqlxtended_SaveDemoWindow, METH_VARARGS,
+     "save_demo_window(client_id, seconds) -- saves the last seconds of the player's replay buffer "
+     "(sv_demoReplay) as a demo. Returns the path it will have once demo_finished fires, or None if there is "
+     "nothing buffered. Anything over 1800 seconds is taken as 1800."},
     {"reliable_status", PyMinqlxtended_ReliableStatus, METH_NOARGS,
      "reliable_status() -- a ReliableStatus snapshot of the reliable command channel.\n\n"
      "The backlog field is the deepest live per-client backlog out of the 64-slot ring; "
      "a plugin about to mass-message can pace itself against it."},
+    {"reliable_history", PyMinqlxtended_ReliableHistory, METH_VARARGS,
+     "reliable_history(client_id, frames=256) -- the client's reliable backlog over its last frames, "
+     "one byte per server frame, oldest first.\n\n"
+     "Shorter than asked for if the client has not been primed that long. Each byte is the backlog "
+     "out of the 64-slot ring as that frame began, so a plugin can send on a falling trend rather "
+     "than whatever this frame's depth happens to be."},
+    {"metric_add", PyMinqlxtended_MetricAdd, METH_VARARGS,
+     "metric_add(name, delta=1) -- add to one of the counters the qlx_metricsSocket "
+     "exporter serves. Safe from any thread that holds the GIL."},
+    {"profile_status", PyMinqlxtended_ProfileStatus, METH_NOARGS,
+     "profile_status() -- a ProfileStatus snapshot of the qlx_prof probes.\n\n"
+     "Every probe is present, sampled or not. The percentiles come from a log-linear "
+     "histogram and read up to 1/16th high; all times are in nanoseconds."},
     {"drop_item", PyMinqlxtended_DropItem, METH_VARARGS,
      "drop_item(client_id, item_id, angle=0.0) -- launch a dropped copy of the item "
      "from the player, returning the new entity's id, or None if nothing spawned.\n\n"
@@ -3168,6 +3528,8 @@ static PyObject* PyMinqlxtended_InitModule(void) {
     PyStructSequence_InitType(&keys_type, &keys_desc);
     PyStructSequence_InitType(&demo_status_type, &demo_status_desc);
     PyStructSequence_InitType(&reliable_status_type, &reliable_status_desc);
+    PyStructSequence_InitType(&profile_probe_type, &profile_probe_desc);
+    PyStructSequence_InitType(&profile_status_type, &profile_status_desc);
     PyStructSequence_InitType(&stat_powerups_type, &stat_powerups_desc);
     PyStructSequence_InitType(&stat_holdables_type, &stat_holdables_desc);
     PyStructSequence_InitType(&player_expanded_stats_type, &player_expanded_stats_desc);
@@ -3187,6 +3549,8 @@ static PyObject* PyMinqlxtended_InitModule(void) {
         {&keys_type, &keys_desc},
         {&demo_status_type, &demo_status_desc},
         {&reliable_status_type, &reliable_status_desc},
+        {&profile_probe_type, &profile_probe_desc},
+        {&profile_status_type, &profile_status_desc},
         {&stat_powerups_type, &stat_powerups_desc},
         {&stat_holdables_type, &stat_holdables_desc},
         {&player_expanded_stats_type, &player_expanded_stats_desc},
@@ -3209,6 +3573,8 @@ static PyObject* PyMinqlxtended_InitModule(void) {
     Py_INCREF((PyObject*)&keys_type);
     Py_INCREF((PyObject*)&demo_status_type);
     Py_INCREF((PyObject*)&reliable_status_type);
+    Py_INCREF((PyObject*)&profile_probe_type);
+    Py_INCREF((PyObject*)&profile_status_type);
     Py_INCREF((PyObject*)&stat_powerups_type);
     Py_INCREF((PyObject*)&stat_holdables_type);
     Py_INCREF((PyObject*)&player_expanded_stats_type);
@@ -3223,6 +3589,8 @@ static PyObject* PyMinqlxtended_InitModule(void) {
     PyModule_AddObject(module, "Keys", (PyObject*)&keys_type);
     PyModule_AddObject(module, "DemoStatus", (PyObject*)&demo_status_type);
     PyModule_AddObject(module, "ReliableStatus", (PyObject*)&reliable_status_type);
+    PyModule_AddObject(module, "ProfileProbe", (PyObject*)&profile_probe_type);
+    PyModule_AddObject(module, "ProfileStatus", (PyObject*)&profile_status_type);
     PyModule_AddObject(module, "StatPowerups", (PyObject*)&stat_powerups_type);
     PyModule_AddObject(module, "StatHoldables", (PyObject*)&stat_holdables_type);
     PyModule_AddObject(module, "PlayerExpandedStats", (PyObject*)&player_expanded_stats_type);
@@ -34,6 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "common.h"
 #include "features/profile.h"
 #include "engine/quake_common.h"
+#include "features/capture.h"
 #include "features/reliable.h"
 #include "features/scoreboard.h"
 
@@ -115,6 +116,41 @@ void __cdecl StopFollowing(void) {
     ENGINE_PRINTF("Done.\n");
 }
 
+#ifndef NOPY
+// "qlx_prof plugins", which times each handler in the Python event chain. The counting is all
+// in minqlxtended._events.handler_profile; this only prints the lines it hands back.
+static void ProfilePlugins(const char* action) {
+    PyGILState_STATE gstate = PyGILState_Ensure();
+
+    PyObject* module = PyImport_ImportModule("minqlxtended");
+    PyObject* result = NULL;
+    if (module != NULL) {
+        result = PyObject_CallMethod(module, "handler_profile", "s", action);
+    }
+
+    if (result != NULL && PyList_Check(result)) {
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(result); i++) {
+            const char* line = PyUnicode_AsUTF8(PyList_GET_ITEM(result, i));
+            if (line == NULL) {
+                PyErr_Clear();
+                continue;
+            }
+            ENGINE_PRINTF("%s\n", line);
+        }
+    } else {
+        if (result != NULL) {
+            PyErr_SetString(PyExc_TypeError, "handler_profile() did not return a list");
+        }
+        // DispatcherRelease reports the exception, so say something before it goes.
+        ENGINE_PRINTF("qlx_prof plugins failed; see the log.\n");
+    }
+
+    Py_XDECREF(result);
+    Py_XDECREF(module);
+    DispatcherRelease(gstate);
+}
+#endif
+
 // Reports how long the game thread spends in everything we add to a frame. Off by
 // default. See profile.h for how to read the output.
 void __cdecl ProfileCommand(void) {
@@ -124,6 +160,12 @@ void __cdecl ProfileCommand(void) {
     }
 
     const char* arg = Cmd_Argv(1);
+#ifndef NOPY
+    if (!strcmp(arg, "plugins")) {
+        ProfilePlugins(Cmd_Argc() > 2 ? Cmd_Argv(2) : "");
+        return;
+    }
+#endif
     if (!strcmp(arg, "on")) {
         Profile_SetEnabled(1);
         ENGINE_PRINTF("Profiler on, counters reset.\n");
@@ -133,8 +175,16 @@ void __cdecl ProfileCommand(void) {
     } else if (!strcmp(arg, "reset")) {
         Profile_Reset();
         ENGINE_PRINTF("Counters reset.\n");
+    } else if (!strcmp(arg, "trace") && Cmd_Argc() > 2) {
+        Profile_TraceStart(atoi(Cmd_Argv(2)));
+    } else if (!strcmp(arg, "counters") && Cmd_Argc() > 2 && (!strcmp(Cmd_Argv(2), "on") || !strcmp(Cmd_Argv(2), "off"))) {
+        Profile_SetCounters(!strcmp(Cmd_Argv(2), "on"));
     } else {
-        ENGINE_PRINTF("Usage: %s [on|off|reset]\n", Cmd_Argv(0));
+#ifndef NOPY
+        ENGINE_PRINTF("Usage: %s [on|off|reset|trace <seconds>|counters on|off|plugins [on|off|reset]]\n", Cmd_Argv(0));
+#else
+        ENGINE_PRINTF("Usage: %s [on|off|reset|trace <seconds>|counters on|off]\n", Cmd_Argv(0));
+#endif
     }
 }
 
@@ -154,6 +204,19 @@ void __cdecl ReliableCommand(void) {
     Reliable_Report();
 }
 
+// Records every Python dispatch to a file for offline replay. See capture.h.
+void __cdecl CaptureCommand(void) {
+    if (Cmd_Argc() < 2) {
+        Capture_Report();
+    } else if (!strcmp(Cmd_Argv(1), "off")) {
+        Capture_Stop();
+    } else if (atoi(Cmd_Argv(1)) > 0) {
+        Capture_Start(atoi(Cmd_Argv(1)));
+    } else {
+        ENGINE_PRINTF("Usage: %s [<seconds>|off]\n", Cmd_Argv(0));
+    }
+}
+
 // Reports how much of the team scoreboard is being held back. See scoreboard.h.
 void __cdecl ScoreboardCommand(void) {
     if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
@@ -200,7 +263,7 @@ void __cdecl PyCommand(void) {
     if (!custom_command_handler) {
         return; // No registered handler.
     }
-    PROF_BEGIN(t_gil);
+    PROF_GIL_BEGIN(t_gil);
     PyGILState_STATE gstate = PyGILState_Ensure();
     PROF_END(PROF_GIL_WAIT, t_gil);
     PROF_BEGIN(t_work);
@@ -37,8 +37,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "engine/patterns.h"
 #include "engine/quake_common.h"
 #include "features/demos.h"
+#include "features/framestats.h"
+#include "features/metrics.h"
 #include "features/reliable.h"
 #include "features/scoreboard.h"
+#include "features/watchdog.h"
+#include "features/workers.h"
 #include "maps_parser.h"
 
 // For comparison with the dedi's executable name to avoid segfaulting
@@ -477,6 +481,7 @@ void InitializeStatic(void) {
     Cmd_AddCommand("qlx_reliable", ReliableCommand);
     Cmd_AddCommand("qlx_scoreboard", ScoreboardCommand);
     Cmd_AddCommand("qlx_pyperf", PyPerfCommand);
+    Cmd_AddCommand("qlx_capture", CaptureCommand);
     Cmd_AddCommand("qlx", PyRcon);
     Cmd_AddCommand("pycmd", PyCommand);
 #endif
@@ -528,10 +533,14 @@ void InitializeVm(void) {
 void InitializeCvars(void) {
     sv_maxclients = Cvar_FindVar("sv_maxclients");
 
-    Demo_Init(); // Register the sv_demo* cvars now.
+    Workers_Init(); // Register the qlx_worker* cvars now.
+    Demo_Init();    // ...and sv_demo*.
 #ifndef NOPY
     Reliable_Init();   // Same for qlx_reliable*.
     Scoreboard_Init(); // ...and qlx_scoreboard*.
+    Watchdog_Init();   // ...and qlx_frameWatchdog*.
+    FrameStats_Init(); // ...and qlx_frameStats.
+    Metrics_Init();    // ...and qlx_metricsSocket.
 #endif
 
     cvars_initialized = 1;
@@ -42,7 +42,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "hook/simple_hook.h"
 
 #ifndef NOPY
+#include "features/capture.h"
+#include "features/framestats.h"
 #include "features/game_events.h"
+#include "features/metrics.h"
+#include "features/watchdog.h"
 #endif
 
 // qagame module.
@@ -154,7 +158,7 @@ static void DrainFinishedDemos(void) {
 
     demo_finished_t done;
     while (Demo_PollFinished(&done)) {
-        if (done.failed) {
+        if (done.failed && !done.replay) {
             Demo_AbandonSlot(done.slot, done.gen);
         }
     }
@@ -299,6 +303,8 @@ void __cdecl My_SV_ExecuteClientCommand(client_t* cl, char* s, qboolean clientOK
     SV_ExecuteClientCommand(cl, res, clientOK);
 }
 
+// src/bench/fake_engine.c mirrors this hook, My_SV_SetConfigstring and
+// My_SV_ExecuteClientCommand for the benchmark; a change to what they check belongs there too.
 void __cdecl My_SV_SendServerCommand(client_t* cl, char* fmt, ...) {
     va_list argptr;
     char buffer[MAX_MSGLEN];
@@ -365,8 +371,8 @@ void __cdecl My_SV_SetConfigstring(int index, char* value) {
         value = "";
     }
     char* res = SetConfigstringDispatcher(index, value);
-    // NULL means stop the event.
-    if (res) {
+    // NULL means stop the event. A plugin's write may be held to collapse with later ones.
+    if (res && !Reliable_DeferConfigstring(index, res)) {
         SV_SetConfigstring(index, res);
     }
 }
@@ -420,7 +426,7 @@ static void DispatchFinishedDemos(void) {
 
     demo_finished_t done;
     while (Demo_PollFinished(&done)) {
-        if (done.failed) {
+        if (done.failed && !done.replay) {
             Demo_AbandonSlot(done.slot, done.gen);
         }
         DemoFinishedDispatcher(done.slot, done.path, done.bytes, done.discarded, done.failed);
@@ -435,6 +441,9 @@ static void DispatchFinishedDemos(void) {
 void __cdecl My_G_RunFrame(int time) {
     // Dropping frames is probably not a good idea, so we don't allow cancelling.
     PROF_BEGIN(t_frame);
+    FrameStats_FrameStart();
+    Watchdog_FrameStart();
+    Capture_Frame();
 
     if (!sv_spawning) {
         // What console_command() held back from worker threads. Before the dispatchers, so what
@@ -451,6 +460,7 @@ void __cdecl My_G_RunFrame(int time) {
 
         PROF_BEGIN(t_demos);
         DispatchFinishedDemos();
+        Demo_ReplayFrame(); // ahead of SV_SendClientMessages, which runs after us in SV_Frame
         PROF_END(PROF_DEMO_DISPATCH, t_demos);
     }
 
@@ -462,6 +472,10 @@ void __cdecl My_G_RunFrame(int time) {
         GameEvents_Frame();
     }
 
+    Watchdog_FrameEnd();
+    FrameStats_FrameEnd();
+    Metrics_Frame();
+
     // The engine's own frame is in here too, so this is what we measure the other probes
     // against. It isn't an overhead figure of its own.
     PROF_END(PROF_FRAME_TOTAL, t_frame);
@@ -494,6 +508,7 @@ static void My_player_die(gentity_t* self, gentity_t* inflictor,
     // rather than the world entity. Suicides report themselves.
     int killer_id = (attacker && attacker->client) ? (int)(attacker - g_entities) : -1;
 
+    Demo_Mark(DEMO_MARK_FRAG, level->time - level->startTime, (int)(self - g_entities), killer_id, mod);
     PlayerDeathDispatcher((int)(self - g_entities), killer_id, mod);
 }
 
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+# minqlxtended - Extends Quake Live's dedicated server with extra functionality and scripting.
+# Copyright (C) 2026 Thomas Jones <me@thomasjones.id.au>
+
+# This file is part of minqlxtended.
+
+# minqlxtended is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# minqlxtended is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with minqlxtended. If not, see <http://www.gnu.org/licenses/>.
+
+"""Expand demos recorded with sv_demoCompress back into plain .dm_91 files.
+
+    python3 tools/demo_expand.py demos/                 # every .dm_91.gz under demos/
+    python3 tools/demo_expand.py a.dm_91.gz -o out/     # elsewhere than beside the input
+    python3 tools/demo_expand.py --salvage x.dm_91.gz.salvage
+
+A finished segment is an ordinary gzip stream, so gunzip does the same job for one file. What
+this adds is the demo framing: each expanded file is checked block by block, and one that stops
+short (a segment left by a crash, or a stream cut off mid-deflate) is refused, or with --salvage
+cut back to its last whole block and given the end marker the client needs to play it.
+
+A crash leaves the segment it was recording as .part. The server's startup sweep renames those to
+.salvage under the default sv_demoCleanupParts 1, which is what --salvage looks for in a
+directory; sv_demoCleanupParts 2 removes them instead, and 0 leaves them as .part, which --salvage
+also takes.
+
+A seek index recorded beside the demo (sv_demoIndex) comes along to the expanded file. Its offsets
+already count the expanded bytes, so only the header changes, and a salvage drops the entries
+pointing past what was kept.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import zlib
+
+SUFFIX = ".dm_91.gz"
+PART = ".part"
+SALVAGE = ".salvage"
+LEFTOVER = (PART, SALVAGE)
+MAX_BLOCK = 32768 + 64  # MAX_NETCHAN_MSGLEN, plus the headroom demos.c leaves for svc_EOF
+EOF_MARKER = struct.pack("<ii", -1, -1)
+
+
+def read_stream(path):
+    """Everything that inflates out of *path*, and whether the gzip stream ended properly."""
+    out = bytearray()
+    with open(path, "rb") as f:
+        inflater = zlib.decompressobj(16 + zlib.MAX_WBITS)
+        while chunk := f.read(1 << 20):
+            try:
+                out += inflater.decompress(chunk)
+            except zlib.error:
+                return bytes(out), False
+        try:
+            out += inflater.flush()
+        except zlib.error:
+            return bytes(out), False
+        return bytes(out), inflater.eof
+
+
+def whole_blocks(data):
+    """The length of *data* covered by whole blocks, and whether the end marker follows them."""
+    pos = 0
+    while pos + 8 <= len(data):
+        seq, size = struct.unpack_from("<ii", data, pos)
+        if seq == -1 and size == -1:
+            return pos, True
+        if size < 0 or size > MAX_BLOCK or pos + 8 + size > len(data):
+            break
+        pos += 8 + size
+    return pos, False
+
+
+def target_for(path, outdir):
+    name = os.path.basename(path)
+    for suffix in LEFTOVER:
+        if name.endswith(suffix):
+            name = name[:-len(suffix)]
+    if name.endswith(".gz"):
+        name = name[:-3]
+    return os.path.join(outdir or os.path.dirname(path) or ".", name)
+
+
+def index_for(path):
+    """The seek index the server wrote beside *path*: ``.idx``, or ``.idx.part`` for a .part and
+    ``.idx.salvage`` for a .salvage."""
+    for suffix in LEFTOVER:
+        if path.endswith(suffix):
+            return path[:-len(suffix)] + ".idx" + suffix
+    return path + ".idx"
+
+
+def carry_index(path, target, used, keep):
+    source = index_for(path)
+    try:
+        with open(source, encoding="utf-8") as f:
+            lines = f.read().splitlines()
+    except FileNotFoundError:
+        return
+
+    out = []
+    for n, line in enumerate(lines):
+        try:
+            entry = json.loads(line)
+        except ValueError:
+            break  # the server stopped mid-line
+        if n == 0:
+            entry["compressed"] = False
+        elif entry.get("offset", 0) >= used:
+            break
+        out.append(json.dumps(entry, separators=(",", ":")))
+
+    with open(target + ".idx.tmp", "w", encoding="utf-8") as f:
+        f.write("".join(line + "\n" for line in out))
+    os.replace(target + ".idx.tmp", target + ".idx")
+    if not keep:
+        os.unlink(source)
+
+
+def expand(path, outdir, salvage, keep):
+    data, complete = read_stream(path)
+    used, terminated = whole_blocks(data)
+    if not (complete and terminated):
+        if not salvage:
+            print(f"{path}: truncated after {used} bytes of whole blocks; --salvage to keep them",
+                  file=sys.stderr)
+            return False
+        if used == 0:
+            print(f"{path}: not even a gamestate survived", file=sys.stderr)
+            return False
+        data = data[:used] + EOF_MARKER
+    else:
+        data = data[:used + len(EOF_MARKER)]
+
+    target = target_for(path, outdir)
+    os.makedirs(os.path.dirname(target) or ".", exist_ok=True)
+    tmp = target + ".tmp"
+    with open(tmp, "wb") as f:
+        f.write(data)
+    os.replace(tmp, target)
+    whole = complete and terminated
+    carry_index(path, target, used, keep or not whole)
+    if not keep and whole:
+        os.unlink(path)
+    print(f"{path} -> {target} ({len(data)} bytes)")
+    return True
+
+
+def inputs(paths, salvage):
+    wanted = (SUFFIX,) + tuple(SUFFIX + s for s in LEFTOVER) if salvage else (SUFFIX,)
+    for path in paths:
+        if os.path.isdir(path):
+            for root, _, files in os.walk(path):
+                for name in sorted(files):
+                    if name.endswith(wanted):
+                        yield os.path.join(root, name)
+        else:
+            yield path
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("paths", nargs="+", help="compressed demos, or directories to search")
+    parser.add_argument("-o", "--outdir", help="write here instead of beside each input")
+    parser.add_argument("--salvage", action="store_true",
+                        help="keep what survived of truncated demos, .salvage and .part files included "
+                             "(the server keeps a crash's leftovers as .salvage unless sv_demoCleanupParts "
+                             "is 2)")
+    parser.add_argument("-k", "--keep", action="store_true",
+                        help="keep the compressed files (truncated ones are always kept)")
+    args = parser.parse_args()
+
+    failed = 0
+    for path in inputs(args.paths, args.salvage):
+        try:
+            if not expand(path, args.outdir, args.salvage, args.keep):
+                failed += 1
+        except OSError as e:
+            print(f"{path}: {e}", file=sys.stderr)
+            failed += 1
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -183,6 +183,9 @@ SIGNATURES = {
     "players_info": "() -> list[PlayerInfo | None]",
     "get_userinfo": "(client_id: int, /) -> str | None",
     "send_server_command": "(client_id: int | None, cmd: str, /) -> bool",
+    "begin_mergeable_prints": "() -> None",
+    "end_mergeable_prints": "() -> None",
+    "send_server_command_many": "(client_ids: Sequence[int], cmd: str, /) -> int",
     "client_command": "(client_id: int, cmd: str, /) -> bool",
     "console_command": "(cmd: str, /) -> None",
     "get_cvar": "(name: str, /) -> str | None",
@@ -195,6 +198,7 @@ SIGNATURES = {
     "force_vote": "(pass_it: bool, /) -> bool",
     "add_console_command": "(name: str, /) -> None",
     "register_handler": "(event: str, handler: Callable[..., Any] | None, /) -> None",
+    "set_server_command_filter": "(words: Sequence[str] | None, /) -> bool",
     "player_state": "(client_id: int, /) -> PlayerState | None",
     "player_stats": "(client_id: int, /) -> PlayerStats | None",
     "drop_holdable": "(client_id: int, /) -> bool",
@@ -212,7 +216,11 @@ SIGNATURES = {
     "start_demo": "(client_id: int, /) -> bool",
     "stop_demo": "(client_id: int, /) -> bool",
     "demo_status": "(client_id: int, /) -> DemoStatus",
+    "save_demo_window": "(client_id: int, seconds: int, /) -> str | None",
     "reliable_status": "() -> ReliableStatus",
+    "reliable_history": "(client_id: int, frames: int = ..., /) -> bytes",
+    "metric_add": "(name: str, delta: int = 1, /) -> None",
+    "profile_status": "() -> ProfileStatus",
     "drop_item": "(client_id: int, item_id: int, angle: float = ..., /) -> int | None",
     "remove_entity": "(entity_id: int, /) -> bool",
     "spawn_entity": ("(classname: str, keys: dict[str, str | int | float | "
@@ -232,6 +240,9 @@ SIGNATURES = {
 UNPUBLISHED = {
     # _configstring.py imports this directly; the package's configstring() wraps it.
     "get_configstring",
+    # Only the mergeable_prints() context manager in _commands.py pairs these.
+    "begin_mergeable_prints",
+    "end_mergeable_prints",
 }
 
 HEADER = '''"""Type stub for the `_minqlxtended` C extension.